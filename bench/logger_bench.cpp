@@ -0,0 +1,551 @@
+
+#include "logger.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*!
+ * Benchmarks of the logger hot paths.
+ *
+ * Every benchmark reports ns per record and "allocs" - heap allocations per record
+ * made by the logging thread. Sink argument: 0 - /dev/null, 1 - file, 2 - custom handler,
+ * 3 - file written by FdSink, 4 - file written by MmapSink, 5 - file written by UringSink,
+ * 6 - file compressed by GzipSink. BM_NetworkSink also sends records over UDP to a local socket.
+ * BM_KeyValue argument is the output format, BM_Clock argument is the clock source,
+ * records go to the custom handler.
+ */
+
+static thread_local size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++allocations;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+enum Sink
+{
+    DevNull,
+    File,
+    Handler,
+    FdFile,
+    MmapFile,
+    UringFile,
+    GzipFile
+};
+
+static void nullHandler(LoggerStream::Level, const char *s)
+{
+    benchmark::DoNotOptimize(s);
+}
+
+static void setSink(int sink)
+{
+    LoggerStream::setOutputHandler(nullptr);
+
+    switch (sink)
+    {
+    case DevNull:
+        LoggerStream::setLogFileName("/dev/null");
+        break;
+    case File:
+        LoggerStream::setLogFileName("logger_bench.log");
+        break;
+    case Handler:
+        LoggerStream::setOutputHandler(&nullHandler);
+        break;
+    case FdFile:
+        LoggerStream::setLogFileName("logger_bench.log", LoggerStream::FdSink);
+        break;
+    case MmapFile:
+        LoggerStream::setLogFileName("logger_bench.log", LoggerStream::MmapSink);
+        break;
+    case UringFile:
+        LoggerStream::setLogFileName("logger_bench.log", LoggerStream::UringSink);
+        break;
+    case GzipFile:
+        LoggerStream::setLogFileName("logger_bench.log.gz", LoggerStream::GzipSink);
+        break;
+    }
+}
+
+static void setUp(const benchmark::State &state)
+{
+    LoggerStream::setSeverityLevel(LoggerStream::Debug);
+    setSink(int(state.range(0)));
+}
+
+static void setUpAsync(const benchmark::State &state)
+{
+    setUp(state);
+    LoggerStream::setAsync(1 << 20, LoggerStream::Block);
+}
+
+static void setUpFormat(const benchmark::State &state)
+{
+    LoggerStream::setSeverityLevel(LoggerStream::Debug);
+    setSink(Handler);
+    LoggerStream::setOutputFormat(LoggerStream::OutputFormat(state.range(0)));
+}
+
+static void tearDown(const benchmark::State &)
+{
+    LoggerStream::setOutputFormat(LoggerStream::TextFormat);
+    LoggerStream::setSync();
+    LoggerStream::flush();
+    LoggerStream::setOutputHandler(nullptr);
+    LoggerStream::setSeverityLevel(LoggerStream::Debug);
+}
+
+static void reportAllocations(benchmark::State &state, size_t before)
+{
+    state.counters["allocs"] = benchmark::Counter(double(allocations - before),
+                                                  benchmark::Counter::kAvgIterations);
+}
+
+static void BM_DisabledLevel(benchmark::State &state)
+{
+    LoggerStream::setSeverityLevel(LoggerStream::Warning);
+    size_t before = allocations;
+    int i = 0;
+
+    for (auto _ : state)
+    {
+        logDebug() << "disabled" << ++i;
+    }
+
+    reportAllocations(state, before);
+    LoggerStream::setSeverityLevel(LoggerStream::Debug);
+}
+BENCHMARK(BM_DisabledLevel);
+
+static void BM_DisabledLevelMacro(benchmark::State &state)
+{
+    LoggerStream::setSeverityLevel(LoggerStream::Warning);
+    size_t before = allocations;
+    int i = 0;
+
+    for (auto _ : state)
+    {
+        LOG_DEBUG << "disabled" << ++i;
+        benchmark::ClobberMemory();
+    }
+
+    reportAllocations(state, before);
+    LoggerStream::setSeverityLevel(LoggerStream::Debug);
+}
+BENCHMARK(BM_DisabledLevelMacro);
+
+static void BM_RateLimited(benchmark::State &state)
+{
+    size_t before = allocations;
+    int i = 0;
+
+    for (auto _ : state)
+    {
+        LOG_RATE_LIMIT(LoggerStream::Error, 10, 10) << "dependency failed" << ++i;
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_RateLimited)->Arg(Handler)->Setup(setUp)->Teardown(tearDown)->ThreadRange(1, 8);
+
+static void BM_NamedDisabled(benchmark::State &state)
+{
+    static Logger logger("bench.disabled");
+    Logger::setLevel("bench", LoggerStream::Warning);
+    size_t before = allocations;
+    int i = 0;
+
+    for (auto _ : state)
+    {
+        LOG_DEBUG_TO(logger) << "disabled" << ++i;
+        benchmark::ClobberMemory();
+    }
+
+    reportAllocations(state, before);
+    Logger::resetLevel("bench");
+}
+BENCHMARK(BM_NamedDisabled);
+
+static void BM_FlightRecorder(benchmark::State &state)
+{
+    LoggerStream::setSeverityLevel(LoggerStream::Warning);
+    LoggerStream::setFlightRecorder(1024);
+    size_t before = allocations;
+    int i = 0;
+
+    for (auto _ : state)
+    {
+        logDebug() << "recorded" << ++i;
+    }
+
+    reportAllocations(state, before);
+    LoggerStream::setFlightRecorder(0);
+    LoggerStream::setSeverityLevel(LoggerStream::Debug);
+}
+BENCHMARK(BM_FlightRecorder)->ThreadRange(1, 8);
+
+static void BM_ScopeDisabled(benchmark::State &state)
+{
+    LoggerStream::setSeverityLevel(LoggerStream::Warning);
+    size_t before = allocations;
+
+    for (auto _ : state)
+    {
+        auto timer = logScope("disabled");
+        benchmark::ClobberMemory();
+    }
+
+    reportAllocations(state, before);
+    LoggerStream::setSeverityLevel(LoggerStream::Debug);
+}
+BENCHMARK(BM_ScopeDisabled);
+
+static void BM_ScopeUnderThreshold(benchmark::State &state)
+{
+    size_t before = allocations;
+
+    for (auto _ : state)
+    {
+        auto timer = logScope("fast", std::chrono::seconds(1));
+        benchmark::ClobberMemory();
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_ScopeUnderThreshold);
+
+static void BM_ShortString(benchmark::State &state)
+{
+    size_t before = allocations;
+
+    for (auto _ : state)
+    {
+        logInfo() << "short" << "message";
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_ShortString)->Arg(DevNull)->Arg(File)->Arg(Handler)->Arg(FdFile)->Arg(MmapFile)->Arg(UringFile)
+    ->Arg(GzipFile)->Setup(setUp)->Teardown(tearDown);
+
+static void BM_PoolSteadyState(benchmark::State &state)
+{
+    // records up to the buffer limit and records nested in others, both served by the pool
+    const std::string text(4096, 'x');
+    size_t sizes[] = {16, 200, 1000, 4000};
+    size_t i = 0;
+    for (size_t warm = 0; warm < 64; ++warm)
+        logInfo() << std::string_view(text.data(), sizes[warm % 4]);
+
+    size_t before = allocations;
+
+    for (auto _ : state)
+    {
+        LoggerStream outer(LoggerStream::Info);
+        outer << std::string_view(text.data(), sizes[++i % 4]);
+        logInfo() << "nested" << i;
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_PoolSteadyState)->Arg(Handler)->Setup(setUp)->Teardown(tearDown);
+
+static void BM_LatencyStats(benchmark::State &state)
+{
+    LoggerStream::setLatencyStats(true);
+    size_t before = allocations;
+
+    for (auto _ : state)
+    {
+        logInfo() << "short" << "message";
+    }
+
+    reportAllocations(state, before);
+    LoggerStream::setLatencyStats(false);
+}
+BENCHMARK(BM_LatencyStats)->Arg(Handler)->Setup(setUp)->Teardown(tearDown);
+
+static void BM_Degradation(benchmark::State &state)
+{
+    // watched but never degraded, the cost of the pressure checks
+    LoggerStream::setDegradation(LoggerStream::DegradeOptions());
+    size_t before = allocations;
+
+    for (auto _ : state)
+    {
+        logInfo() << "short" << "message";
+    }
+
+    reportAllocations(state, before);
+    LoggerStream::disableDegradation();
+}
+BENCHMARK(BM_Degradation)->Arg(Handler)->Arg(FdFile)->Setup(setUp)->Teardown(tearDown)->ThreadRange(1, 8);
+
+static int collector = -1;
+static std::shared_ptr<LoggerStream::Sink> networkSink;
+
+static void setUpNetwork(const benchmark::State &state)
+{
+    setUp(state);
+
+    // a collector which never reads, the kernel discards datagrams
+    collector = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(collector, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+
+    socklen_t size = sizeof(address);
+    getsockname(collector, reinterpret_cast<sockaddr *>(&address), &size);
+
+    LoggerStream::NetworkOptions options;
+    options.address = "127.0.0.1:" + std::to_string(ntohs(address.sin_port));
+    networkSink = LoggerStream::networkSink(options);
+    LoggerStream::addSink(networkSink);
+}
+
+static void tearDownNetwork(const benchmark::State &state)
+{
+    tearDown(state);
+    LoggerStream::removeSink(networkSink);
+    networkSink.reset();
+    close(collector);
+}
+
+static void BM_NetworkSink(benchmark::State &state)
+{
+    size_t before = allocations;
+    int i = 0;
+
+    for (auto _ : state)
+    {
+        logInfo() << "thread" << state.thread_index() << ++i;
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_NetworkSink)->Arg(Handler)->ThreadRange(1, 8)->UseRealTime()->Setup(setUpNetwork)->Teardown(tearDownNetwork);
+
+static void BM_Numeric(benchmark::State &state)
+{
+    size_t before = allocations;
+    int i = 0;
+    double d = 0.5;
+
+    for (auto _ : state)
+    {
+        logInfo() << "numbers" << ++i << d << 42u << -7L;
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_Numeric)->Arg(DevNull)->Arg(File)->Arg(Handler)->Setup(setUp)->Teardown(tearDown);
+
+#ifdef LOGGER_CHECKED_FORMAT
+static void BM_Format(benchmark::State &state)
+{
+    size_t before = allocations;
+    int id = 42;
+    double ms = 3.5;
+
+    for (auto _ : state)
+    {
+        logInfo("user {} took {} ms", id, ms);
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_Format)->Arg(Handler)->Setup(setUp)->Teardown(tearDown);
+#endif
+
+static void BM_FormatMacro(benchmark::State &state)
+{
+    size_t before = allocations;
+    int id = 42;
+    double ms = 3.5;
+
+    for (auto _ : state)
+    {
+        LOG_INFO_F("user {} took {} ms", id, ms);
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_FormatMacro)->Arg(Handler)->Setup(setUp)->Teardown(tearDown);
+
+static void BM_FormatStream(benchmark::State &state)
+{
+    size_t before = allocations;
+    int id = 42;
+    double ms = 3.5;
+
+    for (auto _ : state)
+    {
+        logInfo() << "user" << id << "took" << ms << "ms";
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_FormatStream)->Arg(Handler)->Setup(setUp)->Teardown(tearDown);
+
+static void BM_Quote(benchmark::State &state)
+{
+    size_t before = allocations;
+    std::string user = "user@example.com";
+
+    for (auto _ : state)
+    {
+        logInfo().quote() << "login" << user << 200;
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_Quote)->Arg(DevNull)->Arg(Handler)->Setup(setUp)->Teardown(tearDown);
+
+static void BM_QuoteLarge(benchmark::State &state)
+{
+    size_t before = allocations;
+    std::string payload;
+    for (int i = 0; payload.size() < 4096; ++i)
+        payload += i % 16 == 0 ? "{\"key\": \"value\"}\n" : "plain user supplied text ";
+
+    for (auto _ : state)
+    {
+        logInfo().quote() << "payload" << payload;
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(payload.size()));
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_QuoteLarge)->Arg(Handler)->Setup(setUp)->Teardown(tearDown);
+
+static void BM_LargeMessage(benchmark::State &state)
+{
+    size_t before = allocations;
+    std::string payload(4 << 20, 'x');
+
+    // the second argument enables borrowing of the payload
+    LoggerStream::setStreamingThreshold(state.range(1) ? 64 * 1024 : 0);
+
+    for (auto _ : state)
+    {
+        logInfo() << "request" << payload;
+    }
+
+    LoggerStream::setStreamingThreshold(0);
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(payload.size()));
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_LargeMessage)->Args({DevNull, 0})->Args({DevNull, 1})->Args({FdFile, 0})->Args({FdFile, 1})
+    ->Setup(setUp)->Teardown(tearDown);
+
+static void BM_Nospace(benchmark::State &state)
+{
+    size_t before = allocations;
+    int i = 0;
+
+    for (auto _ : state)
+    {
+        logInfo().nospace() << "key=" << ++i << ";value=" << "text";
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_Nospace)->Arg(DevNull)->Arg(Handler)->Setup(setUp)->Teardown(tearDown);
+
+static void BM_KeyValue(benchmark::State &state)
+{
+    size_t before = allocations;
+    int i = 0;
+    std::string user = "user \"name\"";
+
+    for (auto _ : state)
+    {
+        logInfo() << "request" << kv("user", user) << kv("id", ++i) << kv("ms", 1.25);
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_KeyValue)->Arg(LoggerStream::TextFormat)->Arg(LoggerStream::LogfmtFormat)->Arg(LoggerStream::JsonFormat)
+    ->Setup(setUpFormat)->Teardown(tearDown);
+
+static void setUpClock(const benchmark::State &state)
+{
+    LoggerStream::setSeverityLevel(LoggerStream::Debug);
+    setSink(Handler);
+    LoggerStream::setClock(LoggerStream::ClockSource(state.range(0)));
+}
+
+static void tearDownClock(const benchmark::State &state)
+{
+    LoggerStream::setClock(LoggerStream::RealtimeClock);
+    tearDown(state);
+}
+
+static void BM_Clock(benchmark::State &state)
+{
+    size_t before = allocations;
+
+    for (auto _ : state)
+    {
+        logInfo() << "short" << "message";
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_Clock)->Arg(LoggerStream::RealtimeClock)->Arg(LoggerStream::MonotonicClock)
+    ->Arg(LoggerStream::CoarseClock)->Arg(LoggerStream::TscClock)->Setup(setUpClock)->Teardown(tearDownClock);
+
+static void BM_Threads(benchmark::State &state)
+{
+    size_t before = allocations;
+    int i = 0;
+
+    for (auto _ : state)
+    {
+        logInfo() << "thread" << state.thread_index() << ++i;
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_Threads)->Arg(DevNull)->Arg(File)->Arg(Handler)->Arg(FdFile)->Arg(MmapFile)
+    ->ThreadRange(1, 64)->UseRealTime()->Setup(setUp)->Teardown(tearDown);
+
+static void BM_AsyncThreads(benchmark::State &state)
+{
+    size_t before = allocations;
+    int i = 0;
+
+    for (auto _ : state)
+    {
+        logInfo() << "thread" << state.thread_index() << ++i;
+    }
+
+    reportAllocations(state, before);
+}
+BENCHMARK(BM_AsyncThreads)->Arg(DevNull)->Arg(File)->Arg(Handler)->Arg(FdFile)->Arg(UringFile)->Arg(GzipFile)
+    ->ThreadRange(1, 64)->UseRealTime()->Setup(setUpAsync)->Teardown(tearDown);
+
+BENCHMARK_MAIN();
@@ -1,91 +1,722 @@
 
 #include "logger.h"
+#include "logger_escape.h"
+#include "logger_ring.h"
+#include "logger_clock.h"
+#include "logger_compress.h"
+#include "logger_degrade.h"
+#include "logger_file.h"
+#include "logger_flight.h"
+#include "logger_network.h"
+#include "logger_stats.h"
 
 #include <mutex>
 #include <iomanip>
 #include <atomic>
 #include <deque>
 #include <string>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <map>
+#include <vector>
 
-#include <sys/time.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 
 static std::atomic<LoggerStream::OutputHandler> outputHandler {nullptr};
-static std::atomic<LoggerStream::Level> severityLevel {LoggerStream::Debug};
-static std::atomic<FILE *> outputStream = {stderr};
-static void logHandler(LoggerStream::Level, const char *s);
+// nullptr is stderr
+static std::atomic<LoggerFile *> outputStream {nullptr};
+static void logHandler(const LoggerRing::Record &record, const char *s, size_t size);
+static void logHandler(const LoggerRing::Record &record, const LoggerStream::Bytes *parts, size_t count, size_t size);
+static bool writesParts(LoggerStream::Level level, bool named, size_t size);
+static void writeRecord(const LoggerRing::Record &record, const std::string &str);
 static char logLevelToChar(LoggerStream::Level level);
+static const char *logLevelToName(LoggerStream::Level level);
+static void appendHeader(std::string &str, LoggerStream::Level level, uint64_t time);
+static void appendHeader(std::string &str, LoggerStream::Level level, uint64_t time,
+                         uint32_t threadId, std::string_view threadName);
+static void appendThreadFields(std::string &str, pid_t pid, uint32_t threadId, std::string_view threadName);
+static void appendStructuredHeader(std::string &str, LoggerStream::OutputFormat format,
+                                   LoggerStream::Level level, uint64_t time);
+static void patchFraction(char *digits, int count, uint64_t time);
+static void appendLogfmtField(std::string &out, std::string_view key, std::string_view value);
 
+namespace
+{
+    //! Immutable snapshot of prefixes, republished by every setter.
+    struct Prefixes
+    {
+        std::string application;
+        std::string message;
+    };
+}
+
+// serializes setters only, readers use prefixVersion
 static std::mutex prefixMutex;
-static std::string messagePrefix;
-static std::string applicationPrefix;
+static std::shared_ptr<const Prefixes> prefixes;
+static std::atomic<unsigned> prefixVersion {0};
+static const Prefixes &currentPrefixes();
+static void publishPrefixes(std::string *application, std::string *message);
+
+namespace
+{
+    struct SinkEntry
+    {
+        std::shared_ptr<LoggerStream::Sink> sink;
+        LoggerStream::Level level;
+    };
+
+    //! Immutable snapshot of sinks and the record handler, republished by every change.
+    struct Sinks
+    {
+        std::vector<SinkEntry> entries;
+        LoggerStream::RecordHandler recordHandler = nullptr;
+        void *context = nullptr;
+    };
+}
+
+// serializes changes only, readers use sinksVersion
+static std::mutex sinksMutex;
+static std::shared_ptr<const Sinks> sinks;
+static std::atomic<unsigned> sinksVersion {0};
+static std::atomic<bool> hasSinks {false};
+// level of the log file or the output handler
+static std::atomic<LoggerStream::Level> outputLevel {LoggerStream::Debug};
+// the lowest level of the outputs, lower records are kept by the flight recorder only
+static std::atomic<LoggerStream::Level> writtenLevel {LoggerStream::Debug};
+// Fatal if the flight recorder is disabled
+static std::atomic<LoggerStream::Level> flightLevel {LoggerStream::Fatal};
+static const Sinks &currentSinks();
+static LoggerStream::Level publishSinks(std::shared_ptr<const Sinks> snapshot);
+static void flushSinks();
+static void writeFlightRecords(const char *data, size_t size, void *context);
+static void installFatalSignalHandlers();
+
+//! Flags of LoggerRing::Record.
+enum RecordFlags : uint16_t
+{
+    NamedRecord = 0x01  //!< Filtered by the level of a named logger
+};
+
+namespace
+{
+    //! Named logger, never destroyed. Changed under the registry mutex.
+    struct LoggerNode
+    {
+        std::string name;
+        LoggerNode *parent = nullptr;
+        std::vector<LoggerNode *> children;
+        bool hasLevel = false;
+        LoggerStream::Level ownLevel = LoggerStream::Debug;
+        //! Own or inherited level
+        std::atomic<LoggerStream::Level> level {LoggerStream::Debug};
+    };
+
+    struct LoggerRegistry
+    {
+        std::mutex mutex;
+        LoggerNode root;
+        std::map<std::string, LoggerNode *, std::less<>> nodes;
+    };
+}
+
+static LoggerRegistry &loggerRegistry();
+static LoggerNode *findLoggerNode(LoggerRegistry &registry, std::string_view name);
+static void propagateLevel(LoggerNode *node);
 
 static std::mutex logFileNameMutex;
 static std::string logFileName;
+static LoggerStream::SinkKind logFileKind = LoggerStream::StdioSink;
+
+static std::atomic<size_t> rotationMaxSize {0};
+static std::atomic<unsigned> rotationInterval {0};
+static std::atomic<unsigned> rotationMaxFiles {5};
+static std::atomic<size_t> outputFileSize {0};
+static std::atomic<time_t> outputFileOpened {0};
+static std::atomic<bool> autoRotating {false};
+static void checkAutoRotation(size_t bytes);
+static void retireStream(LoggerFile *stream);
+
+static std::atomic<bool> binaryMode {false};
+static std::atomic<LoggerStream::OutputFormat> outputFormat {LoggerStream::TextFormat};
+// digits of fractions of a second: 3, 6 or 9
+static std::atomic<int> timeDigits {3};
+static std::atomic<bool> printThreadId {false};
+
+static std::atomic<size_t> poolReserve {16};
+static std::atomic<size_t> poolBufferSize {256};
+static std::atomic<size_t> poolBufferLimit {64 * 1024};
+
+class LoggerStream::Pool
+{
+public:
+    Pool();
+    ~Pool();
+
+    Pool(const Pool &) = delete;
+    Pool & operator = (const Pool &) = delete;
+
+    Stream *get();
+    void put(Stream *stream);
+
+    //! Queue of the thread in asynchronous mode
+    std::shared_ptr<LoggerRing> ring;
+    bool destroyed = false;
+
+private:
+    Stream *head = nullptr;
+    size_t size = 0;
+    size_t capacity;
+    size_t bufferSize;
+    size_t bufferLimit;
+};
 
-thread_local std::deque<std::shared_ptr<LoggerStream::Stream>> LoggerStream::pool;
+thread_local LoggerStream::Pool LoggerStream::pool;
+std::atomic<LoggerStream::Level> LoggerStream::severityLevel {LoggerStream::Debug};
+std::atomic<std::size_t> LoggerStream::streamingThreshold {SIZE_MAX};
 
 namespace
 {
+    //! Hazard pointer of a thread writing to outputStream. The stream is closed after
+    //! rotation only when no hazard pointer refers to it.
+    struct alignas(64) StreamHazard
+    {
+        std::atomic<LoggerFile *> stream {nullptr};
+        std::atomic<bool> used {false};
+    };
+
+    const size_t maxStreamHazards = 256;
+    StreamHazard streamHazards[maxStreamHazards];
+
+    // threads without a hazard pointer write under the mutex
+    std::mutex unguardedMutex;
+
+    //! Hazard pointer owned by the thread.
+    struct HazardOwner
+    {
+        HazardOwner()
+        {
+            for (StreamHazard &h : streamHazards)
+            {
+                bool expected = false;
+                if (!h.used.load(std::memory_order_relaxed) &&
+                    h.used.compare_exchange_strong(expected, true))
+                {
+                    hazard = &h;
+                    break;
+                }
+            }
+        }
+
+        ~HazardOwner()
+        {
+            if (hazard)
+            {
+                hazard->stream.store(nullptr, std::memory_order_release);
+                hazard->used.store(false, std::memory_order_release);
+                // streams used later by this thread are guarded by the mutex
+                hazard = nullptr;
+            }
+        }
+
+        StreamHazard *hazard = nullptr;
+    };
+
+    thread_local HazardOwner hazardOwner;
+
+    //! Protects outputStream from closing while it is used.
+    class StreamGuard
+    {
+    public:
+        StreamGuard()
+            : hazard(hazardOwner.hazard)
+        {
+            if (hazard)
+            {
+                previous = hazard->stream.load(std::memory_order_relaxed);
+                stream = outputStream.load();
+                for (;;)
+                {
+                    hazard->stream.store(stream);
+                    LoggerFile *current = outputStream.load();
+                    if (current == stream)
+                        break;
+                    stream = current;
+                }
+            }
+            else
+            {
+                lock = std::unique_lock<std::mutex>(unguardedMutex);
+                stream = outputStream.load();
+            }
+        }
+
+        ~StreamGuard()
+        {
+            if (hazard)
+                hazard->stream.store(previous, std::memory_order_release);
+        }
+
+        StreamGuard(const StreamGuard &) = delete;
+        StreamGuard & operator = (const StreamGuard &) = delete;
+
+        LoggerFile *get() const
+        {
+            return stream ? stream : LoggerFile::standardError();
+        }
+
+    private:
+        StreamHazard *hazard;
+        LoggerFile *previous = nullptr;
+        LoggerFile *stream = nullptr;
+        std::unique_lock<std::mutex> lock;
+    };
+
+    //! Coalesces records written to outputStream according to the flush policy.
+    class OutputBuffer
+    {
+    public:
+        void setPolicy(bool every, LoggerStream::Level level, unsigned intervalMs, size_t bytes);
+
+        void write(LoggerStream::Level level, const char *s, size_t size);
+        //! Writes one record of \a count parts after buffered records.
+        void writeParts(const LoggerStream::Bytes *parts, size_t count);
+        void flush();
+        //! Submits records kept by the output file.
+        void sync();
+        //! Flush if the interval of the policy is expired.
+        void flushExpired();
+
+        //! Returns the flush interval or 0.
+        unsigned interval() const
+        {
+            return intervalMs.load(std::memory_order_relaxed);
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        void flushLocked();
+
+        // the buffer never grows over this size
+        static const size_t maxBufferSize = 1 << 20;
+
+        std::mutex mutex;
+        std::string data;
+        Clock::time_point lastFlush;
+
+        std::atomic<bool> buffered {false};
+        std::atomic<unsigned> intervalMs {0};
+        LoggerStream::Level level = LoggerStream::Fatal;
+        size_t bytes = 0;
+    };
+
+    // must be destroyed after closeStream
+    OutputBuffer outputBuffer;
+
+    // set when the log file is closed at exit, sinks outliving it write to stderr
+    std::atomic<bool> outputClosed {false};
+
     struct CloseStream
     {
         ~CloseStream()
         {
-            FILE *stream = std::atomic_exchange(&outputStream, stderr);
-            if (stream != stderr)
-                fclose(stream);
+            // sinks are released first, a network sink writes records it could not send to the log file
+            std::shared_ptr<const Sinks> released;
+            {
+                std::lock_guard<std::mutex> lock(sinksMutex);
+                released = sinks;
+                publishSinks(nullptr);
+            }
+            if (released)
+            {
+                for (const SinkEntry &entry : released->entries)
+                    entry.sink->flush();
+                released.reset();
+            }
+
+            outputBuffer.flush();
+            outputClosed.store(true, std::memory_order_release);
+            retireStream(std::atomic_exchange(&outputStream, (LoggerFile *)nullptr));
         }
 
     } closeStream;
+
+    std::atomic<pid_t> processId {0};
+
+    thread_local pid_t threadIdCache = 0;
+
+    void refreshProcessId()
+    {
+        processId.store(::getpid(), std::memory_order_relaxed);
+        // the child runs in a copy of the forking thread
+        threadIdCache = 0;
+    }
+
+    uint32_t currentThreadId()
+    {
+        if (threadIdCache == 0)
+            threadIdCache = pid_t(::syscall(SYS_gettid));
+        return uint32_t(threadIdCache);
+    }
+
+    pid_t currentProcessId()
+    {
+        pid_t pid = processId.load(std::memory_order_relaxed);
+        if (pid == 0)
+        {
+            pid = ::getpid();
+            processId.store(pid, std::memory_order_relaxed);
+        }
+        return pid;
+    }
+
+    struct ProcessIdTracker
+    {
+        ProcessIdTracker()
+        {
+            pthread_atfork(nullptr, nullptr, &refreshProcessId);
+        }
+    } processIdTracker;
+
+    //! Name of the thread printed in the header. Trivially destructible, records may be
+    //! written by destructors of thread local objects.
+    struct ThreadName
+    {
+        char text[32];
+        unsigned char size = 0;
+
+        std::string_view view() const
+        {
+            return std::string_view(text, size);
+        }
+    };
+
+    thread_local ThreadName threadName;
+
+    //! Whole header of a level for the current second, the fraction is patched in place.
+    struct HeaderTemplate
+    {
+        char text[256];
+        uint16_t size = 0;
+        //! Offset of the fraction digits
+        uint16_t fraction = 0;
+        unsigned generation = 0;
+    };
+
+    //! Formatted date and time of the current second, reformatted only when the second
+    //! or the precision changes. The static part of the header is kept in templates
+    //! rebuilt when the date, prefixes, the process or the thread fields change.
+    struct HeaderCache
+    {
+        time_t second = -1;
+        int digits = 0;
+        // "dd.mm.yyyy hh:mm:ss.mmm "
+        char dateTime[64];
+        int dateTimeSize = 0;
+
+        // " [pid:tid name] prefix: " of this thread, -1 if it doesn't fit
+        char fragment[192];
+        int fragmentSize = 0;
+        pid_t pid = 0;
+        unsigned prefixVersion = 0;
+        bool threadId = false;
+        bool fragmentStale = true;
+
+        //! Changed when the date or the fragment changes
+        unsigned generation = 1;
+        HeaderTemplate templates[LoggerStream::Fatal + 1];
+
+        // "yyyy-mm-ddThh:mm:ss.mmmZ" of logfmt and JSON
+        time_t isoSecond = -1;
+        int isoDigits = 0;
+        char isoTime[64];
+        int isoTimeSize = 0;
+    };
+
+    thread_local HeaderCache headerCache;
+
+    //! Thread local copy of the prefix snapshot.
+    struct PrefixCache
+    {
+        unsigned version = 0;
+        std::shared_ptr<const Prefixes> prefixes;
+    };
+
+    thread_local PrefixCache prefixCache;
+
+    //! Thread local copy of the sink snapshot.
+    struct SinkCache
+    {
+        unsigned version = 0;
+        std::shared_ptr<const Sinks> sinks;
+    };
+
+    thread_local SinkCache sinkCache;
+
+    //! Merges per thread rings in the timestamp order and writes records on a background thread.
+    class AsyncWriter
+    {
+    public:
+        ~AsyncWriter()
+        {
+            stop();
+            drain();
+        }
+
+        void start(size_t capacity, LoggerStream::OverflowPolicy policy);
+        void stop();
+
+        //! Enqueue the record to the \a ring of the calling thread, creates the ring if needed.
+        //! Returns false if the record must be written synchronously.
+        bool push(std::shared_ptr<LoggerRing> &ring, const LoggerRing::Record &record,
+                  const std::string &str);
+        void flush();
+
+        //! Returns true if a record of \a size bytes is written synchronously. Queued records
+        //! are flushed then, like by push().
+        bool bypass(size_t size);
+
+        size_t droppedCount() const
+        {
+            return dropped.load(std::memory_order_relaxed);
+        }
+
+    private:
+        void run();
+        void wakeup();
+        //! Writes records queued before the call, returns false if there were none.
+        bool drain();
+        bool drainLocked();
+        //! Waits until the consumer frees space in \a ring or the writer stops. \a tail is
+        //! the tail of the ring read before the failed push.
+        void waitSpace(LoggerRing &ring, uint64_t tail);
+
+        // guards rings, thread and stopping
+        std::mutex mutex;
+        std::condition_variable wakeCondition;
+        std::vector<std::shared_ptr<LoggerRing>> rings;
+        std::atomic<unsigned> ringsVersion {0};
+        bool stopping = false;
+        std::thread thread;
+
+        // guards the consumer side of rings
+        std::mutex drainMutex;
+        std::vector<std::shared_ptr<LoggerRing>> drainRings;
+        //! Heads of drainRings when the drain started
+        std::vector<uint64_t> drainLimits;
+        unsigned drainVersion = 0;
+        std::string drainData;
+
+        // signalled when a drain finishes
+        std::mutex drainedMutex;
+        std::condition_variable drainedCondition;
+
+        // signalled when records are consumed from a ring whose producer waits for space
+        std::mutex spaceMutex;
+        std::condition_variable spaceCondition;
+
+        //! Capacity of new rings, rounded as by the ring
+        std::atomic<size_t> ringCapacity {0};
+        std::atomic<LoggerStream::OverflowPolicy> policy {LoggerStream::Block};
+        std::atomic<bool> running {false};
+        std::atomic<bool> sleeping {false};
+        std::atomic<std::thread::id> writerThread {};
+        std::atomic<size_t> dropped {0};
+    };
+
+    // must be destroyed before closeStream
+    AsyncWriter asyncWriter;
+
+    //! Rate limited sites which suppressed records, see RateLimit::suppress()
+    std::atomic<LoggerStream::RateLimit *> suppressingSites {nullptr};
 }
 
-LoggerStream::LoggerStream(Level level)
+void LoggerStream::init(Level level)
 {
-    Level currentSeverityLevel = std::atomic_load(&severityLevel);
+    if (level < Error && LoggerDegrade::mode() != NormalMode && !LoggerDegrade::allow(level))
+        return;
+
+    stream = getFromPool();
+    stream->str.clear();
+    stream->fields.clear();
+    stream->borrowed.clear();
+    stream->borrowedSize = 0;
+    stream->level = level;
+    stream->space = true;
+    stream->quote = false;
+    stream->hex = false;
+    stream->named = false;
+    stream->precision = 6;
+    stream->format = outputFormat.load(std::memory_order_relaxed);
+    // records of the flight recorder are kept formatted
+    stream->binary = stream->format == TextFormat && binaryMode.load(std::memory_order_relaxed) &&
+                     level >= writtenLevel.load(std::memory_order_relaxed);
+
+    stream->time = LoggerClock::now();
+    stream->threadId = currentThreadId();
+    stream->headerSize = 0;
+
+    if (stream->binary)
+    {
+        // the header is formatted by decodeRecord()
+        std::string_view name = threadName.view();
+        stream->str.append(reinterpret_cast<const char *>(&stream->time), sizeof(stream->time));
+        stream->str.append(reinterpret_cast<const char *>(&stream->threadId), sizeof(stream->threadId));
+        stream->str += char(name.size());
+        stream->str += name;
+    }
+    else
+    {
+        if (stream->format == TextFormat)
+            appendHeader(stream->str, level, stream->time);
+        else
+            appendStructuredHeader(stream->str, OutputFormat(stream->format), level, stream->time);
+
+        stream->headerSize = uint32_t(stream->str.size());
+    }
+}
 
-    if (level >= currentSeverityLevel)
+LoggerStream::LoggerStream(Level level, RateLimit &limit)
+{
+    if (isEnabled(level))
     {
-        stream = getFromPool();
-        stream->str.clear();
-        stream->level = level;
-        stream->space = true;
-        stream->quote = false;
+        uint64_t suppressed = limit.suppressed.exchange(0, std::memory_order_relaxed);
+        if (suppressed != 0)
+        {
+            LoggerStream(level) << "suppressed" << suppressed << "similar messages";
+        }
 
-        timeval tv;
-        ::gettimeofday(&tv, NULL);
+        init(level);
+    }
+}
 
-        struct tm tm;
-        localtime_r(&tv.tv_sec, &tm);
+void LoggerStream::RateLimit::suppress()
+{
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    LoggerStats::add(LoggerStats::Suppressed);
+
+    if (listed.load(std::memory_order_relaxed) || listed.exchange(true, std::memory_order_relaxed))
+        return;
+
+    // sites are static objects, they stay listed until exit
+    next = suppressingSites.load(std::memory_order_relaxed);
+    while (!suppressingSites.compare_exchange_weak(next, this, std::memory_order_release,
+                                                   std::memory_order_relaxed))
+    {
+    }
 
-        char header[128];
+    // after the logger objects are constructed, so runs before they are destroyed
+    static const int atExit = atexit(&LoggerStream::writeSuppressed);
+    (void)atExit;
+}
+
+void LoggerStream::writeSuppressed()
+{
+    for (RateLimit *site = suppressingSites.load(std::memory_order_acquire); site; site = site->next)
+    {
+        if (site->suppressed.load(std::memory_order_relaxed) == 0 || !isEnabled(site->level))
+            continue;
 
+        uint64_t suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+        if (suppressed != 0)
         {
-            std::lock_guard<std::mutex> lock(prefixMutex);
-            snprintf(header, sizeof(header) - 1,
-                     "%s%02d.%02d.%d %02d:%02d:%02d.%03d %c [%d] %s: ", applicationPrefix.c_str(),
-                     tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec,
-                     (int)tv.tv_usec / 1000, logLevelToChar(level), getpid(),
-                     messagePrefix.c_str());
+            LoggerStream(site->level) << "suppressed" << suppressed << "similar messages at"
+                                      << std::string(site->file) + ":" + std::to_string(site->line);
         }
+    }
+}
 
-        // ensure last char is null terminator
-        header[sizeof(header) - 1] = 0;
+bool LoggerStream::RateLimit::allow(uint64_t interval, unsigned burst)
+{
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t capacity = int64_t(interval) * (burst > 0 ? burst - 1 : 0);
 
-        stream->str += header;
+    // GCRA: every record moves the time when the bucket is full by the interval
+    int64_t full = fullTime.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        int64_t start = std::max(full, now);
+        if (start - now > capacity)
+        {
+            suppress();
+            return false;
+        }
 
+        if (fullTime.compare_exchange_weak(full, start + int64_t(interval), std::memory_order_relaxed))
+            return true;
     }
 }
 
 LoggerStream::~LoggerStream()
 {
-    if (stream.unique())
+    if (stream)
     {
-        logHandler(stream->level, stream->str.c_str());
-        pushToPool(std::move(stream));
+        uint64_t start = LoggerStats::measureLatency() ? LoggerStats::now() : 0;
+
+        if (stream->format != TextFormat)
+            finishRecord();
+
+        size_t size = stream->str.size() + stream->borrowedSize;
+        if (!stream->borrowed.empty() && !writesParts(stream->level, stream->named, size))
+            joinBorrowed();
+
+        LoggerRing::Record record = {uint32_t(size), uint8_t(stream->level),
+                                     uint8_t(stream->binary), uint16_t(stream->named ? NamedRecord : 0),
+                                     stream->time,
+                                     stream->threadId, stream->headerSize};
+
+        if (!stream->borrowed.empty())
+        {
+            // text between borrowed strings is referenced in place
+            std::vector<Bytes> &parts = stream->parts;
+            parts.clear();
+            size_t offset = 0;
+            for (const Stream::Borrowed &borrowed : stream->borrowed)
+            {
+                parts.push_back(Bytes{stream->str.data() + offset, borrowed.offset - offset});
+                parts.push_back(borrowed.bytes);
+                offset = borrowed.offset;
+            }
+            parts.push_back(Bytes{stream->str.data() + offset, stream->str.size() - offset});
+
+            logHandler(record, parts.data(), parts.size(), size);
+        }
+        else if (stream->level == Fatal)
+        {
+            // fatal record must be the last one in the log
+            asyncWriter.flush();
+            if (flightLevel.load(std::memory_order_relaxed) != Fatal)
+            {
+                outputBuffer.flush();
+                dumpFlightRecorder();
+            }
+            writeRecord(record, stream->str);
+        }
+        else if (!stream->named && stream->level < writtenLevel.load(std::memory_order_relaxed))
+        {
+            if (stream->level >= flightLevel.load(std::memory_order_relaxed))
+                LoggerFlight::record(stream->time, stream->str.data(), stream->str.size());
+            LoggerStats::add(LoggerStats::Filtered);
+        }
+        else if (pool.destroyed || !asyncWriter.push(pool.ring, record, stream->str))
+        {
+            writeRecord(record, stream->str);
+        }
+        pushToPool(stream);
+
+        if (start != 0)
+            LoggerStats::addLatency(LoggerStats::RecordLatency, start);
     }
 }
 
@@ -96,7 +727,19 @@ void LoggerStream::setOutputHandler(OutputHandler handler)
 
 void LoggerStream::setSeverityLevel(Level level)
 {
-    std::atomic_store(&severityLevel, level);
+    {
+        std::lock_guard<std::mutex> lock(sinksMutex);
+
+        std::atomic_store(&outputLevel, level);
+        std::atomic_store(&severityLevel, publishSinks(sinks));
+    }
+
+    // named loggers without own level
+    LoggerRegistry &registry = loggerRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    registry.root.ownLevel = level;
+    propagateLevel(&registry.root);
 }
 
 void LoggerStream::setSeverityLevel(const std::string &level)
@@ -115,124 +758,1544 @@ void LoggerStream::setSeverityLevel(const std::string &level)
     setSeverityLevel(severity);
 }
 
+void LoggerStream::setRecordHandler(RecordHandler handler, void *context)
+{
+    std::lock_guard<std::mutex> lock(sinksMutex);
+
+    auto snapshot = std::make_shared<Sinks>();
+    if (sinks)
+        *snapshot = *sinks;
+
+    snapshot->recordHandler = handler;
+    snapshot->context = handler ? context : nullptr;
+    std::atomic_store(&severityLevel, publishSinks(std::move(snapshot)));
+}
+
+void LoggerStream::addSink(std::shared_ptr<Sink> sink, Level level)
+{
+    if (!sink)
+        return;
+
+    std::lock_guard<std::mutex> lock(sinksMutex);
+
+    auto snapshot = std::make_shared<Sinks>();
+    if (sinks)
+        *snapshot = *sinks;
+
+    snapshot->entries.push_back(SinkEntry{std::move(sink), level});
+    std::atomic_store(&severityLevel, publishSinks(std::move(snapshot)));
+}
+
+std::shared_ptr<LoggerStream::Sink> LoggerStream::networkSink(NetworkOptions options)
+{
+    return LoggerNetwork::create(std::move(options), [](Level level, const char *s, std::size_t size) {
+        // records of the output level are in the log file already
+        if (level >= outputLevel.load(std::memory_order_relaxed))
+            return;
+
+        if (outputClosed.load(std::memory_order_acquire))
+            LoggerFile::standardError()->writeRecord(s, size);
+        else
+            outputBuffer.write(level, s, size);
+    });
+}
+
+void LoggerStream::setSinkLevel(const std::shared_ptr<Sink> &sink, Level level)
+{
+    std::lock_guard<std::mutex> lock(sinksMutex);
+
+    if (!sinks)
+        return;
+
+    auto snapshot = std::make_shared<Sinks>(*sinks);
+    for (SinkEntry &entry : snapshot->entries)
+    {
+        if (entry.sink == sink)
+            entry.level = level;
+    }
+    std::atomic_store(&severityLevel, publishSinks(std::move(snapshot)));
+}
+
+void LoggerStream::removeSink(const std::shared_ptr<Sink> &sink)
+{
+    std::lock_guard<std::mutex> lock(sinksMutex);
+
+    if (!sinks)
+        return;
+
+    auto snapshot = std::make_shared<Sinks>(*sinks);
+    auto isSink = [&sink](const SinkEntry &entry) {
+        return entry.sink == sink;
+    };
+    std::vector<SinkEntry> &entries = snapshot->entries;
+    entries.erase(std::remove_if(entries.begin(), entries.end(), isSink), entries.end());
+    std::atomic_store(&severityLevel, publishSinks(std::move(snapshot)));
+}
+
 void LoggerStream::setApplicationPrefix(std::string prefix)
 {
     if (!prefix.empty())
         prefix += ' ';
 
-    std::lock_guard<std::mutex> lock(prefixMutex);
-    applicationPrefix = std::move(prefix);
+    publishPrefixes(&prefix, nullptr);
 }
 
 void LoggerStream::setMessagePrefix(std::string prefix)
 {
-    std::lock_guard<std::mutex> lock(prefixMutex);
-    messagePrefix = std::move(prefix);
+    publishPrefixes(nullptr, &prefix);
+}
+
+void LoggerStream::setOutputFormat(OutputFormat format)
+{
+    outputFormat.store(format, std::memory_order_relaxed);
+}
+
+void LoggerStream::setClock(ClockSource clock)
+{
+    LoggerClock::setSource(clock);
+}
+
+void LoggerStream::setTimePrecision(TimePrecision precision)
+{
+    timeDigits.store(precision == Nanoseconds ? 9 : precision == Microseconds ? 6 : 3,
+                     std::memory_order_relaxed);
 }
 
-void LoggerStream::setLogFileName(std::string fileName)
+void LoggerStream::setThreadIdEnabled(bool enabled)
+{
+    printThreadId.store(enabled, std::memory_order_relaxed);
+}
+
+void LoggerStream::setThreadName(std::string_view name)
+{
+    ThreadName &current = threadName;
+
+    current.size = (unsigned char)std::min(name.size(), sizeof(current.text));
+    memcpy(current.text, name.data(), current.size);
+    headerCache.fragmentStale = true;
+}
+
+void LoggerStream::setLogFileName(std::string fileName, SinkKind kind)
 {
     {
         std::lock_guard<std::mutex> lock(logFileNameMutex);
         logFileName = std::move(fileName);
+        logFileKind = kind;
     }
     rotateFile();
 }
 
+void LoggerStream::setCompression(int level, std::size_t frameSize, unsigned frameInterval)
+{
+    LoggerCompress::configure(level, frameSize, frameInterval);
+}
+
 void LoggerStream::rotateFile()
 {
     std::string fileName;
+    SinkKind kind;
 
     {
         std::lock_guard<std::mutex> lock(logFileNameMutex);
         fileName = logFileName;
+        kind = logFileKind;
     }
 
     if (!fileName.empty())
     {
-        FILE *newFile = fopen(fileName.c_str(), "a");
+        LoggerFile *newFile = LoggerFile::open(fileName, kind);
 
         if (!newFile)
         {
             std::string message = "cannot open log file '";
-            message += logFileName;
+            message += fileName;
             message += "'";
 
             fprintf(stderr, "%s: %s\n", message.c_str(), strerror(errno));
         }
         else
         {
-            FILE *previousFile = std::atomic_exchange(&outputStream, newFile);
+            outputFileSize.store(newFile->initialSize());
+            outputFileOpened.store(time(nullptr));
 
-            if (previousFile && previousFile != stderr)
-            {
-                fclose(previousFile);
-            }
+            // buffered records belong to the previous file
+            outputBuffer.flush();
+            retireStream(std::atomic_exchange(&outputStream, newFile));
         }
     }
 }
 
-std::shared_ptr<LoggerStream::Stream> LoggerStream::getFromPool()
+void LoggerStream::setAsync(std::size_t capacity, OverflowPolicy policy)
 {
-    if (pool.empty())
-    {
-        return std::move(std::make_shared<LoggerStream::Stream>());
-    }
-    else
-    {
-        std::shared_ptr<LoggerStream::Stream> stream{std::move(pool.back())};
-        pool.pop_back();
-        return std::move(stream);
-    }
+    asyncWriter.start(capacity, policy);
 }
 
-void LoggerStream::pushToPool(std::shared_ptr<LoggerStream::Stream> stream)
+void LoggerStream::setSync()
 {
-    pool.push_back(std::move(stream));
+    asyncWriter.stop();
 }
 
-LoggerStream logDebug()
+void LoggerStream::flush()
 {
-    return LoggerStream(LoggerStream::Debug);
+    asyncWriter.flush();
+    outputBuffer.flush();
+    flushSinks();
 }
 
-LoggerStream logInfo()
+std::size_t LoggerStream::droppedCount()
 {
-    return LoggerStream(LoggerStream::Info);
+    return asyncWriter.droppedCount();
 }
 
-LoggerStream logWarning()
+void LoggerStream::setDegradation(DegradeOptions options)
 {
-    return LoggerStream(LoggerStream::Warning);
+    LoggerDegrade::configure(options);
 }
 
-LoggerStream logError()
+void LoggerStream::disableDegradation()
 {
-    return LoggerStream(LoggerStream::Error);
+    LoggerDegrade::disable();
 }
 
-LoggerStream logFatal()
+LoggerStream::DegradeMode LoggerStream::degradeMode()
 {
-    return LoggerStream(LoggerStream::Fatal);
+    return LoggerDegrade::mode();
 }
 
-static void logHandler(LoggerStream::Level level, const char *s)
+LoggerStream::FlushPolicy LoggerStream::FlushPolicy::everyMessage()
 {
-    auto handler = std::atomic_load(&outputHandler);
-
-    if (handler)
-    {
-        handler(level, s);
-    }
-    else
-    {
-        FILE *stream = std::atomic_load(&outputStream);
-        fprintf(stream, "%s\n", s);
-        fflush(stream);
-    }
+    FlushPolicy policy;
+    policy.every = true;
+    return policy;
+}
+
+LoggerStream::FlushPolicy LoggerStream::FlushPolicy::onLevel(Level level)
+{
+    FlushPolicy policy;
+    policy.level = level;
+    return policy;
+}
+
+LoggerStream::FlushPolicy LoggerStream::FlushPolicy::interval(unsigned ms)
+{
+    FlushPolicy policy;
+    policy.intervalMs = ms;
+    return policy;
+}
+
+LoggerStream::FlushPolicy LoggerStream::FlushPolicy::bufferBytes(std::size_t bytes)
+{
+    FlushPolicy policy;
+    policy.bytes = bytes;
+    return policy;
+}
+
+LoggerStream::FlushPolicy LoggerStream::FlushPolicy::operator | (const FlushPolicy &other) const
+{
+    FlushPolicy policy;
+    policy.every = every || other.every;
+    policy.level = std::min(level, other.level);
+
+    if (intervalMs == 0 || other.intervalMs == 0)
+        policy.intervalMs = std::max(intervalMs, other.intervalMs);
+    else
+        policy.intervalMs = std::min(intervalMs, other.intervalMs);
+
+    if (bytes == 0 || other.bytes == 0)
+        policy.bytes = std::max(bytes, other.bytes);
+    else
+        policy.bytes = std::min(bytes, other.bytes);
+
+    return policy;
+}
+
+void LoggerStream::setFlushPolicy(const FlushPolicy &policy)
+{
+    outputBuffer.setPolicy(policy.every, policy.level, policy.intervalMs, policy.bytes);
+}
+
+void LoggerStream::setAutoRotation(std::size_t maxSize, unsigned interval, unsigned maxFiles)
+{
+    rotationMaxFiles.store(maxFiles, std::memory_order_relaxed);
+    rotationInterval.store(interval, std::memory_order_relaxed);
+    rotationMaxSize.store(maxSize, std::memory_order_relaxed);
+}
+
+void LoggerStream::setBinaryMode(bool enabled)
+{
+    binaryMode.store(enabled, std::memory_order_relaxed);
+}
+
+void LoggerStream::decodeRecord(Level level, const char *data, std::size_t size, std::string &text,
+                                std::size_t *headerSize)
+{
+    const char *end = data + size;
+    uint64_t time;
+    uint32_t threadId;
+
+    if (size < sizeof(time) + sizeof(threadId) + 1)
+        return;
+
+    memcpy(&time, data, sizeof(time));
+    data += sizeof(time);
+    memcpy(&threadId, data, sizeof(threadId));
+    data += sizeof(threadId);
+
+    size_t nameSize = static_cast<unsigned char>(*data++);
+    if (size_t(end - data) < nameSize)
+        return;
+    std::string_view name(data, nameSize);
+    data += nameSize;
+
+    size_t start = text.size();
+    appendHeader(text, level, time, threadId, name);
+    if (headerSize)
+        *headerSize = text.size() - start;
+
+    while (data < end)
+    {
+        unsigned char tag = static_cast<unsigned char>(*data++);
+        char buffer[512];
+        std::string fallback;
+        std::string_view value;
+
+        switch (tag & ArgumentTypeMask)
+        {
+        case StringArgument:
+        {
+            uint32_t length;
+            if (end - data < (ptrdiff_t)sizeof(length))
+                return;
+            memcpy(&length, data, sizeof(length));
+            data += sizeof(length);
+            if (end - data < (ptrdiff_t)length)
+                return;
+            value = std::string_view(data, length);
+            data += length;
+            break;
+        }
+        case IntArgument:
+        case UIntArgument:
+        {
+            uint64_t v;
+            if (end - data < (ptrdiff_t)sizeof(v))
+                return;
+            memcpy(&v, data, sizeof(v));
+            data += sizeof(v);
+
+            int base = (tag & HexFlag) ? 16 : 10;
+            std::to_chars_result result = (tag & ArgumentTypeMask) == IntArgument
+                ? std::to_chars(buffer, buffer + sizeof(buffer), int64_t(v), base)
+                : std::to_chars(buffer, buffer + sizeof(buffer), v, base);
+            value = std::string_view(buffer, result.ptr - buffer);
+            break;
+        }
+        case DoubleArgument:
+        case LongDoubleArgument:
+        {
+            bool isDouble = (tag & ArgumentTypeMask) == DoubleArgument;
+            size_t valueSize = isDouble ? sizeof(double) : sizeof(long double);
+            if (end - data < (ptrdiff_t)(valueSize + 1))
+                return;
+
+            double d = 0;
+            long double ld = 0;
+            if (isDouble)
+                memcpy(&d, data, sizeof(d));
+            else
+                memcpy(&ld, data, sizeof(ld));
+            data += valueSize;
+            int precision = static_cast<unsigned char>(*data++);
+
+            std::to_chars_result result = isDouble
+                ? std::to_chars(buffer, buffer + sizeof(buffer), d, std::chars_format::fixed, precision)
+                : std::to_chars(buffer, buffer + sizeof(buffer), ld, std::chars_format::fixed, precision);
+            if (result.ec == std::errc())
+            {
+                value = std::string_view(buffer, result.ptr - buffer);
+            }
+            else
+            {
+                fallback = isDouble ? std::to_string(d) : std::to_string(ld);
+                value = fallback;
+            }
+            break;
+        }
+        default:
+            // corrupted record
+            return;
+        }
+
+        if (tag & SpaceFlag)
+            text += ' ';
+
+        if (tag & QuoteFlag)
+        {
+            text += '"';
+            appendEscaped(text, value);
+            text += '"';
+        }
+        else
+        {
+            text += value;
+        }
+    }
+}
+
+void LoggerStream::appendFormatArgument(std::string &out, const FormatArgument &argument, bool hex, int precision)
+{
+    if (argument.type == FormatArgument::String)
+    {
+        out.append(argument.data, argument.size);
+        return;
+    }
+
+    char buffer[128];
+    std::to_chars_result result;
+
+    switch (argument.type)
+    {
+    case FormatArgument::Int:
+        result = std::to_chars(buffer, buffer + sizeof(buffer), argument.i, hex ? 16 : 10);
+        break;
+    case FormatArgument::UInt:
+        result = std::to_chars(buffer, buffer + sizeof(buffer), argument.u, hex ? 16 : 10);
+        break;
+    case FormatArgument::Double:
+        result = std::to_chars(buffer, buffer + sizeof(buffer), argument.d, std::chars_format::fixed, precision);
+        break;
+    default:
+        result = std::to_chars(buffer, buffer + sizeof(buffer), argument.ld, std::chars_format::fixed, precision);
+        break;
+    }
+
+    if (result.ec == std::errc())
+        out.append(buffer, result.ptr - buffer);
+    else
+        out += argument.type == FormatArgument::Double ? std::to_string(argument.d) : std::to_string(argument.ld);
+}
+
+void LoggerStream::appendFormatted(std::string &out, std::string_view text, const LogFormatPart *parts, bool valid,
+                                   const FormatArgument *arguments, std::size_t count, int precision)
+{
+    if (!valid)
+    {
+        // a format of C++17 not matching the arguments
+        out += text;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out += ' ';
+            appendFormatArgument(out, arguments[i], false, precision);
+        }
+        return;
+    }
+
+    for (std::size_t i = 0; i <= count; ++i)
+    {
+        const LogFormatPart &part = parts[i];
+
+        if (!part.escaped)
+        {
+            out.append(part.text, part.size);
+        }
+        else
+        {
+            // {{ and }} are written once
+            for (std::uint32_t j = 0; j < part.size; ++j)
+            {
+                out += part.text[j];
+                if ((part.text[j] == '{' || part.text[j] == '}') && j + 1 < part.size)
+                    ++j;
+            }
+        }
+
+        if (i < count)
+            appendFormatArgument(out, arguments[i], part.hex, part.precision < 0 ? precision : part.precision);
+    }
+}
+
+void LoggerStream::addFormatted(std::string_view text, const LogFormatPart *parts, bool valid,
+                                const FormatArgument *arguments, std::size_t count)
+{
+    // text records are formatted in place
+    if (!stream->binary && stream->format == TextFormat)
+    {
+        if (stream->space)
+            stream->str += ' ';
+        appendFormatted(stream->str, text, parts, valid, arguments, count, stream->precision);
+        return;
+    }
+
+    // other records take the message as one argument
+    thread_local std::string message;
+    message.clear();
+    appendFormatted(message, text, parts, valid, arguments, count, stream->precision);
+
+    bool quote = stream->quote;
+    stream->quote = false;
+    addLogMessage(std::string_view(message));
+    stream->quote = quote;
+}
+
+void LoggerStream::addQuotedMessage(std::string_view s)
+{
+    std::string &str = stream->str;
+
+    str += '"';
+    appendEscaped(str, s);
+    str += '"';
+}
+
+void LoggerStream::addEscapedMessage(std::string_view s)
+{
+    std::string &str = stream->str;
+
+    // the message starts without a separator
+    if (stream->space && str.size() > stream->headerSize)
+        str += ' ';
+    if (stream->quote)
+        str += "\\\"";
+
+    appendEscaped(str, s);
+
+    if (stream->quote)
+        str += "\\\"";
+}
+
+void LoggerStream::addField(std::string_view key, std::string_view value, bool isString)
+{
+    switch (stream->format)
+    {
+    case JsonFormat:
+    {
+        std::string &out = stream->fields;
+        out += ",\"";
+        appendEscaped(out, key);
+        out += "\":";
+        if (isString)
+        {
+            out += '"';
+            appendEscaped(out, value);
+            out += '"';
+        }
+        else
+        {
+            out += value;
+        }
+        break;
+    }
+    case LogfmtFormat:
+        appendLogfmtField(stream->fields, key, value);
+        break;
+    default:
+        if (stream->binary)
+        {
+            // captured as a string argument always separated by a space
+            thread_local std::string text;
+            text.clear();
+            appendLogfmtField(text, key, value);
+
+            uint32_t size = uint32_t(text.size() - 1);
+            stream->str += char(StringArgument | SpaceFlag);
+            stream->str.append(reinterpret_cast<const char *>(&size), sizeof(size));
+            stream->str.append(text, 1, size);
+        }
+        else
+        {
+            appendLogfmtField(stream->str, key, value);
+        }
+        break;
+    }
+}
+
+void LoggerStream::setLogger(std::string_view name)
+{
+    stream->named = true;
+
+    if (stream->format != TextFormat)
+    {
+        addField("logger", name, true);
+    }
+    else if (stream->binary)
+    {
+        uint32_t size = uint32_t(name.size() + 1);
+        stream->str += char(StringArgument | SpaceFlag);
+        stream->str.append(reinterpret_cast<const char *>(&size), sizeof(size));
+        stream->str += name;
+        stream->str += ':';
+    }
+    else
+    {
+        stream->str += ' ';
+        stream->str += name;
+        stream->str += ':';
+    }
+}
+
+void LoggerStream::finishRecord()
+{
+    std::string &str = stream->str;
+
+    str += '"';
+    str += stream->fields;
+    if (stream->format == JsonFormat)
+        str += '}';
+}
+
+void LoggerStream::setFlightRecorder(std::size_t records, Level level, std::size_t recordSize)
+{
+    std::lock_guard<std::mutex> lock(sinksMutex);
+
+    LoggerFlight::configure(records, recordSize);
+    if (records != 0)
+    {
+        // created before a signal handler may need it
+        LoggerFile::standardError();
+        installFatalSignalHandlers();
+    }
+
+    std::atomic_store(&flightLevel, records != 0 && level < Fatal ? level : Fatal);
+    std::atomic_store(&severityLevel, publishSinks(sinks));
+}
+
+void LoggerStream::dumpFlightRecorder()
+{
+    LoggerFlight::dump(&writeFlightRecords, nullptr);
+}
+
+uint64_t LoggerStream::Histogram::upperBound(unsigned bucket)
+{
+    if (bucket < 8)
+        return bucket;
+
+    unsigned exponent = bucket / 8 + 2;
+    uint64_t lower = uint64_t(8 + bucket % 8) << (exponent - 3);
+    return lower + ((uint64_t(1) << (exponent - 3)) - 1);
+}
+
+uint64_t LoggerStream::Histogram::count() const
+{
+    uint64_t total = 0;
+    for (uint64_t c : counts)
+        total += c;
+    return total;
+}
+
+uint64_t LoggerStream::Histogram::quantile(double quantile) const
+{
+    uint64_t total = count();
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = uint64_t(std::ceil(quantile * double(total)));
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < bucketCount; ++i)
+    {
+        seen += counts[i];
+        if (seen >= rank && seen > 0)
+            return upperBound(i);
+    }
+    return upperBound(bucketCount - 1);
+}
+
+LoggerStream::Stats LoggerStream::stats()
+{
+    Stats result;
+    LoggerStats::collect(result);
+    result.dropped = asyncWriter.droppedCount();
+    result.degradeMode = LoggerDegrade::mode();
+    return result;
+}
+
+void LoggerStream::setLatencyStats(bool enabled)
+{
+    LoggerStats::setLatencyEnabled(enabled);
+}
+
+void LoggerStream::setStreamingThreshold(std::size_t size)
+{
+    streamingThreshold.store(size == 0 ? SIZE_MAX : size, std::memory_order_relaxed);
+}
+
+void LoggerStream::addBorrowed(std::string_view s)
+{
+    assert(stream);
+    if (stream->binary || stream->format != TextFormat || stream->quote)
+    {
+        addLogMessage(s);
+        return;
+    }
+
+    if (stream->space)
+    {
+        stream->str += ' ';
+    }
+
+    stream->borrowed.push_back(Stream::Borrowed{stream->str.size(), Bytes{s.data(), s.size()}});
+    stream->borrowedSize += s.size();
+}
+
+void LoggerStream::joinBorrowed()
+{
+    std::string text;
+    text.reserve(stream->str.size() + stream->borrowedSize);
+
+    size_t offset = 0;
+    for (const Stream::Borrowed &borrowed : stream->borrowed)
+    {
+        text.append(stream->str, offset, borrowed.offset - offset);
+        text.append(borrowed.bytes.data, borrowed.bytes.size);
+        offset = borrowed.offset;
+    }
+    text.append(stream->str, offset, std::string::npos);
+
+    stream->str.swap(text);
+    stream->borrowed.clear();
+    stream->borrowedSize = 0;
+}
+
+void LoggerStream::Sink::writeParts(Level level, const Bytes *parts, std::size_t count, std::size_t size)
+{
+    std::string text;
+    text.reserve(size);
+    for (std::size_t i = 0; i < count; ++i)
+        text.append(parts[i].data, parts[i].size);
+
+    write(level, text.data(), text.size());
+}
+
+void LoggerStream::setPoolReserve(std::size_t streams, std::size_t bufferSize, std::size_t bufferLimit)
+{
+    poolReserve.store(streams, std::memory_order_relaxed);
+    poolBufferSize.store(bufferSize, std::memory_order_relaxed);
+    poolBufferLimit.store(std::max(bufferSize, bufferLimit), std::memory_order_relaxed);
+}
+
+LoggerStream::Stream *LoggerStream::getFromPool()
+{
+    return pool.get();
+}
+
+void LoggerStream::pushToPool(Stream *stream)
+{
+    pool.put(stream);
+}
+
+LoggerStream::Pool::Pool()
+    : capacity(poolReserve.load(std::memory_order_relaxed))
+    , bufferSize(poolBufferSize.load(std::memory_order_relaxed))
+    , bufferLimit(poolBufferLimit.load(std::memory_order_relaxed))
+{
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        Stream *stream = new Stream;
+        stream->str.reserve(bufferSize);
+        stream->next = head;
+        head = stream;
+    }
+    size = capacity;
+}
+
+LoggerStream::Pool::~Pool()
+{
+    while (head)
+    {
+        Stream *stream = head;
+        head = stream->next;
+        delete stream;
+    }
+    size = 0;
+
+    // streams destroyed later by this thread are not pooled
+    destroyed = true;
+
+    if (ring)
+    {
+        // the writer thread releases the ring when it is drained
+        ring->closed.store(true, std::memory_order_release);
+    }
+}
+
+LoggerStream::Stream *LoggerStream::Pool::get()
+{
+    if (!head)
+    {
+        LoggerStats::add(LoggerStats::PoolMisses);
+        Stream *stream = new Stream;
+        stream->str.reserve(bufferSize);
+        return stream;
+    }
+
+    LoggerStats::add(LoggerStats::PoolHits);
+    Stream *stream = head;
+    head = stream->next;
+    stream->next = nullptr;
+    --size;
+    return stream;
+}
+
+void LoggerStream::Pool::put(Stream *stream)
+{
+    // a stream moved from another thread may overflow the pool
+    if (destroyed || size >= capacity)
+    {
+        delete stream;
+        return;
+    }
+
+    if (stream->str.capacity() > bufferLimit)
+    {
+        std::string().swap(stream->str);
+    }
+    if (stream->fields.capacity() > bufferLimit)
+    {
+        std::string().swap(stream->fields);
+    }
+    if (stream->str.capacity() < bufferSize)
+    {
+        stream->str.reserve(bufferSize);
+    }
+
+    stream->next = head;
+    head = stream;
+    ++size;
+}
+
+static void writeRecord(const LoggerRing::Record &record, const std::string &str)
+{
+    if (record.binary)
+    {
+        thread_local std::string text;
+        text.clear();
+
+        size_t headerSize = 0;
+        LoggerStream::decodeRecord(LoggerStream::Level(record.level), str.data(), str.size(), text, &headerSize);
+
+        LoggerRing::Record decoded = record;
+        decoded.headerSize = uint32_t(headerSize);
+        logHandler(decoded, text.data(), text.size());
+    }
+    else
+    {
+        logHandler(record, str.data(), str.size());
+    }
+}
+
+//! Returns true if a record with borrowed strings is written as parts by the calling thread.
+//! Records kept by the flight recorder or the asynchronous queue and records passed to
+//! handlers are joined.
+static bool writesParts(LoggerStream::Level level, bool named, size_t size)
+{
+    if (level == LoggerStream::Fatal)
+        return false;
+    if (!named && level < writtenLevel.load(std::memory_order_relaxed))
+        return false;
+    if (outputHandler.load(std::memory_order_relaxed))
+        return false;
+    if (hasSinks.load(std::memory_order_relaxed) && currentSinks().recordHandler)
+        return false;
+
+    return asyncWriter.bypass(size);
+}
+
+static void logHandler(const LoggerRing::Record &record, const LoggerStream::Bytes *parts, size_t count, size_t size)
+{
+    LoggerStream::Level level = LoggerStream::Level(record.level);
+    const Sinks *current = hasSinks.load(std::memory_order_relaxed) ? &currentSinks() : nullptr;
+    uint64_t start = LoggerStats::measureLatency() ? LoggerStats::now() : 0;
+    uint64_t degradeStart = LoggerDegrade::enabled() ? LoggerDegrade::beginWrite() : 0;
+    bool written = false;
+
+    if ((record.flags & NamedRecord) || level >= outputLevel.load(std::memory_order_relaxed))
+    {
+        written = true;
+        LoggerStats::add(LoggerStats::Bytes, size + 1);
+
+        outputBuffer.writeParts(parts, count);
+        checkAutoRotation(size + 1);
+    }
+
+    if (current)
+    {
+        for (const SinkEntry &entry : current->entries)
+        {
+            if (level >= entry.level)
+            {
+                entry.sink->writeParts(level, parts, count, size);
+                written = true;
+            }
+        }
+    }
+
+    LoggerStats::add(written ? LoggerStats::Counter(LoggerStats::DebugRecords + level) : LoggerStats::Filtered);
+    if (start != 0)
+        LoggerStats::addLatency(LoggerStats::WriteLatency, start);
+    if (degradeStart != 0)
+        LoggerDegrade::endWrite(degradeStart);
+}
+
+static void logHandler(const LoggerRing::Record &record, const char *s, size_t size)
+{
+    LoggerStream::Level level = LoggerStream::Level(record.level);
+    LoggerStream::Record info = {level, record.time / 1000, record.threadId, record.headerSize,
+                                 std::string_view(s, size)};
+    const Sinks *current = hasSinks.load(std::memory_order_relaxed) ? &currentSinks() : nullptr;
+    uint64_t start = LoggerStats::measureLatency() ? LoggerStats::now() : 0;
+    uint64_t degradeStart = LoggerDegrade::enabled() ? LoggerDegrade::beginWrite() : 0;
+    bool written = false;
+
+    if ((record.flags & NamedRecord) || level >= outputLevel.load(std::memory_order_relaxed))
+    {
+        written = true;
+        LoggerStats::add(LoggerStats::Bytes, size + 1);
+
+        auto handler = std::atomic_load(&outputHandler);
+
+        if (current && current->recordHandler)
+        {
+            current->recordHandler(info, current->context);
+        }
+        else if (handler)
+        {
+            handler(level, s);
+        }
+        else
+        {
+            outputBuffer.write(level, s, size);
+            checkAutoRotation(size + 1);
+        }
+    }
+
+    if (current)
+    {
+        for (const SinkEntry &entry : current->entries)
+        {
+            if (level >= entry.level)
+            {
+                entry.sink->writeRecord(info);
+                written = true;
+            }
+        }
+    }
+
+    LoggerStats::add(written ? LoggerStats::Counter(LoggerStats::DebugRecords + level) : LoggerStats::Filtered);
+    if (start != 0)
+        LoggerStats::addLatency(LoggerStats::WriteLatency, start);
+    if (degradeStart != 0)
+        LoggerDegrade::endWrite(degradeStart);
 
     if (level == LoggerStream::Fatal)
+    {
+        // compressed files keep records until sync
+        outputBuffer.flush();
+        flushSinks();
         abort();
+    }
+}
+
+//! Reformats the date and time of the cache if the second or the precision changed.
+static void updateDateTime(HeaderCache &cache, time_t second, int digits)
+{
+    if (cache.second != second || cache.digits != digits)
+    {
+        struct tm tm;
+        localtime_r(&second, &tm);
+
+        int size = snprintf(cache.dateTime, sizeof(cache.dateTime), "%02d.%02d.%d %02d:%02d:%02d.%0*d ",
+                            tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                            digits, 0);
+        if (size < 0 || size >= (int)sizeof(cache.dateTime))
+            size = 0;
+
+        cache.dateTimeSize = size;
+        cache.second = second;
+        cache.digits = digits;
+        ++cache.generation;
+    }
+}
+
+static void appendHeader(std::string &str, LoggerStream::Level level, uint64_t time)
+{
+    HeaderCache &cache = headerCache;
+    int digits = timeDigits.load(std::memory_order_relaxed);
+    updateDateTime(cache, time_t(time / 1000000000), digits);
+
+    const Prefixes &current = currentPrefixes();
+    pid_t pid = currentProcessId();
+    bool threadId = printThreadId.load(std::memory_order_relaxed);
+
+    if (cache.fragmentStale || cache.pid != pid || cache.prefixVersion != prefixCache.version ||
+        cache.threadId != threadId)
+    {
+        std::string fragment;
+        appendThreadFields(fragment, pid, threadId ? currentThreadId() : 0, threadName.view());
+        fragment += current.message;
+        fragment += ": ";
+
+        if (fragment.size() <= sizeof(cache.fragment))
+        {
+            memcpy(cache.fragment, fragment.data(), fragment.size());
+            cache.fragmentSize = int(fragment.size());
+        }
+        else
+        {
+            cache.fragmentSize = -1;
+        }
+
+        cache.pid = pid;
+        cache.prefixVersion = prefixCache.version;
+        cache.threadId = threadId;
+        cache.fragmentStale = false;
+        ++cache.generation;
+    }
+
+    HeaderTemplate &header = cache.templates[level];
+    if (header.generation != cache.generation)
+    {
+        size_t size = current.application.size() + cache.dateTimeSize + 1 + std::max(cache.fragmentSize, 0);
+        if (cache.fragmentSize < 0 || size > sizeof(header.text))
+        {
+            // long prefixes, the header is built from parts
+            appendHeader(str, level, time, currentThreadId(), threadName.view());
+            return;
+        }
+
+        char *p = header.text;
+        memcpy(p, current.application.data(), current.application.size());
+        p += current.application.size();
+        memcpy(p, cache.dateTime, cache.dateTimeSize);
+        p += cache.dateTimeSize;
+        *p++ = logLevelToChar(level);
+        memcpy(p, cache.fragment, cache.fragmentSize);
+
+        header.size = uint16_t(size);
+        header.fraction = uint16_t(current.application.size() + cache.dateTimeSize - 1 - digits);
+        header.generation = cache.generation;
+    }
+
+    size_t start = str.size();
+    str.append(header.text, header.size);
+
+    if (cache.dateTimeSize > digits + 1)
+        patchFraction(&str[start + header.fraction], digits, time);
+}
+
+//! Appends the header of a record of another thread, or of a header not fitting the template.
+static void appendHeader(std::string &str, LoggerStream::Level level, uint64_t time,
+                         uint32_t threadId, std::string_view name)
+{
+    HeaderCache &cache = headerCache;
+    int digits = timeDigits.load(std::memory_order_relaxed);
+    updateDateTime(cache, time_t(time / 1000000000), digits);
+
+    const Prefixes &current = currentPrefixes();
+
+    str += current.application;
+    size_t dateTime = str.size();
+    str.append(cache.dateTime, cache.dateTimeSize);
+    if (cache.dateTimeSize > digits + 1)
+        patchFraction(&str[dateTime + cache.dateTimeSize - 1 - digits], digits, time);
+    str += logLevelToChar(level);
+    appendThreadFields(str, currentProcessId(),
+                       printThreadId.load(std::memory_order_relaxed) ? threadId : 0, name);
+    str += current.message;
+    str += ": ";
+}
+
+//! Appends " [pid:tid name] ", the thread id is omitted if it is 0.
+static void appendThreadFields(std::string &str, pid_t pid, uint32_t threadId, std::string_view name)
+{
+    char buffer[16];
+
+    str += " [";
+    str.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), int(pid)).ptr);
+    if (threadId != 0)
+    {
+        str += ':';
+        str.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), threadId).ptr);
+    }
+    if (!name.empty())
+    {
+        str += ' ';
+        str += name;
+    }
+    str += "] ";
+}
+
+static const Prefixes &currentPrefixes()
+{
+    static const Prefixes empty;
+    PrefixCache &cache = prefixCache;
+
+    unsigned version = prefixVersion.load(std::memory_order_acquire);
+    if (cache.version != version)
+    {
+        cache.prefixes = std::atomic_load(&prefixes);
+        cache.version = version;
+    }
+
+    return cache.prefixes ? *cache.prefixes : empty;
+}
+
+void LogTimer::finish()
+{
+    thread_local unsigned sampleCounter = 0;
+
+    int64_t elapsed = now() - start;
+    bool sampled = false;
+    if (sampleRate != 0)
+    {
+        unsigned count = counter ? counter->fetch_add(1, std::memory_order_relaxed) + 1 : ++sampleCounter;
+        sampled = count % sampleRate == 0;
+    }
+
+    if (elapsed >= threshold || sampled)
+    {
+        LoggerStream(level).precision(3) << name << "took" << double(elapsed) / 1000 << "us";
+    }
+}
+
+Logger::Logger(std::string_view name)
+{
+    LoggerRegistry &registry = loggerRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    LoggerNode *node = findLoggerNode(registry, name);
+    level = &node->level;
+    loggerName = node->name;
+}
+
+void Logger::setLevel(std::string_view name, LoggerStream::Level level)
+{
+    LoggerRegistry &registry = loggerRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    LoggerNode *node = findLoggerNode(registry, name);
+    node->hasLevel = true;
+    node->ownLevel = level;
+    propagateLevel(node);
+}
+
+void Logger::resetLevel(std::string_view name)
+{
+    LoggerRegistry &registry = loggerRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    LoggerNode *node = findLoggerNode(registry, name);
+    if (node != &registry.root)
+    {
+        node->hasLevel = false;
+        propagateLevel(node);
+    }
+}
+
+static LoggerRegistry &loggerRegistry()
+{
+    // intentionally leaked, loggers may be constructed and used by static objects
+    static LoggerRegistry *registry = [] {
+        LoggerRegistry *r = new LoggerRegistry;
+        r->root.hasLevel = true;
+        return r;
+    }();
+    return *registry;
+}
+
+//! Must be called under the registry mutex. Creates missing loggers.
+static LoggerNode *findLoggerNode(LoggerRegistry &registry, std::string_view name)
+{
+    if (name.empty())
+        return &registry.root;
+
+    auto it = registry.nodes.find(name);
+    if (it != registry.nodes.end())
+        return it->second;
+
+    size_t dot = name.rfind('.');
+    LoggerNode *parent = dot == std::string_view::npos
+        ? &registry.root
+        : findLoggerNode(registry, name.substr(0, dot));
+
+    LoggerNode *node = new LoggerNode;
+    node->name = std::string(name);
+    node->parent = parent;
+    node->level.store(parent->level.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    parent->children.push_back(node);
+
+    registry.nodes.emplace(node->name, node);
+    return node;
+}
+
+//! Must be called under the registry mutex. Updates levels of \a node and of descendants
+//! inheriting it.
+static void propagateLevel(LoggerNode *node)
+{
+    LoggerStream::Level level = node->hasLevel || !node->parent
+        ? node->ownLevel
+        : node->parent->level.load(std::memory_order_relaxed);
+    node->level.store(level, std::memory_order_relaxed);
+
+    for (LoggerNode *child : node->children)
+    {
+        if (!child->hasLevel)
+            propagateLevel(child);
+    }
+}
+
+static void appendStructuredHeader(std::string &str, LoggerStream::OutputFormat format,
+                                   LoggerStream::Level level, uint64_t time)
+{
+    HeaderCache &cache = headerCache;
+    time_t second = time_t(time / 1000000000);
+    int digits = timeDigits.load(std::memory_order_relaxed);
+
+    if (cache.isoSecond != second || cache.isoDigits != digits)
+    {
+        struct tm tm;
+        gmtime_r(&second, &tm);
+
+        int size = snprintf(cache.isoTime, sizeof(cache.isoTime), "%04d-%02d-%02dT%02d:%02d:%02d.%0*dZ",
+                            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                            digits, 0);
+        if (size < 0 || size >= (int)sizeof(cache.isoTime))
+            size = 0;
+
+        cache.isoTimeSize = size;
+        cache.isoSecond = second;
+        cache.isoDigits = digits;
+    }
+
+    if (cache.isoTimeSize > digits + 1)
+    {
+        // patch the fraction in place, it is followed by 'Z'
+        patchFraction(cache.isoTime + cache.isoTimeSize - 1 - digits, digits, time);
+    }
+
+    char pid[16];
+    std::to_chars_result result = std::to_chars(pid, pid + sizeof(pid), int(currentProcessId()));
+    std::string_view pidText(pid, result.ptr - pid);
+
+    char tid[16];
+    std::string_view tidText;
+    if (printThreadId.load(std::memory_order_relaxed))
+    {
+        result = std::to_chars(tid, tid + sizeof(tid), currentThreadId());
+        tidText = std::string_view(tid, result.ptr - tid);
+    }
+    std::string_view name = threadName.view();
+
+    const Prefixes &current = currentPrefixes();
+    std::string_view application = current.application;
+    // the application prefix is stored with the separator
+    if (!application.empty() && application.back() == ' ')
+        application.remove_suffix(1);
+
+    std::string_view isoTime(cache.isoTime, cache.isoTimeSize);
+
+    if (format == LoggerStream::JsonFormat)
+    {
+        str += "{\"time\":\"";
+        str += isoTime;
+        str += "\",\"level\":\"";
+        str += logLevelToName(level);
+        str += "\",\"pid\":";
+        str += pidText;
+        if (!tidText.empty())
+        {
+            str += ",\"tid\":";
+            str += tidText;
+        }
+        if (!name.empty())
+        {
+            str += ",\"thread\":\"";
+            appendEscaped(str, name);
+            str += '"';
+        }
+        if (!application.empty())
+        {
+            str += ",\"app\":\"";
+            appendEscaped(str, application);
+            str += '"';
+        }
+        if (!current.message.empty())
+        {
+            str += ",\"prefix\":\"";
+            appendEscaped(str, current.message);
+            str += '"';
+        }
+        str += ",\"msg\":\"";
+    }
+    else
+    {
+        str += "time=";
+        str += isoTime;
+        str += " level=";
+        str += logLevelToName(level);
+        str += " pid=";
+        str += pidText;
+        if (!tidText.empty())
+        {
+            str += " tid=";
+            str += tidText;
+        }
+        if (!name.empty())
+            appendLogfmtField(str, "thread", name);
+        if (!application.empty())
+            appendLogfmtField(str, "app", application);
+        if (!current.message.empty())
+            appendLogfmtField(str, "prefix", current.message);
+        str += " msg=\"";
+    }
+}
+
+//! Writes \a count leading digits of the fraction of the second of \a time in nanoseconds.
+static void patchFraction(char *digits, int count, uint64_t time)
+{
+    uint32_t fraction = uint32_t(time % 1000000000);
+    for (int i = count; i < 9; ++i)
+        fraction /= 10;
+
+    for (int i = count - 1; i >= 0; --i)
+    {
+        digits[i] = char('0' + fraction % 10);
+        fraction /= 10;
+    }
+}
+
+static void appendLogfmtField(std::string &out, std::string_view key, std::string_view value)
+{
+    out += ' ';
+    if (key.empty())
+        out += '_';
+
+    // keys are never quoted, characters splitting them are replaced
+    for (char c : key)
+    {
+        unsigned char u = static_cast<unsigned char>(c);
+        out += u <= ' ' || u == 0x7f || c == '=' || c == '"' ? '_' : c;
+    }
+    out += '=';
+
+    if (value.empty() || value.find_first_of(" =") != std::string_view::npos || needsEscaping(value))
+    {
+        out += '"';
+        appendEscaped(out, value);
+        out += '"';
+    }
+    else
+    {
+        out += value;
+    }
+}
+
+static const char *logLevelToName(LoggerStream::Level level)
+{
+    switch (level)
+    {
+    case LoggerStream::Debug:
+        return "debug";
+    case LoggerStream::Info:
+        return "info";
+    case LoggerStream::Warning:
+        return "warning";
+    case LoggerStream::Error:
+        return "error";
+    case LoggerStream::Fatal:
+        return "fatal";
+    default:
+        return "unknown";
+    }
+}
+
+static const Sinks &currentSinks()
+{
+    static const Sinks empty;
+    SinkCache &cache = sinkCache;
+
+    unsigned version = sinksVersion.load(std::memory_order_acquire);
+    if (cache.version != version)
+    {
+        cache.sinks = std::atomic_load(&sinks);
+        cache.version = version;
+    }
+
+    return cache.sinks ? *cache.sinks : empty;
+}
+
+//! Must be called under sinksMutex. Returns the lowest level of the outputs and
+//! the flight recorder.
+static LoggerStream::Level publishSinks(std::shared_ptr<const Sinks> snapshot)
+{
+    LoggerStream::Level level = outputLevel.load();
+    if (snapshot)
+    {
+        for (const SinkEntry &entry : snapshot->entries)
+            level = std::min(level, entry.level);
+    }
+    writtenLevel.store(level);
+
+    hasSinks.store(snapshot && (!snapshot->entries.empty() || snapshot->recordHandler),
+                   std::memory_order_relaxed);
+    std::atomic_store(&sinks, std::move(snapshot));
+    // the snapshot is stored before the version is changed
+    sinksVersion.fetch_add(1, std::memory_order_release);
+
+    return std::min(level, flightLevel.load());
+}
+
+static void flushSinks()
+{
+    if (hasSinks.load(std::memory_order_relaxed))
+    {
+        for (const SinkEntry &entry : currentSinks().entries)
+            entry.sink->flush();
+    }
+}
+
+static void publishPrefixes(std::string *application, std::string *message)
+{
+    std::lock_guard<std::mutex> lock(prefixMutex);
+
+    auto snapshot = std::make_shared<Prefixes>();
+    if (prefixes)
+        *snapshot = *prefixes;
+
+    if (application)
+        snapshot->application = std::move(*application);
+    if (message)
+        snapshot->message = std::move(*message);
+
+    std::atomic_store(&prefixes, std::shared_ptr<const Prefixes>(std::move(snapshot)));
+    // the snapshot is stored before the version is changed
+    prefixVersion.fetch_add(1, std::memory_order_release);
+}
+
+static void retireStream(LoggerFile *stream)
+{
+    if (!stream)
+        return;
+
+    // wait for writers without a hazard pointer
+    {
+        std::lock_guard<std::mutex> lock(unguardedMutex);
+    }
+
+    // wait for writers which may still use the stream
+    for (StreamHazard &hazard : streamHazards)
+    {
+        while (hazard.stream.load() == stream)
+            std::this_thread::yield();
+    }
+
+    delete stream;
+}
+
+static void writeFlightRecords(const char *data, size_t size, void *)
+{
+    if (hazardOwner.hazard)
+    {
+        StreamGuard guard;
+        guard.get()->writeFromSignal(data, size);
+    }
+    else
+    {
+        // the mutex of unguarded writers may be held by the interrupted code
+        LoggerFile *stream = outputStream.load();
+        (stream ? stream : LoggerFile::standardError())->writeFromSignal(data, size);
+    }
+}
+
+namespace
+{
+    const int fatalSignals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+    struct sigaction previousActions[sizeof(fatalSignals) / sizeof(fatalSignals[0])];
+    std::atomic<bool> signalsInstalled {false};
+
+    void onFatalSignal(int signal)
+    {
+        LoggerStream::dumpFlightRecorder();
+
+        // the signal is delivered again to the previous handler when this one returns
+        for (size_t i = 0; i < sizeof(fatalSignals) / sizeof(fatalSignals[0]); ++i)
+        {
+            if (fatalSignals[i] == signal)
+                sigaction(signal, &previousActions[i], nullptr);
+        }
+        raise(signal);
+    }
+}
+
+static void installFatalSignalHandlers()
+{
+    if (signalsInstalled.exchange(true))
+        return;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = &onFatalSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_ONSTACK;
+
+    for (size_t i = 0; i < sizeof(fatalSignals) / sizeof(fatalSignals[0]); ++i)
+        sigaction(fatalSignals[i], &action, &previousActions[i]);
+}
+
+static void rotateArchives()
+{
+    std::string fileName;
+
+    {
+        std::lock_guard<std::mutex> lock(logFileNameMutex);
+        fileName = logFileName;
+    }
+
+    if (fileName.empty())
+        return;
+
+    unsigned maxFiles = rotationMaxFiles.load(std::memory_order_relaxed);
+
+    if (maxFiles > 0)
+    {
+        // name.1 is the newest archive
+        unlink((fileName + '.' + std::to_string(maxFiles)).c_str());
+        for (unsigned i = maxFiles - 1; i > 0; --i)
+        {
+            rename((fileName + '.' + std::to_string(i)).c_str(),
+                   (fileName + '.' + std::to_string(i + 1)).c_str());
+        }
+        rename(fileName.c_str(), (fileName + ".1").c_str());
+    }
+    else
+    {
+        time_t now = time(nullptr);
+        struct tm tm;
+        localtime_r(&now, &tm);
+
+        char suffix[32];
+        strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &tm);
+        rename(fileName.c_str(), (fileName + suffix).c_str());
+    }
+
+    LoggerStream::rotateFile();
+}
+
+static void checkAutoRotation(size_t bytes)
+{
+    size_t maxSize = rotationMaxSize.load(std::memory_order_relaxed);
+    unsigned interval = rotationInterval.load(std::memory_order_relaxed);
+
+    if (maxSize == 0 && interval == 0)
+        return;
+
+    size_t size = outputFileSize.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    bool due = (maxSize != 0 && size >= maxSize) ||
+               (interval != 0 && time(nullptr) - outputFileOpened.load(std::memory_order_relaxed) >= time_t(interval));
+
+    if (due && outputStream.load(std::memory_order_relaxed) != nullptr &&
+        !autoRotating.exchange(true, std::memory_order_acquire))
+    {
+        rotateArchives();
+        autoRotating.store(false, std::memory_order_release);
+    }
 }
 
 static char logLevelToChar(LoggerStream::Level level)
@@ -255,3 +2318,439 @@ static char logLevelToChar(LoggerStream::Level level)
     }
 }
 
+void OutputBuffer::setPolicy(bool every, LoggerStream::Level newLevel, unsigned newIntervalMs, size_t newBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    flushLocked();
+
+    level = newLevel;
+    bytes = newBytes;
+    intervalMs.store(newIntervalMs, std::memory_order_relaxed);
+    buffered.store(!every, std::memory_order_release);
+}
+
+void OutputBuffer::write(LoggerStream::Level recordLevel, const char *s, size_t size)
+{
+    if (!buffered.load(std::memory_order_acquire))
+    {
+        StreamGuard guard;
+        guard.get()->writeRecord(s, size);
+        LoggerStats::add(LoggerStats::Flushes);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    data.append(s, size);
+    data += '\n';
+
+    bool needFlush = !buffered.load(std::memory_order_relaxed) ||
+                     recordLevel >= LoggerStream::Error || recordLevel >= level ||
+                     (bytes != 0 && data.size() >= bytes) ||
+                     data.size() >= maxBufferSize;
+
+    unsigned ms = intervalMs.load(std::memory_order_relaxed);
+    if (!needFlush && ms != 0)
+    {
+        needFlush = Clock::now() - lastFlush >= std::chrono::milliseconds(ms);
+    }
+
+    if (needFlush)
+    {
+        flushLocked();
+    }
+}
+
+void OutputBuffer::writeParts(const LoggerStream::Bytes *parts, size_t count)
+{
+    if (buffered.load(std::memory_order_acquire))
+    {
+        // a large record isn't copied to the buffer, it follows the buffered records
+        std::lock_guard<std::mutex> lock(mutex);
+        flushLocked();
+
+        StreamGuard guard;
+        guard.get()->writeParts(parts, count);
+    }
+    else
+    {
+        StreamGuard guard;
+        guard.get()->writeParts(parts, count);
+    }
+    LoggerStats::add(LoggerStats::Flushes);
+}
+
+void OutputBuffer::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    flushLocked();
+    sync();
+}
+
+void OutputBuffer::sync()
+{
+    StreamGuard guard;
+    guard.get()->sync();
+}
+
+void OutputBuffer::flushExpired()
+{
+    unsigned ms = intervalMs.load(std::memory_order_relaxed);
+    if (ms == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (Clock::now() - lastFlush >= std::chrono::milliseconds(ms))
+    {
+        flushLocked();
+    }
+}
+
+void OutputBuffer::flushLocked()
+{
+    if (!data.empty())
+    {
+        StreamGuard guard;
+
+        // one write for the whole batch
+        guard.get()->writeBatch(data.data(), data.size());
+        data.clear();
+        LoggerStats::add(LoggerStats::Flushes);
+    }
+    lastFlush = Clock::now();
+}
+
+void AsyncWriter::start(size_t capacity, LoggerStream::OverflowPolicy newPolicy)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    ringCapacity.store(LoggerRing::roundCapacity(capacity), std::memory_order_relaxed);
+    policy.store(newPolicy, std::memory_order_relaxed);
+
+    if (!thread.joinable())
+    {
+        stopping = false;
+        thread = std::thread(&AsyncWriter::run, this);
+        writerThread.store(thread.get_id());
+        running.store(true);
+    }
+}
+
+void AsyncWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (!thread.joinable() || thread.get_id() == std::this_thread::get_id())
+            return;
+
+        running.store(false);
+        stopping = true;
+    }
+
+    wakeCondition.notify_one();
+    {
+        std::lock_guard<std::mutex> lock(spaceMutex);
+        spaceCondition.notify_all();
+    }
+    thread.join();
+    writerThread.store(std::thread::id());
+
+    // records pushed while the thread was stopping
+    drain();
+}
+
+bool AsyncWriter::push(std::shared_ptr<LoggerRing> &ring, const LoggerRing::Record &record,
+                       const std::string &str)
+{
+    if (!running.load(std::memory_order_acquire))
+        return false;
+
+    // a record from the output handler must not wait for itself
+    if (writerThread.load(std::memory_order_relaxed) == std::this_thread::get_id())
+        return false;
+
+    if (!ring)
+    {
+        ring = std::make_shared<LoggerRing>(ringCapacity.load(std::memory_order_relaxed));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.push_back(ring);
+        ringsVersion.fetch_add(1, std::memory_order_release);
+    }
+
+    if (str.size() > ring->maxRecordSize())
+    {
+        // keep the order of records of this thread
+        flush();
+        return false;
+    }
+
+    bool full = false;
+    unsigned retries = 0;
+    for (;;)
+    {
+        uint64_t tail = ring->tailPosition();
+        if (ring->push(record, str.data()))
+            break;
+
+        if (!full)
+        {
+            full = true;
+            LoggerStats::add(LoggerStats::QueueFull);
+            if (LoggerDegrade::enabled())
+                LoggerDegrade::queueFill(100);
+        }
+
+        switch (policy.load(std::memory_order_relaxed))
+        {
+        case LoggerStream::Block:
+            if (!running.load(std::memory_order_acquire))
+                return false;
+            // a short spin, then sleep until the consumer frees space
+            if (++retries <= 16)
+            {
+                if (retries == 1)
+                    wakeup();
+                std::this_thread::yield();
+            }
+            else
+            {
+                waitSpace(*ring, tail);
+            }
+            break;
+        case LoggerStream::DropNewest:
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        case LoggerStream::DropOldest:
+            if (ring->dropOldest())
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    if (LoggerDegrade::enabled())
+        LoggerDegrade::queueFill(ring->fillPercent());
+
+    // pairs with the fence in run()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed))
+        wakeup();
+
+    return true;
+}
+
+void AsyncWriter::waitSpace(LoggerRing &ring, uint64_t tail)
+{
+    std::unique_lock<std::mutex> lock(spaceMutex);
+    ring.waiting.store(true, std::memory_order_seq_cst);
+    // the timeout covers a writer thread stopped meanwhile
+    spaceCondition.wait_for(lock, std::chrono::milliseconds(100), [&] {
+        return ring.tailPosition() != tail || !running.load(std::memory_order_acquire);
+    });
+    ring.waiting.store(false, std::memory_order_relaxed);
+}
+
+void AsyncWriter::wakeup()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    wakeCondition.notify_one();
+}
+
+bool AsyncWriter::bypass(size_t size)
+{
+    if (!running.load(std::memory_order_acquire) ||
+        writerThread.load(std::memory_order_relaxed) == std::this_thread::get_id())
+        return true;
+
+    if (size <= LoggerRing::recordLimit(ringCapacity.load(std::memory_order_relaxed)))
+        return false;
+
+    // keep the order of records of this thread
+    flush();
+    return true;
+}
+
+void AsyncWriter::flush()
+{
+    if (writerThread.load(std::memory_order_relaxed) == std::this_thread::get_id())
+        return;
+
+    // records queued before the flush, later ones are not waited for
+    std::vector<std::pair<std::shared_ptr<LoggerRing>, uint64_t>> targets;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        targets.reserve(rings.size());
+        for (const std::shared_ptr<LoggerRing> &ring : rings)
+            targets.emplace_back(ring, ring->headPosition());
+    }
+
+    auto isFlushed = [&targets] {
+        for (const auto &target : targets)
+        {
+            if (target.first->flushed.load(std::memory_order_acquire) < target.second)
+                return false;
+        }
+        return true;
+    };
+
+    for (;;)
+    {
+        // a drain started now covers the targets, otherwise the running one may
+        std::unique_lock<std::mutex> drainLock(drainMutex, std::try_to_lock);
+        if (drainLock.owns_lock())
+        {
+            drainLocked();
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(drainedMutex);
+        if (drainedCondition.wait_for(lock, std::chrono::milliseconds(10), isFlushed))
+            return;
+    }
+}
+
+bool AsyncWriter::drain()
+{
+    std::lock_guard<std::mutex> drainLock(drainMutex);
+    return drainLocked();
+}
+
+bool AsyncWriter::drainLocked()
+{
+    unsigned version = ringsVersion.load(std::memory_order_acquire);
+    if (drainVersion != version)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        drainRings = rings;
+        drainVersion = version;
+    }
+
+    // records pushed during the drain are left for the next one, so a drain ends under load
+    drainLimits.resize(drainRings.size());
+    for (size_t i = 0; i < drainRings.size(); ++i)
+        drainLimits[i] = drainRings[i]->headPosition();
+
+    bool written = false;
+    bool hasClosed = false;
+
+    for (;;)
+    {
+        LoggerRing *oldest = nullptr;
+        uint64_t oldestLimit = 0;
+        uint64_t oldestTime = 0;
+
+        for (size_t i = 0; i < drainRings.size(); ++i)
+        {
+            LoggerRing *ring = drainRings[i].get();
+            uint64_t time;
+            if (ring->front(time, drainLimits[i]))
+            {
+                if (!oldest || time < oldestTime)
+                {
+                    oldest = ring;
+                    oldestLimit = drainLimits[i];
+                    oldestTime = time;
+                }
+            }
+            else if (ring->closed.load(std::memory_order_acquire))
+            {
+                hasClosed = true;
+            }
+        }
+
+        if (!oldest)
+            break;
+
+        LoggerRing::Record record;
+        if (oldest->pop(record, drainData, oldestLimit))
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (oldest->waiting.load(std::memory_order_relaxed))
+            {
+                std::lock_guard<std::mutex> lock(spaceMutex);
+                spaceCondition.notify_all();
+            }
+
+            writeRecord(record, drainData);
+            written = true;
+        }
+    }
+
+    if (hasClosed)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto isDone = [](const std::shared_ptr<LoggerRing> &ring) {
+            return ring->closed.load(std::memory_order_acquire) && ring->empty();
+        };
+        rings.erase(std::remove_if(rings.begin(), rings.end(), isDone), rings.end());
+        ringsVersion.fetch_add(1, std::memory_order_release);
+    }
+
+    if (written)
+        outputBuffer.sync();
+
+    // records before the tails are written, or dropped by their producers
+    for (const std::shared_ptr<LoggerRing> &ring : drainRings)
+        ring->flushed.store(ring->tailPosition(), std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(drainedMutex);
+    }
+    drainedCondition.notify_all();
+
+    return written;
+}
+
+void AsyncWriter::run()
+{
+    // records are submitted in batches when queues are drained
+    LoggerFile::setDeferred(true);
+
+    auto summaryTime = std::chrono::steady_clock::now();
+    for (;;)
+    {
+        bool written = drain();
+        outputBuffer.flushExpired();
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - summaryTime >= std::chrono::seconds(1))
+        {
+            summaryTime = now;
+            LoggerStream::writeSuppressed();
+            outputBuffer.sync();
+        }
+
+        if (written)
+            continue;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (stopping)
+            break;
+
+        sleeping.store(true, std::memory_order_relaxed);
+        // pairs with the fence in push()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool pending = false;
+        for (const std::shared_ptr<LoggerRing> &ring : rings)
+        {
+            if (!ring->empty())
+            {
+                pending = true;
+                break;
+            }
+        }
+
+        if (!pending)
+        {
+            unsigned interval = outputBuffer.interval();
+            wakeCondition.wait_for(lock, std::chrono::milliseconds(interval != 0 ? interval : 100));
+        }
+
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    drain();
+}
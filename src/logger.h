@@ -4,6 +4,15 @@
 #include <sstream>
 #include <deque>
 #include <cassert>
+#include <cstdint>
+#include <atomic>
+#include <charconv>
+#include <string_view>
+#include <type_traits>
+#include <cmath>
+#include <chrono>
+#include <tuple>
+#include <vector>
 
 /*!
  * Simple logger.
@@ -21,7 +30,154 @@
  *  03.08.2017 12:44:15.737 I [26629] : "string" "to" "log" "10"
  *
  *  For custom types you must privide std::to_string overload.
+ *
+ *  Messages can be formatted in one pass by a format string checked at compile time,
+ *  see LogFormat:
+ * \code
+ *  LOG_INFO_F("user {} took {} ms", id, ms);
+ * \endcode
+ *
+ *  LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR and LOG_FATAL macros check the level
+ *  before the arguments are evaluated:
+ * \code
+ *  LOG_DEBUG << "state" << expensive();
+ * \endcode
+ */
+
+//! Records with a level below are compiled out: 0 - Debug, 1 - Info, 2 - Warning, 3 - Error.
+//! Fatal records are never compiled out.
+#ifndef LOGGER_MIN_LEVEL
+#define LOGGER_MIN_LEVEL 0
+#endif
+
+//! Defined when LogFormat is parsed at compile time wherever it is constructed (C++20).
+#if defined(__cpp_consteval)
+#define LOGGER_CONSTEVAL consteval
+#define LOGGER_CHECKED_FORMAT 1
+#else
+#define LOGGER_CONSTEVAL constexpr
+#endif
+
+//! Text before a placeholder of LogFormat and the format of the placeholder.
+struct LogFormatPart
+{
+    const char *text = nullptr;
+    std::uint32_t size = 0;
+    //! The text contains {{ or }}
+    bool escaped = false;
+    bool hex = false;
+    //! Digits after the decimal point, -1 for the default
+    signed char precision = -1;
+};
+
+/*!
+ * Format string of \a Count arguments, parsed by the constructor:
+ * \code
+ *  LOG_INFO_F("user {} took {} ms", id, ms);
+ * \endcode
+ * Placeholders are {}, {:x} for hexadecimal integers and {:.N} for N digits after
+ * the decimal point, {{ and }} are braces. Arguments are numbers, bool, char, enums
+ * and strings, other types don't compile.
+ *
+ * LOG_INFO_F and other macros parse the format at compile time and reject a malformed
+ * format or a wrong count of arguments. They are the only checked API in C++17. C++20
+ * checks every LogFormat, so logInfo("user {}", id) and other functions taking a format
+ * are declared only when LOGGER_CHECKED_FORMAT is defined.
  */
+template<std::size_t Count>
+class LogFormat
+{
+public:
+    template<std::size_t N>
+    LOGGER_CONSTEVAL LogFormat(const char (&s)[N])
+        : text(s, N - 1)
+    {
+        std::size_t count = 0;
+        std::size_t start = 0;
+        bool escaped = false;
+
+        for (std::size_t i = 0; i < text.size(); ++i)
+        {
+            char c = text[i];
+            if (c != '{' && c != '}')
+                continue;
+
+            if (i + 1 < text.size() && text[i + 1] == c)
+            {
+                escaped = true;
+                ++i;
+                continue;
+            }
+
+            std::size_t end = text.find('}', i);
+            if (c == '}' || end == std::string_view::npos || count == Count ||
+                !parseSpec(text.substr(i + 1, end - i - 1), parts[count]))
+            {
+                invalidFormat();
+                return;
+            }
+
+            setText(parts[count++], start, i, escaped);
+            start = end + 1;
+            escaped = false;
+            i = end;
+        }
+
+        if (count != Count)
+        {
+            invalidFormat();
+            return;
+        }
+
+        setText(parts[Count], start, text.size(), escaped);
+        valid = true;
+    }
+
+    std::string_view text;
+    //! Parts before every placeholder and the text after the last one
+    LogFormatPart parts[Count + 1];
+    bool valid = false;
+
+private:
+    constexpr void setText(LogFormatPart &part, std::size_t begin, std::size_t end, bool escaped)
+    {
+        part.text = text.data() + begin;
+        part.size = std::uint32_t(end - begin);
+        part.escaped = escaped;
+    }
+
+    //! Parses an empty spec, ":x" or ":.N".
+    static constexpr bool parseSpec(std::string_view spec, LogFormatPart &part)
+    {
+        if (spec.empty())
+            return true;
+        if (spec == ":x")
+        {
+            part.hex = true;
+            return true;
+        }
+        if (spec.size() < 3 || spec.size() > 4 || spec[0] != ':' || spec[1] != '.')
+            return false;
+
+        int precision = 0;
+        for (char c : spec.substr(2))
+        {
+            if (c < '0' || c > '9')
+                return false;
+            precision = precision * 10 + (c - '0');
+        }
+        part.precision = (signed char)precision;
+        return true;
+    }
+
+    //! Not constexpr, a call fails the compile-time check.
+    static void invalidFormat()
+    {
+    }
+};
+
+class Logger;
+
 class LoggerStream
 {
 public:
@@ -34,9 +190,57 @@ public:
         Fatal
     };
 
+    //! State of a rate limited call site, one static object per site. Lock-free.
+    class RateLimit
+    {
+    public:
+        //! The site is named by \a file and \a line in summaries written by writeSuppressed().
+        constexpr RateLimit(Level level = Info, const char *file = "", int line = 0)
+            : level(level)
+            , file(file)
+            , line(line)
+        {
+        }
+
+        //! Returns true for every \a n-th record.
+        bool everyN(unsigned n);
+
+        //! Token bucket: returns true for \a burst records and then for one record
+        //! every \a interval nanoseconds.
+        bool allow(uint64_t interval, unsigned burst = 1);
+
+        //! Token bucket refilled by \a rate records per second. Returns false for every
+        //! record if \a rate is not positive.
+        bool perSecond(double rate, unsigned burst = 1);
+
+    private:
+        friend class LoggerStream;
+
+        //! Counts a suppressed record, the first one lists the site for writeSuppressed().
+        void suppress();
+
+        Level level;
+        const char *file;
+        int line;
+        std::atomic<uint64_t> count {0};
+        //! Time when the bucket is full again, in steady clock nanoseconds
+        std::atomic<int64_t> fullTime {0};
+        std::atomic<uint64_t> suppressed {0};
+        std::atomic<bool> listed {false};
+        //! Next listed site
+        RateLimit *next = nullptr;
+    };
+
     //! Create the debug stream. Default separate by spaces and without quote marks.
     LoggerStream(Level level);
-    LoggerStream(const LoggerStream &) = default;
+    //! Create the stream of the named \a logger, filtered by its level.
+    LoggerStream(Level level, const Logger &logger);
+    //! Create the stream of a rate limited call site. Writes the count of records
+    //! suppressed by \a limit before.
+    LoggerStream(Level level, RateLimit &limit);
+    LoggerStream(LoggerStream &&other) noexcept;
+    LoggerStream(const LoggerStream &) = delete;
+    LoggerStream &operator = (const LoggerStream &) = delete;
     ~LoggerStream();
 
     //! Separate by a space.
@@ -44,31 +248,140 @@ public:
     //! Don't separate by a space.
     LoggerStream &nospace();
 
-    //! Insert a quote marks
+    //! Insert a quote marks. Quotes, backslashes and control characters are escaped.
     LoggerStream &quote();
     //! Don't insert quote marks
     LoggerStream &noquote();
 
+    //! Print integers in hexadecimal.
+    LoggerStream &hex();
+    //! Print integers in decimal. Default.
+    LoggerStream &dec();
+
+    //! Sets count of digits after the decimal point for floating point numbers. Default 6.
+    LoggerStream &precision(int n);
+
     LoggerStream &operator << (const char *s);
     LoggerStream &operator << (char *s);
     LoggerStream &operator << (const std::string &s);
+    //! Temporaries are destroyed before the record is written, they are never borrowed.
+    LoggerStream &operator << (std::string &&s);
+    LoggerStream &operator << (std::string_view s);
     LoggerStream &operator << (char c);
 
+    //! Bytes appended without a copy, created by logBytes().
+    struct Bytes
+    {
+        const char *data;
+        std::size_t size;
+    };
+
+    //! Appends \a bytes as they are. The bytes are borrowed until the record is written,
+    //! see setStreamingThreshold(). Copied with quote() and in logfmt, JSON or binary records.
+    LoggerStream &operator << (const Bytes &bytes);
+
     template<typename T>
     LoggerStream &operator << (const T &t);
 
+    //! Structured field created by kv().
+    template<typename T>
+    struct KeyValue
+    {
+        std::string_view key;
+        const T &value;
+    };
+
+    template<typename T>
+    LoggerStream &operator << (const KeyValue<T> &field);
+
+    //! Appends the message formatted by \a format in one pass. Separated from the header
+    //! like the first argument of operator <<, quote() and hex() don't apply.
+    //! C++17 checks \a format only if it is a constant expression, use LOG_INFO_F and
+    //! other macros.
+    template<typename... Args>
+    LoggerStream &format(const LogFormat<sizeof...(Args)> &format, const Args &... args);
+
     //! Custom log handler type. Called from destructor, must be noexcept.
     typedef void(*OutputHandler)(Level level, const char *s);
 
     //! Sets the output handler function
     static void setOutputHandler(OutputHandler handler);
 
-    //! Sets the severity level
+    //! Record passed to the record handler.
+    struct Record
+    {
+        Level level;
+        //! Timestamp in microseconds since the epoch
+        uint64_t time;
+        //! Kernel id of the thread which created the record
+        uint32_t threadId;
+        //! Size of the header at the beginning of the text
+        std::size_t headerSize;
+        //! Header and message without the line end
+        std::string_view text;
+
+        std::string_view message() const
+        {
+            return text.substr(headerSize);
+        }
+    };
+
+    //! Record handler type. Called from destructor or by the writer thread, must be noexcept.
+    typedef void(*RecordHandler)(const Record &record, void *context);
+
+    //! Sets the record handler called with \a context instead of the output handler
+    //! and the log file. Put nullptr to remove the handler.
+    static void setRecordHandler(RecordHandler handler, void *context = nullptr);
+
+    //! Sets the severity level of the log file or the output handler. Records are built
+    //! if they pass this level or the level of any sink.
     static void setSeverityLevel(Level level);
 
     //! Sets the severity level by string
     static void setSeverityLevel(const std::string &level);
 
+    //! Returns true if records with \a level are not filtered out.
+    static bool isEnabled(Level level);
+
+    //! Output receiving records in addition to the log file or the output handler.
+    //! Called by the thread writing the record, the writer thread in asynchronous mode.
+    //! A record is formatted once and passed to every sink, it must be copied if kept.
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+
+        //! Writes one record without the line end.
+        virtual void write(Level level, const char *s, std::size_t size) = 0;
+
+        //! Writes one record of \a count parts, \a size bytes in total, without the line end.
+        //! Gets synchronous records with borrowed strings. The default joins the parts
+        //! and calls write().
+        virtual void writeParts(Level level, const Bytes *parts, std::size_t count, std::size_t size);
+
+        //! Writes one record with the time and the thread id of its creation. Gets every
+        //! record not passed to writeParts(), which may be written long after its creation in
+        //! asynchronous mode. The default calls write().
+        virtual void writeRecord(const Record &record)
+        {
+            write(record.level, record.text.data(), record.text.size());
+        }
+
+        //! Called by flush() and before abort() on a fatal record.
+        virtual void flush()
+        {
+        }
+    };
+
+    //! Adds \a sink receiving records with \a level or higher.
+    static void addSink(std::shared_ptr<Sink> sink, Level level = Debug);
+
+    //! Changes the level of \a sink.
+    static void setSinkLevel(const std::shared_ptr<Sink> &sink, Level level);
+
+    //! Removes \a sink. A thread writing records releases it with its next record.
+    static void removeSink(const std::shared_ptr<Sink> &sink);
+
     //! Set prefix for all log messages. Used for quick search by email.
     //! Example:
     //! \code
@@ -85,16 +398,405 @@ public:
     //! Sets application prefix
     static void setApplicationPrefix(std::string prefix);
 
+    //! Prints the kernel thread id after the process id: [pid:tid].
+    static void setThreadIdEnabled(bool enabled);
+
+    //! Sets the name of the calling thread printed after the ids: [pid:tid name].
+    //! Truncated to 32 characters, put empty string to remove the name.
+    static void setThreadName(std::string_view name);
+
+    //! How the log file is written.
+    enum SinkKind
+    {
+        StdioSink,  //!< Through stdio. Default.
+        FdSink,     //!< Raw descriptor with O_APPEND, one write(2) per record or batch, no stdio locking.
+                    //!< O_DIRECT is deliberately not supported, records are not block aligned.
+        MmapSink,   //!< Memory mapped file preallocated in chunks, a record is a memory copy.
+                    //!< The file is truncated to the written length on close or rotation.
+        UringSink,  //!< Written by io_uring from registered buffers, the writer thread of
+                    //!< the asynchronous mode keeps several writes in flight. The file must
+                    //!< not be shared with other writers. Falls back to FdSink if io_uring
+                    //!< is not available.
+        ZstdSink,   //!< Compressed by zstd. Records are compressed and written by a thread
+                    //!< of the file, in frames limited by setCompression().
+        Lz4Sink,    //!< Compressed to lz4 frames, like ZstdSink.
+        GzipSink    //!< Compressed by zlib, every frame is a gzip member, like ZstdSink.
+                    //!< Compressed sinks are built if the library is found, otherwise
+                    //!< opening fails with ENOTSUP.
+    };
+
+    //! Format of records.
+    enum OutputFormat
+    {
+        TextFormat,     //!< dd.mm.yyyy hh:mm:ss.mmm L [pid] prefix: message key=value. Default.
+        LogfmtFormat,   //!< time=yyyy-mm-ddThh:mm:ss.mmmZ level=info pid=N msg="message" key=value
+        JsonFormat      //!< {"time":"yyyy-mm-ddThh:mm:ss.mmmZ","level":"info","pid":N,"msg":"message","key":value}
+    };
+
+    //! Sets the format of records. Messages and string values are escaped in logfmt and JSON,
+    //! such records are never captured in binary mode.
+    static void setOutputFormat(OutputFormat format);
+
+    //! Source of timestamps of records.
+    enum ClockSource
+    {
+        RealtimeClock,  //!< CLOCK_REALTIME for every record. Default.
+        MonotonicClock, //!< CLOCK_MONOTONIC shifted to the wall clock, never steps back on NTP adjustments.
+        CoarseClock,    //!< CLOCK_MONOTONIC_COARSE shifted to the wall clock, cheaper but with
+                        //!< the resolution of the kernel tick (1-4 ms).
+        TscClock        //!< rdtsc scaled by a calibrated rate, the cheapest. x86-64 with an invariant TSC
+                        //!< only (checked by CPUID), MonotonicClock on other CPUs.
+    };
+
+    //! Sets the source of timestamps. Monotonic sources are shifted to the wall clock when
+    //! they are set, set the source again to follow changes of the wall clock.
+    static void setClock(ClockSource clock);
+
+    //! Digits of fractions of a second in the header.
+    enum TimePrecision
+    {
+        Milliseconds,   //!< Default
+        Microseconds,
+        Nanoseconds
+    };
+
+    //! Sets the precision of timestamps in the header.
+    static void setTimePrecision(TimePrecision precision);
+
     //! Set logger filename. By default used stderr.
-    static void setLogFileName(std::string fileName);
+    static void setLogFileName(std::string fileName, SinkKind kind = StdioSink);
+
+    //! Sets the compression of ZstdSink, Lz4Sink and GzipSink files opened later. A frame is
+    //! finished after \a frameSize bytes of records or \a frameInterval milliseconds, records
+    //! of unfinished frames are lost on a crash. \a level 0 selects the default of the codec.
+    static void setCompression(int level = 0, std::size_t frameSize = 1 << 20, unsigned frameInterval = 1000);
 
-    //! Reopen log file.
+    //! Reopen log file. Safe under load: the previous file is closed after the last
+    //! writer leaves it, writers never wait for the rotation.
     static void rotateFile();
 
+    //! Rotate the log file when it grows over \a maxSize bytes or when \a interval seconds
+    //! passed since it was opened, 0 disables the condition.
+    //! Archives are renamed to name.1 ... name.N (name.1 is the newest) for \a maxFiles N,
+    //! or to name.YYYYmmdd-HHMMSS if \a maxFiles is 0.
+    static void setAutoRotation(std::size_t maxSize, unsigned interval = 0, unsigned maxFiles = 5);
+
+    //! Behaviour of the asynchronous queue when it is full.
+    enum OverflowPolicy
+    {
+        Block,      //!< Wait until the writer thread frees a slot.
+        DropNewest, //!< Discard the record being logged.
+        DropOldest  //!< Discard the oldest queued record.
+    };
+
+    //! Enable asynchronous mode. Records are written by a background thread.
+    //! Every thread has own lock-free queue of \a capacity bytes, queues are merged
+    //! in the timestamp order. Larger records are written synchronously.
+    //! Fatal records are always written synchronously after the queue is flushed.
+    static void setAsync(std::size_t capacity, OverflowPolicy policy = Block);
+
+    //! Disable asynchronous mode. Queued records are written before return.
+    static void setSync();
+
+    //! Wait until all queued records are written.
+    static void flush();
+
+    //! Returns count of records dropped by the asynchronous queue.
+    static std::size_t droppedCount();
+
+    //! Writes "suppressed N similar messages at file:line" for every rate limited site
+    //! which suppressed records since its last record. Called once a second by the writer
+    //! thread in asynchronous mode and at exit.
+    static void writeSuppressed();
+
+    //! Steps of degradation under a log storm, see setDegradation().
+    enum DegradeMode
+    {
+        NormalMode,     //!< All records are written.
+        SampleMode,     //!< One of DegradeOptions::sampleRate Debug and Info records is written.
+        WarningMode,    //!< Debug and Info records are dropped.
+        ErrorMode       //!< Records below Error are dropped.
+    };
+
+    //! Thresholds of degradation.
+    struct DegradeOptions
+    {
+        //! Time of writing a record to the outputs, or of a write in progress, which overloads them
+        std::chrono::milliseconds latency {50};
+        //! Fill of the asynchronous queue of a thread which overloads it
+        unsigned queuePercent = 50;
+        //! Pressure is checked once per interval, one step is taken per interval
+        std::chrono::milliseconds interval {100};
+        //! Count of calm intervals, under half of both thresholds, before a step back.
+        //! Doubled by each step up following a step back, up to 64 times the count,
+        //! and reset after as many calm intervals in NormalMode.
+        unsigned recovery = 10;
+        //! One of \a sampleRate Debug and Info records is written in SampleMode
+        unsigned sampleRate = 16;
+        //! Highest step
+        DegradeMode maxMode = ErrorMode;
+    };
+
+    //! Degrades logging while the outputs can't keep up. An interval in which writing a record
+    //! took the latency threshold or longer, or an asynchronous queue was filled over the
+    //! threshold, takes one step: Debug and Info records are sampled, then dropped, then all
+    //! records below Error are dropped before they are formatted. Calm intervals step back.
+    //! Error and Fatal records are never dropped by degradation. Every transition is written
+    //! as a Warning record with the count of records dropped meanwhile, and counted by stats().
+    //! Every written record reads the clock twice.
+    static void setDegradation(DegradeOptions options);
+
+    //! Disables degradation, all records are written again.
+    static void disableDegradation();
+
+    //! Returns the current step of degradation.
+    static DegradeMode degradeMode();
+
+    //! Transport of a network sink.
+    enum NetworkTransport
+    {
+        UdpTransport,           //!< A datagram per record to host:port.
+        TcpTransport,           //!< Persistent connection to host:port.
+        UnixDatagramTransport,  //!< A datagram per record to a Unix socket path, e.g. /dev/log.
+        UnixStreamTransport     //!< Persistent connection to a Unix socket path.
+    };
+
+    //! Framing of records sent by a network sink.
+    enum NetworkFraming
+    {
+        LineFraming,    //!< Formatted records, terminated by a line end on connections.
+        SyslogFraming   //!< RFC 5424 header before the formatted record, octet counting
+                        //!< (RFC 6587) on connections.
+    };
+
+    struct NetworkOptions
+    {
+        NetworkTransport transport = UdpTransport;
+        std::string address;                //!< host:port, [ipv6]:port or a socket path
+        NetworkFraming framing = LineFraming;
+        OverflowPolicy policy = DropNewest; //!< Block makes logging threads wait up to 100 ms for
+                                            //!< space, then records go to the fallback until the
+                                            //!< collector takes records again
+        std::size_t queueSize = 4 << 20;    //!< Bytes of records waiting for the sender
+        unsigned batchInterval = 100;       //!< Milliseconds a record waits for a batch at most
+        std::size_t maxDatagram = 8192;     //!< Longer datagrams are truncated
+        bool fallback = true;               //!< Records not sent are written to the log file
+                                            //!< if they are below the severity level
+        int facility = 1;                   //!< Syslog facility, user-level by default
+        std::string appName;                //!< Syslog APP-NAME, the program name if empty
+    };
+
+    //! Creates a sink sending records to a log collector, add it by addSink(). Records are
+    //! batched and sent by a thread of the sink, by sendmmsg(2) for datagrams and one
+    //! sendmsg(2) per batch for connections. Connections are reestablished after errors.
+    //! Records dropped by the policy or not sent are counted in stats().networkDropped.
+    static std::shared_ptr<Sink> networkSink(NetworkOptions options);
+
+    //! When records written to the log file are flushed. Policies are combined by operator |,
+    //! the buffer is flushed when any of them matches. Error and Fatal records are always flushed.
+    //! Example:
+    //! \code
+    //!     LoggerStream::setFlushPolicy(LoggerStream::FlushPolicy::onLevel(LoggerStream::Warning) |
+    //!                                  LoggerStream::FlushPolicy::interval(100));
+    //! \endcode
+    class FlushPolicy
+    {
+    public:
+        //! Flush after every record. Default.
+        static FlushPolicy everyMessage();
+        //! Flush after a record with \a level or higher.
+        static FlushPolicy onLevel(Level level);
+        //! Flush when \a ms milliseconds passed since the last flush.
+        static FlushPolicy interval(unsigned ms);
+        //! Flush when \a bytes are buffered.
+        static FlushPolicy bufferBytes(std::size_t bytes);
+
+        FlushPolicy operator | (const FlushPolicy &other) const;
+
+    private:
+        friend class LoggerStream;
+
+        FlushPolicy() = default;
+
+        bool every = false;
+        Level level = Fatal;
+        unsigned intervalMs = 0;
+        std::size_t bytes = 0;
+    };
+
+    //! Sets the flush policy for the log file. Doesn't affect the output handler.
+    static void setFlushPolicy(const FlushPolicy &policy);
+
+    //! Enable binary mode. Arguments are captured as raw type tagged values and the text
+    //! is formatted when the record is written, by the writer thread in asynchronous mode.
+    //! Prefixes are resolved when the record is formatted.
+    static void setBinaryMode(bool enabled);
+
+    //! Formats a record captured in binary mode to \a text.
+    //! Sets \a headerSize to the size of the formatted header if it isn't nullptr.
+    static void decodeRecord(Level level, const char *data, std::size_t size, std::string &text,
+                             std::size_t *headerSize = nullptr);
+
+    //! Keeps the last \a records of every thread with \a level or higher which no output wants
+    //! in memory, such records are formatted but not written. They are written to the log file
+    //! by dumpFlightRecorder(), before a fatal record and on SIGSEGV, SIGBUS, SIGILL, SIGFPE
+    //! and SIGABRT. Records are truncated to \a recordSize bytes. Applies to threads which
+    //! didn't record yet, 0 records disables the recorder.
+    static void setFlightRecorder(std::size_t records, Level level = Debug, std::size_t recordSize = 256);
+
+    //! Writes records kept by the flight recorder and not written before to the log file or
+    //! stderr, merged in the timestamp order. Async-signal-safe.
+    static void dumpFlightRecorder();
+
+    //! Histogram of durations in nanoseconds. Values below 8 have own buckets, larger ones
+    //! are split into 8 buckets per power of two, so a bucket is within 12.5% of its values.
+    struct Histogram
+    {
+        static const unsigned bucketCount = 496;
+
+        uint64_t counts[bucketCount];
+
+        //! Returns the bucket of \a value.
+        static unsigned bucket(uint64_t value)
+        {
+            if (value < 8)
+                return unsigned(value);
+
+            unsigned exponent = 63 - unsigned(__builtin_clzll(value));
+            return (exponent - 2) * 8 + unsigned(value >> (exponent - 3) & 7);
+        }
+
+        //! Returns the largest value of \a bucket, "le" of a Prometheus histogram.
+        static uint64_t upperBound(unsigned bucket);
+
+        //! Returns count of values.
+        uint64_t count() const;
+
+        //! Returns the upper bound of the bucket of the \a quantile, 0.99 for p99.
+        uint64_t quantile(double quantile) const;
+    };
+
+    //! Counters of the logger since the start of the process.
+    struct Stats
+    {
+        uint64_t records[Fatal + 1];    //!< Records written to the outputs by level
+        uint64_t bytes;                 //!< Bytes of records written to the log file or the handler
+        uint64_t filtered;              //!< Records built but wanted by no output
+        uint64_t poolHits;              //!< Record buffers taken from the pool
+        uint64_t poolMisses;            //!< Record buffers allocated because the pool was empty
+        uint64_t queueFull;             //!< Records which found the asynchronous queue full
+        uint64_t dropped;               //!< Records dropped by the asynchronous queue
+        uint64_t flushes;               //!< Writes to the log file
+        uint64_t networkSent;           //!< Records sent by network sinks
+        uint64_t networkDropped;        //!< Records dropped or not sent by network sinks
+        uint64_t degraded;              //!< Records dropped by degradation
+        uint64_t degradeTransitions;    //!< Steps of degradation taken up or back
+        uint64_t suppressed;            //!< Records suppressed by rate limited sites
+        DegradeMode degradeMode;        //!< Current step of degradation
+        Histogram recordLatency;        //!< Time of ~LoggerStream, enabled by setLatencyStats()
+        Histogram writeLatency;         //!< Time of writing a record to the outputs
+    };
+
+    //! Returns the sum of counters of all threads. Counters are kept by every thread without
+    //! atomic read-modify-write operations, the snapshot is not exact under load.
+    static Stats stats();
+
+    //! Enables latency histograms, every record reads the clock twice. Disabled by default.
+    static void setLatencyStats(bool enabled);
+
+    //! Sets count of record buffers kept by every thread, reserved size of a buffer
+    //! and maximum size of a buffer returned to the pool. Larger buffers are shrunk.
+    //! Applies to threads which didn't log yet. Once the buffers grew to the size of the
+    //! records, records up to \a bufferLimit are built without heap allocations.
+    static void setPoolReserve(std::size_t streams, std::size_t bufferSize = 256,
+                               std::size_t bufferLimit = 64 * 1024);
+
+    //! Strings of \a size bytes or longer, passed as lvalues, are borrowed by the record
+    //! instead of copied. A record written synchronously is passed to the log file and sinks
+    //! as a list of parts, the log file writes it by one writev(2). Records kept by the
+    //! asynchronous queue or passed to handlers are joined. The strings must outlive the
+    //! record, as they do within one statement, not when a stream is kept in a variable.
+    //! 0 disables, default.
+    static void setStreamingThreshold(std::size_t size);
+
 private:
+    void init(Level level);
+
     template<typename T>
     void addLogMessage(const T &s);
 
+    template<typename T>
+    void addNumber(T value);
+
+    //! Type tags of arguments in binary mode.
+    enum ArgumentType : unsigned char
+    {
+        StringArgument,
+        IntArgument,
+        UIntArgument,
+        DoubleArgument,
+        LongDoubleArgument,
+
+        ArgumentTypeMask = 0x0f,
+        SpaceFlag = 0x10,
+        QuoteFlag = 0x20,
+        HexFlag = 0x40
+    };
+
+    //! Appends an escaped argument in quote marks.
+    void addQuotedMessage(std::string_view s);
+    //! Appends a message argument of a logfmt or JSON record.
+    void addEscapedMessage(std::string_view s);
+    void addField(std::string_view key, std::string_view value, bool isString);
+    template<typename T>
+    void addNumberField(std::string_view key, T value);
+    //! Marks the record of a named logger and writes the name.
+    void setLogger(std::string_view name);
+    //! Closes the message and appends fields of a logfmt or JSON record.
+    void finishRecord();
+
+    //! Type erased argument of format().
+    struct FormatArgument
+    {
+        enum Type : unsigned char
+        {
+            Int,
+            UInt,
+            Double,
+            LongDouble,
+            String
+        };
+
+        Type type;
+        union
+        {
+            int64_t i;
+            uint64_t u;
+            double d;
+            long double ld;
+            const char *data;
+        };
+        std::size_t size;
+    };
+
+    template<typename T>
+    static void setFormatArgument(FormatArgument &argument, const T &value);
+    void addFormatted(std::string_view text, const LogFormatPart *parts, bool valid,
+                      const FormatArgument *arguments, std::size_t count);
+    static void appendFormatted(std::string &out, std::string_view text, const LogFormatPart *parts, bool valid,
+                                const FormatArgument *arguments, std::size_t count, int precision);
+    static void appendFormatArgument(std::string &out, const FormatArgument &argument, bool hex, int precision);
+
+    //! Appends \a s borrowed until the record is written, copies it if the record escapes it.
+    void addBorrowed(std::string_view s);
+    //! Copies borrowed strings into the record.
+    void joinBorrowed();
+
+    void addBinaryArgument(ArgumentType type, const void *data, std::size_t size);
+    void addBinaryString(std::string_view s);
+    template<typename T>
+    void addBinaryNumber(T value);
+
     struct Stream
     {
         Stream() = default;
@@ -108,26 +810,408 @@ private:
         Level level;
         bool space;
         bool quote;
+        bool hex;
+        bool binary;
+        //! Created by a named logger, the level of the log file doesn't apply
+        bool named;
+        unsigned char format;
+        int precision;
+        //! Timestamp in nanoseconds
+        uint64_t time;
+        uint32_t threadId;
+        //! Size of the formatted header, 0 in binary mode
+        uint32_t headerSize;
+        //! Fields of a logfmt or JSON record, appended after the message
+        std::string fields;
+
+        //! String borrowed by the record, inserted at \a offset of str.
+        struct Borrowed
+        {
+            std::size_t offset;
+            Bytes bytes;
+        };
+
+        std::vector<Borrowed> borrowed;
+        //! Size of borrowed strings
+        std::size_t borrowedSize;
+        //! Text and borrowed strings of the record in order, built by the destructor
+        std::vector<Bytes> parts;
+
+        //! Next stream in the pool
+        Stream *next = nullptr;
     };
 
+    //! Fixed capacity thread local free list of streams.
+    class Pool;
+
     // +30% for perfomance
-    static std::shared_ptr<Stream> getFromPool();
-    static void pushToPool(std::shared_ptr<Stream> stream);
-    static thread_local std::deque<std::shared_ptr<Stream>> pool;
+    static Stream *getFromPool();
+    static void pushToPool(Stream *stream);
+    static thread_local Pool pool;
+
+    //! The lowest level of the log file and sinks.
+    static std::atomic<Level> severityLevel;
+    //! Size of strings borrowed by records, SIZE_MAX if disabled.
+    static std::atomic<std::size_t> streamingThreshold;
+
+    Stream *stream = nullptr;
+};
+
+/*!
+ * Named logger with own level. Levels are inherited by dotted names: "net.tcp" uses
+ * the level of "net" until own level is set, loggers without a level use the severity
+ * level. The level is resolved once on construction, the check is one relaxed load.
+ * \code
+ *  static Logger tcpLog("net.tcp");
+ *  tcpLog.debug() << "connected" << fd;
+ *  Logger::setLevel("net", LoggerStream::Debug);
+ * \endcode
+ */
+class Logger
+{
+public:
+    explicit Logger(std::string_view name);
+
+    std::string_view name() const
+    {
+        return loggerName;
+    }
+
+    bool isEnabled(LoggerStream::Level level) const
+    {
+        return (level >= LOGGER_MIN_LEVEL || level == LoggerStream::Fatal) &&
+               level >= this->level->load(std::memory_order_relaxed);
+    }
+
+    LoggerStream stream(LoggerStream::Level level) const
+    {
+        return LoggerStream(level, *this);
+    }
+
+    LoggerStream debug() const
+    {
+        return stream(LoggerStream::Debug);
+    }
+
+    LoggerStream info() const
+    {
+        return stream(LoggerStream::Info);
+    }
+
+    LoggerStream warning() const
+    {
+        return stream(LoggerStream::Warning);
+    }
 
-    std::shared_ptr<Stream> stream;
+    LoggerStream error() const
+    {
+        return stream(LoggerStream::Error);
+    }
+
+    //! Flushes the asynchronous queue, never returns.
+    LoggerStream fatal() const
+    {
+        return stream(LoggerStream::Fatal);
+    }
+
+    //! Sets the level of the logger \a name and of its descendants without own level.
+    static void setLevel(std::string_view name, LoggerStream::Level level);
+
+    //! Removes own level of the logger \a name, it inherits the level of the parent again.
+    static void resetLevel(std::string_view name);
+
+private:
+    const std::atomic<LoggerStream::Level> *level;
+    std::string_view loggerName;
 };
 
 //! Creates a debug stream.
-LoggerStream logDebug();
+inline LoggerStream logDebug();
 //! Creates a debug stream for a info messages.
-LoggerStream logInfo();
+inline LoggerStream logInfo();
 //! Creates a debug stream for warnings.
-LoggerStream logWarning();
+inline LoggerStream logWarning();
 //! Creates a debug stream for error.
-LoggerStream logError();
-//! Creates a debug stream for fatal error. Never returns.
-LoggerStream logFatal();
+inline LoggerStream logError();
+//! Creates a debug stream for fatal error. Flushes the asynchronous queue, never returns.
+inline LoggerStream logFatal();
+
+#ifdef LOGGER_CHECKED_FORMAT
+//! Create streams with a message formatted by \a format, see LogFormat. C++20 only.
+template<typename... Args>
+inline LoggerStream logDebug(const LogFormat<sizeof...(Args)> &format, const Args &... args);
+template<typename... Args>
+inline LoggerStream logInfo(const LogFormat<sizeof...(Args)> &format, const Args &... args);
+template<typename... Args>
+inline LoggerStream logWarning(const LogFormat<sizeof...(Args)> &format, const Args &... args);
+template<typename... Args>
+inline LoggerStream logError(const LogFormat<sizeof...(Args)> &format, const Args &... args);
+template<typename... Args>
+inline LoggerStream logFatal(const LogFormat<sizeof...(Args)> &format, const Args &... args);
+#endif
+
+//! Creates a structured field. Written as key=value, or as a member in JSON format.
+//! Spaces, '=', '"' and control characters of keys are replaced by '_' in key=value form,
+//! an empty key is written as '_'. JSON escapes keys.
+//! Example:
+//! \code
+//!     logInfo() << "login" << kv("user", id) << kv("ms", elapsed);
+//! \endcode
+template<typename T>
+inline LoggerStream::KeyValue<T> kv(std::string_view key, const T &value);
+
+//! Appends \a size bytes at \a data without a copy when the record is written synchronously.
+//! The bytes must stay valid until the record is written.
+//! Example:
+//! \code
+//!     logInfo() << "request" << logBytes(body.data(), body.size());
+//! \endcode
+inline LoggerStream::Bytes logBytes(const void *data, std::size_t size);
+
+/*!
+ * Logs the duration of a scope when it takes the threshold or longer, or when the scope
+ * is sampled. A disabled level costs one relaxed load, the clock is not read.
+ * \code
+ *  void parse()
+ *  {
+ *      auto timer = logScope("parse", std::chrono::milliseconds(5));
+ *      ...
+ *  }
+ * \endcode
+ *
+ * Sampled timers of LOG_SCOPE count the scopes of the call site, timers of logScope()
+ * share one counter per thread.
+ *
+ * Output:
+ *  03.08.2017 12:44:15.737 I [26629] :  parse took 7312.114 us
+ */
+class LogTimer
+{
+public:
+    //! Writes a record with \a level if the scope takes \a threshold or longer, and for
+    //! every \a sampleRate-th timer of the thread if it isn't 0.
+    //! \a name must outlive the timer.
+    LogTimer(std::string_view name, std::chrono::nanoseconds threshold = {},
+             LoggerStream::Level level = LoggerStream::Info, unsigned sampleRate = 0);
+    //! Samples every \a sampleRate-th timer counted by \a counter, one static counter per call site.
+    LogTimer(std::atomic<unsigned> *counter, std::string_view name, std::chrono::nanoseconds threshold = {},
+             LoggerStream::Level level = LoggerStream::Info, unsigned sampleRate = 0);
+    LogTimer(const LogTimer &) = delete;
+    LogTimer &operator = (const LogTimer &) = delete;
+    ~LogTimer();
+
+private:
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //! Checks the threshold and the sample rate, writes the record.
+    void finish();
+
+    std::string_view name;
+    int64_t threshold;
+    int64_t start = 0;
+    LoggerStream::Level level;
+    unsigned sampleRate;
+    std::atomic<unsigned> *counter = nullptr;
+    bool enabled = false;
+};
+
+//! Creates a scope timer, see LogTimer.
+inline LogTimer logScope(std::string_view name, std::chrono::nanoseconds threshold = {},
+                         LoggerStream::Level level = LoggerStream::Info, unsigned sampleRate = 0);
+
+#define LOGGER_JOIN_IMPL(a, b) a##b
+#define LOGGER_JOIN(a, b) LOGGER_JOIN_IMPL(a, b)
+
+//! Times the rest of the scope, the arguments are those of logScope(). Sampled scopes
+//! are counted per call site:
+//! \code
+//!     LOG_SCOPE("query", std::chrono::milliseconds(10), LoggerStream::Info, 100);
+//! \endcode
+#define LOG_SCOPE(...) LOGGER_SCOPE(LOGGER_JOIN(loggerScope, __COUNTER__), __VA_ARGS__)
+
+#define LOGGER_SCOPE(timer, ...) \
+    static std::atomic<unsigned> LOGGER_JOIN(timer, Counter) {0}; \
+    LogTimer timer(&LOGGER_JOIN(timer, Counter), __VA_ARGS__)
+
+#define LOGGER_STREAM(level) \
+    if (!LoggerStream::isEnabled(level)) {} else LoggerStream(level)
+
+#define LOG_DEBUG   LOGGER_STREAM(LoggerStream::Debug)
+#define LOG_INFO    LOGGER_STREAM(LoggerStream::Info)
+#define LOG_WARNING LOGGER_STREAM(LoggerStream::Warning)
+#define LOG_ERROR   LOGGER_STREAM(LoggerStream::Error)
+#define LOG_FATAL   LOGGER_STREAM(LoggerStream::Fatal)
+
+//! Checks the level of the named \a logger before the arguments are evaluated.
+#define LOGGER_STREAM_TO(logger, level) \
+    if (!(logger).isEnabled(level)) {} else (logger).stream(level)
+
+#define LOG_DEBUG_TO(logger)   LOGGER_STREAM_TO(logger, LoggerStream::Debug)
+#define LOG_INFO_TO(logger)    LOGGER_STREAM_TO(logger, LoggerStream::Info)
+#define LOG_WARNING_TO(logger) LOGGER_STREAM_TO(logger, LoggerStream::Warning)
+#define LOG_ERROR_TO(logger)   LOGGER_STREAM_TO(logger, LoggerStream::Error)
+#define LOG_FATAL_TO(logger)   LOGGER_STREAM_TO(logger, LoggerStream::Fatal)
+
+//! Checks the level before the arguments are evaluated and the format at compile time:
+//! \code
+//!     LOG_INFO_F("user {} took {} ms", id, ms);
+//! \endcode
+#define LOGGER_FORMAT(level, text, ...) \
+    if (!LoggerStream::isEnabled(level)) {} else \
+    if (static constexpr LogFormat<std::tuple_size<decltype(std::forward_as_tuple(__VA_ARGS__))>::value> \
+            loggerFormat(text); false) {} else \
+        LoggerStream(level).format(loggerFormat, ##__VA_ARGS__)
+
+#define LOG_DEBUG_F(...)   LOGGER_FORMAT(LoggerStream::Debug, __VA_ARGS__)
+#define LOG_INFO_F(...)    LOGGER_FORMAT(LoggerStream::Info, __VA_ARGS__)
+#define LOG_WARNING_F(...) LOGGER_FORMAT(LoggerStream::Warning, __VA_ARGS__)
+#define LOG_ERROR_F(...)   LOGGER_FORMAT(LoggerStream::Error, __VA_ARGS__)
+#define LOG_FATAL_F(...)   LOGGER_FORMAT(LoggerStream::Fatal, __VA_ARGS__)
+
+#define LOGGER_LIMITED(level, condition) \
+    if (!LoggerStream::isEnabled(level)) {} else \
+    if (static LoggerStream::RateLimit loggerRateLimit(level, __FILE__, __LINE__); \
+        !loggerRateLimit.condition) {} else \
+        LoggerStream(level, loggerRateLimit)
+
+//! Writes every \a n-th record of the call site. Suppressed records are not formatted,
+//! their count is written before the next record or by LoggerStream::writeSuppressed():
+//! \code
+//!     LOG_EVERY_N(LoggerStream::Error, 1000) << "request failed" << error;
+//! \endcode
+#define LOG_EVERY_N(level, n) LOGGER_LIMITED(level, everyN(n))
+
+//! Writes at most one record of the call site in \a ms milliseconds.
+#define LOG_EVERY_MS(level, ms) LOGGER_LIMITED(level, allow(uint64_t(ms) * 1000000))
+
+//! Writes at most \a rate records of the call site per second, bursts up to \a burst records.
+//! A rate of 0 suppresses all records of the site.
+#define LOG_RATE_LIMIT(level, rate, burst) \
+    LOGGER_LIMITED(level, perSecond(double(rate), burst))
+
+inline LoggerStream::LoggerStream(Level level)
+{
+    if (isEnabled(level))
+    {
+        init(level);
+    }
+}
+
+inline LoggerStream::LoggerStream(Level level, const Logger &logger)
+{
+    if (logger.isEnabled(level))
+    {
+        init(level);
+        if (stream)
+            setLogger(logger.name());
+    }
+}
+
+inline LoggerStream::LoggerStream(LoggerStream &&other) noexcept
+    : stream(other.stream)
+{
+    other.stream = nullptr;
+}
+
+inline bool LoggerStream::RateLimit::everyN(unsigned n)
+{
+    uint64_t c = count.fetch_add(1, std::memory_order_relaxed);
+    if (n <= 1 || c % n == 0)
+        return true;
+
+    suppress();
+    return false;
+}
+
+inline bool LoggerStream::RateLimit::perSecond(double rate, unsigned burst)
+{
+    if (rate > 0)
+    {
+        // at least a nanosecond and at most about 30 years between records
+        double interval = 1e9 / rate;
+        return allow(interval < 1 ? 1 : interval < 1e18 ? uint64_t(interval) : uint64_t(1e18), burst);
+    }
+
+    suppress();
+    return false;
+}
+
+inline bool LoggerStream::isEnabled(Level level)
+{
+    return (level >= LOGGER_MIN_LEVEL || level == Fatal) &&
+           level >= severityLevel.load(std::memory_order_relaxed);
+}
+
+inline LoggerStream logDebug()
+{
+    return LoggerStream(LoggerStream::Debug);
+}
+
+inline LoggerStream logInfo()
+{
+    return LoggerStream(LoggerStream::Info);
+}
+
+inline LoggerStream logWarning()
+{
+    return LoggerStream(LoggerStream::Warning);
+}
+
+inline LoggerStream logError()
+{
+    return LoggerStream(LoggerStream::Error);
+}
+
+inline LoggerStream logFatal()
+{
+    return LoggerStream(LoggerStream::Fatal);
+}
+
+#ifdef LOGGER_CHECKED_FORMAT
+template<typename... Args>
+inline LoggerStream logDebug(const LogFormat<sizeof...(Args)> &format, const Args &... args)
+{
+    LoggerStream s(LoggerStream::Debug);
+    s.format(format, args...);
+    return s;
+}
+
+template<typename... Args>
+inline LoggerStream logInfo(const LogFormat<sizeof...(Args)> &format, const Args &... args)
+{
+    LoggerStream s(LoggerStream::Info);
+    s.format(format, args...);
+    return s;
+}
+
+template<typename... Args>
+inline LoggerStream logWarning(const LogFormat<sizeof...(Args)> &format, const Args &... args)
+{
+    LoggerStream s(LoggerStream::Warning);
+    s.format(format, args...);
+    return s;
+}
+
+template<typename... Args>
+inline LoggerStream logError(const LogFormat<sizeof...(Args)> &format, const Args &... args)
+{
+    LoggerStream s(LoggerStream::Error);
+    s.format(format, args...);
+    return s;
+}
+
+template<typename... Args>
+inline LoggerStream logFatal(const LogFormat<sizeof...(Args)> &format, const Args &... args)
+{
+    LoggerStream s(LoggerStream::Fatal);
+    s.format(format, args...);
+    return s;
+}
+#endif
 
 inline LoggerStream &LoggerStream::space()
 {
@@ -165,6 +1249,33 @@ inline LoggerStream &LoggerStream::noquote()
     return *this;
 }
 
+inline LoggerStream &LoggerStream::hex()
+{
+    if (stream)
+    {
+        stream->hex = true;
+    }
+    return *this;
+}
+
+inline LoggerStream &LoggerStream::dec()
+{
+    if (stream)
+    {
+        stream->hex = false;
+    }
+    return *this;
+}
+
+inline LoggerStream &LoggerStream::precision(int n)
+{
+    if (stream)
+    {
+        stream->precision = n < 0 ? 0 : n;
+    }
+    return *this;
+}
+
 inline LoggerStream &LoggerStream::operator << (const char *s)
 {
     if (stream)
@@ -185,6 +1296,18 @@ inline LoggerStream &LoggerStream::operator << (char *s)
 
 
 inline LoggerStream &LoggerStream::operator << (const std::string &s)
+{
+    if (stream)
+    {
+        if (s.size() >= streamingThreshold.load(std::memory_order_relaxed))
+            addBorrowed(s);
+        else
+            addLogMessage(s);
+    }
+    return *this;
+}
+
+inline LoggerStream &LoggerStream::operator << (std::string &&s)
 {
     if (stream)
     {
@@ -193,11 +1316,29 @@ inline LoggerStream &LoggerStream::operator << (const std::string &s)
     return *this;
 }
 
+inline LoggerStream &LoggerStream::operator << (std::string_view s)
+{
+    if (stream)
+    {
+        addLogMessage(s);
+    }
+    return *this;
+}
+
+inline LoggerStream &LoggerStream::operator << (const Bytes &bytes)
+{
+    if (stream)
+    {
+        addBorrowed(std::string_view(bytes.data, bytes.size));
+    }
+    return *this;
+}
+
 inline LoggerStream &LoggerStream::operator << (char c)
 {
     if (stream)
     {
-        addLogMessage(std::string{&c, 1});
+        addLogMessage(std::string_view{&c, 1});
     }
     return *this;
 }
@@ -207,29 +1348,310 @@ inline LoggerStream &LoggerStream::operator << (const T &s)
 {
     if (stream)
     {
-        addLogMessage(std::to_string(s));
+        if constexpr (std::is_same<T, bool>::value)
+        {
+            addNumber(int(s));
+        }
+        else if constexpr (std::is_integral<T>::value || std::is_floating_point<T>::value)
+        {
+            addNumber(s);
+        }
+        else
+        {
+            addLogMessage(std::to_string(s));
+        }
+    }
+    return *this;
+}
+
+template<typename... Args>
+inline LoggerStream &LoggerStream::format(const LogFormat<sizeof...(Args)> &format,
+                                          const Args &... args)
+{
+    if (stream)
+    {
+        // one more element, arrays can't be empty
+        FormatArgument arguments[sizeof...(Args) + 1];
+        FormatArgument *argument = arguments;
+        (setFormatArgument(*argument++, args), ...);
+        addFormatted(format.text, format.parts, format.valid, arguments, sizeof...(Args));
     }
     return *this;
 }
 
+template<typename T>
+inline void LoggerStream::setFormatArgument(FormatArgument &argument, const T &value)
+{
+    if constexpr (std::is_same<T, bool>::value)
+    {
+        argument.type = FormatArgument::String;
+        argument.data = value ? "true" : "false";
+        argument.size = value ? 4 : 5;
+    }
+    else if constexpr (std::is_same<T, char>::value)
+    {
+        argument.type = FormatArgument::String;
+        argument.data = &value;
+        argument.size = 1;
+    }
+    else if constexpr (std::is_enum<T>::value)
+    {
+        setFormatArgument(argument, static_cast<typename std::underlying_type<T>::type>(value));
+    }
+    else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+    {
+        argument.type = FormatArgument::Int;
+        argument.i = value;
+    }
+    else if constexpr (std::is_integral<T>::value)
+    {
+        argument.type = FormatArgument::UInt;
+        argument.u = value;
+    }
+    else if constexpr (std::is_same<T, long double>::value)
+    {
+        argument.type = FormatArgument::LongDouble;
+        argument.ld = value;
+    }
+    else if constexpr (std::is_floating_point<T>::value)
+    {
+        argument.type = FormatArgument::Double;
+        argument.d = value;
+    }
+    else if constexpr (std::is_convertible<const T &, std::string_view>::value)
+    {
+        std::string_view s;
+        if constexpr (std::is_pointer<T>::value)
+            s = value ? std::string_view(value) : std::string_view("(null)");
+        else
+            s = value;
+
+        argument.type = FormatArgument::String;
+        argument.data = s.data();
+        argument.size = s.size();
+    }
+    else
+    {
+        static_assert(sizeof(T) == 0, "unsupported argument type of a format string, convert it to a string");
+    }
+}
+
+inline LogTimer::LogTimer(std::string_view name, std::chrono::nanoseconds threshold,
+                          LoggerStream::Level level, unsigned sampleRate)
+    : name(name)
+    , threshold(threshold.count())
+    , level(level)
+    , sampleRate(sampleRate)
+{
+    if (LoggerStream::isEnabled(level))
+    {
+        enabled = true;
+        start = now();
+    }
+}
+
+inline LogTimer::LogTimer(std::atomic<unsigned> *counter, std::string_view name, std::chrono::nanoseconds threshold,
+                          LoggerStream::Level level, unsigned sampleRate)
+    : LogTimer(name, threshold, level, sampleRate)
+{
+    this->counter = counter;
+}
+
+inline LogTimer::~LogTimer()
+{
+    if (enabled)
+    {
+        finish();
+    }
+}
+
+inline LogTimer logScope(std::string_view name, std::chrono::nanoseconds threshold,
+                         LoggerStream::Level level, unsigned sampleRate)
+{
+    return LogTimer(name, threshold, level, sampleRate);
+}
+
+template<typename T>
+inline LoggerStream::KeyValue<T> kv(std::string_view key, const T &value)
+{
+    return LoggerStream::KeyValue<T>{key, value};
+}
+
+inline LoggerStream::Bytes logBytes(const void *data, std::size_t size)
+{
+    return LoggerStream::Bytes{static_cast<const char *>(data), size};
+}
+
+template<typename T>
+inline LoggerStream &LoggerStream::operator << (const KeyValue<T> &field)
+{
+    if (stream)
+    {
+        if constexpr (std::is_same<T, bool>::value)
+        {
+            addField(field.key, field.value ? "true" : "false", false);
+        }
+        else if constexpr (std::is_same<T, char>::value)
+        {
+            addField(field.key, std::string_view(&field.value, 1), true);
+        }
+        else if constexpr (std::is_integral<T>::value || std::is_floating_point<T>::value)
+        {
+            addNumberField(field.key, field.value);
+        }
+        else if constexpr (std::is_convertible<const T &, std::string_view>::value)
+        {
+            addField(field.key, std::string_view(field.value), true);
+        }
+        else
+        {
+            addField(field.key, std::to_string(field.value), true);
+        }
+    }
+    return *this;
+}
+
+template<typename T>
+void LoggerStream::addNumberField(std::string_view key, T value)
+{
+    char buffer[128];
+    std::to_chars_result result;
+
+    if constexpr (std::is_integral<T>::value)
+    {
+        result = std::to_chars(buffer, buffer + sizeof(buffer), value, stream->hex ? 16 : 10);
+    }
+    else
+    {
+        result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed,
+                               stream->precision);
+    }
+
+    if (result.ec == std::errc())
+    {
+        // hex digits, infinity and NaN are not JSON numbers
+        bool isString = false;
+        if constexpr (std::is_integral<T>::value)
+            isString = stream->hex;
+        else
+            isString = !std::isfinite(value);
+
+        addField(key, std::string_view(buffer, result.ptr - buffer), isString);
+    }
+    else
+    {
+        addField(key, std::to_string(value), false);
+    }
+}
+
+template<typename T>
+void LoggerStream::addNumber(T value)
+{
+    if (stream->binary)
+    {
+        addBinaryNumber(value);
+        return;
+    }
+
+    // enough for any integer and for usual floating point values
+    char buffer[128];
+    std::to_chars_result result;
+
+    if constexpr (std::is_integral<T>::value)
+    {
+        result = std::to_chars(buffer, buffer + sizeof(buffer), value, stream->hex ? 16 : 10);
+    }
+    else
+    {
+        result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed,
+                               stream->precision);
+    }
+
+    if (result.ec == std::errc())
+    {
+        addLogMessage(std::string_view(buffer, result.ptr - buffer));
+    }
+    else
+    {
+        addLogMessage(std::to_string(value));
+    }
+}
+
 template<typename T>
 void LoggerStream::addLogMessage(const T &s)
 {
     assert(stream);
+    if (stream->binary)
+    {
+        addBinaryString(s);
+        return;
+    }
+    if (stream->format != TextFormat)
+    {
+        addEscapedMessage(s);
+        return;
+    }
+
     if (stream->space)
     {
         stream->str += ' ';
     }
+
     if (stream->quote)
     {
-        stream->str += '"';
+        addQuotedMessage(s);
     }
+    else
+    {
+        stream->str += s;
+    }
+}
 
-    stream->str += s;
-
+inline void LoggerStream::addBinaryArgument(ArgumentType type, const void *data, std::size_t size)
+{
+    unsigned char tag = type;
+    if (stream->space)
+        tag |= SpaceFlag;
     if (stream->quote)
+        tag |= QuoteFlag;
+    if (stream->hex)
+        tag |= HexFlag;
+
+    stream->str += char(tag);
+    stream->str.append(static_cast<const char *>(data), size);
+}
+
+inline void LoggerStream::addBinaryString(std::string_view s)
+{
+    uint32_t size = uint32_t(s.size());
+    addBinaryArgument(StringArgument, &size, sizeof(size));
+    stream->str.append(s.data(), size);
+}
+
+template<typename T>
+void LoggerStream::addBinaryNumber(T value)
+{
+    if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+    {
+        int64_t v = value;
+        addBinaryArgument(IntArgument, &v, sizeof(v));
+    }
+    else if constexpr (std::is_integral<T>::value)
     {
-        stream->str += '"';
+        uint64_t v = value;
+        addBinaryArgument(UIntArgument, &v, sizeof(v));
+    }
+    else
+    {
+        if constexpr (std::is_same<T, long double>::value)
+        {
+            addBinaryArgument(LongDoubleArgument, &value, sizeof(value));
+        }
+        else
+        {
+            double v = value;
+            addBinaryArgument(DoubleArgument, &v, sizeof(v));
+        }
+        stream->str += char(stream->precision > 255 ? 255 : stream->precision);
     }
 }
-
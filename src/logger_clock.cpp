@@ -0,0 +1,170 @@
+
+#include "logger_clock.h"
+
+#include <atomic>
+#include <mutex>
+
+#include <time.h>
+
+// the scaling takes 128-bit products
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define LOGGER_HAS_TSC 1
+#endif
+
+namespace
+{
+#ifdef LOGGER_HAS_TSC
+    __extension__ typedef __int128 Int128;
+    __extension__ typedef unsigned __int128 UInt128;
+#endif
+
+    //! Parameters of the source, guarded by a sequence number: readers retry while
+    //! setSource() changes them, so no snapshot is allocated or leaked.
+    struct Calibration
+    {
+        //! Odd while the parameters change
+        std::atomic<unsigned> sequence {0};
+        std::atomic<LoggerStream::ClockSource> source {LoggerStream::RealtimeClock};
+        //! Wall clock minus the monotonic clock
+        std::atomic<uint64_t> offset {0};
+        //! TSC and wall clock time of the calibration
+        std::atomic<uint64_t> baseTicks {0};
+        std::atomic<uint64_t> baseTime {0};
+        //! Nanoseconds per tick, fixed point with 32 fractional bits
+        std::atomic<uint64_t> multiplier {0};
+    };
+
+    Calibration calibration;
+    // serializes setSource()
+    std::mutex calibrationMutex;
+
+    uint64_t clockTime(clockid_t clock)
+    {
+        timespec ts;
+        clock_gettime(clock, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+    }
+
+#ifdef LOGGER_HAS_TSC
+    //! Takes the TSC in the middle of two readings of the monotonic clock.
+    void sample(uint64_t &ticks, uint64_t &time)
+    {
+        uint64_t before = clockTime(CLOCK_MONOTONIC);
+        ticks = __rdtsc();
+        uint64_t after = clockTime(CLOCK_MONOTONIC);
+        time = before + (after - before) / 2;
+    }
+
+    //! Returns true if the TSC runs at a constant rate in all power states (CPUID 0x80000007 EDX bit 8).
+    bool invariantTsc()
+    {
+        unsigned eax, ebx, ecx, edx;
+        return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8)) != 0;
+    }
+#endif
+}
+
+void LoggerClock::setSource(LoggerStream::ClockSource source)
+{
+#ifdef LOGGER_HAS_TSC
+    if (source == LoggerStream::TscClock && !invariantTsc())
+        source = LoggerStream::MonotonicClock;
+#else
+    if (source == LoggerStream::TscClock)
+        source = LoggerStream::MonotonicClock;
+#endif
+
+    uint64_t offset = 0;
+    uint64_t baseTicks = 0;
+    uint64_t baseTime = 0;
+    uint64_t multiplier = 0;
+
+    if (source != LoggerStream::RealtimeClock)
+    {
+        clockid_t clock = source == LoggerStream::CoarseClock ? CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC;
+        uint64_t monotonic = clockTime(clock);
+        offset = clockTime(CLOCK_REALTIME) - monotonic;
+    }
+
+#ifdef LOGGER_HAS_TSC
+    if (source == LoggerStream::TscClock)
+    {
+        uint64_t ticks0, time0, ticks1, time1;
+        sample(ticks0, time0);
+
+        timespec delay = {0, 10000000};
+        while (nanosleep(&delay, &delay) != 0)
+        {
+        }
+
+        sample(ticks1, time1);
+
+        baseTicks = ticks1;
+        baseTime = time1 + offset;
+        multiplier = ticks1 > ticks0
+            ? uint64_t((UInt128(time1 - time0) << 32) / (ticks1 - ticks0))
+            : uint64_t(1) << 32;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(calibrationMutex);
+
+    unsigned sequence = calibration.sequence.load(std::memory_order_relaxed);
+    calibration.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    calibration.source.store(source, std::memory_order_relaxed);
+    calibration.offset.store(offset, std::memory_order_relaxed);
+    calibration.baseTicks.store(baseTicks, std::memory_order_relaxed);
+    calibration.baseTime.store(baseTime, std::memory_order_relaxed);
+    calibration.multiplier.store(multiplier, std::memory_order_relaxed);
+
+    calibration.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+uint64_t LoggerClock::now()
+{
+    LoggerStream::ClockSource source;
+    uint64_t offset, baseTicks, baseTime, multiplier;
+    for (;;)
+    {
+        unsigned sequence = calibration.sequence.load(std::memory_order_acquire);
+        source = calibration.source.load(std::memory_order_relaxed);
+        offset = calibration.offset.load(std::memory_order_relaxed);
+        baseTicks = calibration.baseTicks.load(std::memory_order_relaxed);
+        baseTime = calibration.baseTime.load(std::memory_order_relaxed);
+        multiplier = calibration.multiplier.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if ((sequence & 1) == 0 && calibration.sequence.load(std::memory_order_relaxed) == sequence)
+            break;
+    }
+
+#ifndef LOGGER_HAS_TSC
+    (void)baseTicks;
+    (void)baseTime;
+    (void)multiplier;
+#endif
+
+    switch (source)
+    {
+    case LoggerStream::MonotonicClock:
+        return clockTime(CLOCK_MONOTONIC) + offset;
+    case LoggerStream::CoarseClock:
+        return clockTime(CLOCK_MONOTONIC_COARSE) + offset;
+#ifdef LOGGER_HAS_TSC
+    case LoggerStream::TscClock:
+    {
+        // the TSC of a core may be slightly behind the base
+        int64_t ticks = int64_t(__rdtsc() - baseTicks);
+        Int128 delta = (Int128(ticks) * Int128(multiplier)) >> 32;
+        return uint64_t(int64_t(baseTime) + int64_t(delta));
+    }
+#endif
+    case LoggerStream::RealtimeClock:
+    default:
+        return clockTime(CLOCK_REALTIME);
+    }
+}
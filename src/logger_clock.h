@@ -0,0 +1,23 @@
+#pragma once
+
+#include "logger.h"
+
+#include <cstdint>
+
+/*!
+ * Timestamps of records in nanoseconds since the epoch.
+ *
+ * Monotonic sources are converted to the wall clock by an offset taken when the source
+ * is set, so they don't jump on NTP steps but drift from the wall clock until the source
+ * is set again.
+ */
+class LoggerClock
+{
+public:
+    //! Sets the source and calibrates it against the wall clock. Calibration of the TSC
+    //! takes about 10 ms.
+    static void setSource(LoggerStream::ClockSource source);
+
+    //! Returns the current time in nanoseconds since the epoch.
+    static uint64_t now();
+};
@@ -0,0 +1,568 @@
+
+#include "logger_compress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef LOGGER_HAS_ZSTD
+#include <zstd.h>
+#endif
+#ifdef LOGGER_HAS_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef LOGGER_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace
+{
+    std::atomic<int> compressionLevel {0};
+    std::atomic<size_t> compressionFrameSize {1 << 20};
+    std::atomic<unsigned> compressionFrameInterval {1000};
+
+    //! Streaming compressor of one format.
+    class Codec
+    {
+    public:
+        virtual ~Codec() = default;
+
+        //! Appends compressed \a data to \a out, starts a frame if needed.
+        virtual bool compress(const char *data, size_t size, std::string &out) = 0;
+
+        //! Finishes the frame, the next data starts a new one.
+        virtual bool endFrame(std::string &out) = 0;
+    };
+
+#ifdef LOGGER_HAS_ZSTD
+    class ZstdCodec : public Codec
+    {
+    public:
+        explicit ZstdCodec(int level)
+            : context(ZSTD_createCCtx())
+        {
+            if (context)
+            {
+                ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level != 0 ? level : 3);
+                ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1);
+            }
+        }
+
+        ~ZstdCodec() override
+        {
+            ZSTD_freeCCtx(context);
+        }
+
+        bool valid() const
+        {
+            return context != nullptr;
+        }
+
+        bool compress(const char *data, size_t size, std::string &out) override
+        {
+            ZSTD_inBuffer input = {data, size, 0};
+            while (input.pos < input.size)
+            {
+                if (!step(input, ZSTD_e_continue, out))
+                    return false;
+            }
+            return true;
+        }
+
+        bool endFrame(std::string &out) override
+        {
+            ZSTD_inBuffer input = {nullptr, 0, 0};
+            size_t remaining;
+            do
+            {
+                if (!step(input, ZSTD_e_end, out, &remaining))
+                    return false;
+            }
+            while (remaining != 0);
+            return true;
+        }
+
+    private:
+        bool step(ZSTD_inBuffer &input, ZSTD_EndDirective mode, std::string &out, size_t *remaining = nullptr)
+        {
+            size_t start = out.size();
+            out.resize(start + ZSTD_CStreamOutSize());
+
+            ZSTD_outBuffer output = {&out[start], out.size() - start, 0};
+            size_t result = ZSTD_compressStream2(context, &output, &input, mode);
+            out.resize(start + output.pos);
+
+            if (ZSTD_isError(result))
+                return false;
+            if (remaining)
+                *remaining = result;
+            return true;
+        }
+
+        ZSTD_CCtx *context;
+    };
+#endif
+
+#ifdef LOGGER_HAS_LZ4
+    class Lz4Codec : public Codec
+    {
+    public:
+        explicit Lz4Codec(int level)
+        {
+            memset(&preferences, 0, sizeof(preferences));
+            preferences.compressionLevel = level;
+            preferences.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+
+            if (LZ4F_isError(LZ4F_createCompressionContext(&context, LZ4F_VERSION)))
+                context = nullptr;
+        }
+
+        ~Lz4Codec() override
+        {
+            if (context)
+                LZ4F_freeCompressionContext(context);
+        }
+
+        bool valid() const
+        {
+            return context != nullptr;
+        }
+
+        bool compress(const char *data, size_t size, std::string &out) override
+        {
+            if (!started)
+            {
+                size_t start = out.size();
+                out.resize(start + LZ4F_HEADER_SIZE_MAX);
+                size_t result = LZ4F_compressBegin(context, &out[start], LZ4F_HEADER_SIZE_MAX, &preferences);
+                if (LZ4F_isError(result))
+                {
+                    out.resize(start);
+                    return false;
+                }
+                out.resize(start + result);
+                started = true;
+            }
+
+            while (size > 0)
+            {
+                // bounds the output of one call
+                size_t part = std::min(size, size_t(64 << 10));
+                size_t start = out.size();
+                size_t bound = LZ4F_compressBound(part, &preferences);
+                out.resize(start + bound);
+
+                size_t result = LZ4F_compressUpdate(context, &out[start], bound, data, part, nullptr);
+                if (LZ4F_isError(result))
+                {
+                    out.resize(start);
+                    return false;
+                }
+                out.resize(start + result);
+
+                data += part;
+                size -= part;
+            }
+            return true;
+        }
+
+        bool endFrame(std::string &out) override
+        {
+            if (!started)
+                return true;
+
+            size_t start = out.size();
+            size_t bound = LZ4F_compressBound(0, &preferences);
+            out.resize(start + bound);
+
+            size_t result = LZ4F_compressEnd(context, &out[start], bound, nullptr);
+            started = false;
+            if (LZ4F_isError(result))
+            {
+                out.resize(start);
+                return false;
+            }
+            out.resize(start + result);
+            return true;
+        }
+
+    private:
+        LZ4F_cctx *context = nullptr;
+        LZ4F_preferences_t preferences;
+        bool started = false;
+    };
+#endif
+
+#ifdef LOGGER_HAS_ZLIB
+    //! Every frame is a gzip member, concatenated members are one gzip file.
+    class GzipCodec : public Codec
+    {
+    public:
+        explicit GzipCodec(int level)
+        {
+            memset(&stream, 0, sizeof(stream));
+            initialized = deflateInit2(&stream, level != 0 ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                                       15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        }
+
+        ~GzipCodec() override
+        {
+            if (initialized)
+                deflateEnd(&stream);
+        }
+
+        bool valid() const
+        {
+            return initialized;
+        }
+
+        bool compress(const char *data, size_t size, std::string &out) override
+        {
+            stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+            stream.avail_in = uInt(size);
+
+            while (stream.avail_in > 0)
+            {
+                if (!step(Z_NO_FLUSH, out))
+                    return false;
+            }
+            return true;
+        }
+
+        bool endFrame(std::string &out) override
+        {
+            stream.next_in = nullptr;
+            stream.avail_in = 0;
+
+            int result;
+            do
+            {
+                result = deflate(prepare(out), Z_FINISH);
+                finish(out);
+            }
+            while (result == Z_OK || result == Z_BUF_ERROR);
+
+            // the next member starts with a new gzip header
+            deflateReset(&stream);
+            return result == Z_STREAM_END;
+        }
+
+    private:
+        static const size_t chunkSize = 64 << 10;
+
+        z_stream *prepare(std::string &out)
+        {
+            start = out.size();
+            out.resize(start + chunkSize);
+            stream.next_out = reinterpret_cast<Bytef *>(&out[start]);
+            stream.avail_out = uInt(chunkSize);
+            return &stream;
+        }
+
+        void finish(std::string &out)
+        {
+            out.resize(start + chunkSize - stream.avail_out);
+        }
+
+        bool step(int flush, std::string &out)
+        {
+            int result = deflate(prepare(out), flush);
+            finish(out);
+            return result == Z_OK || result == Z_BUF_ERROR;
+        }
+
+        z_stream stream;
+        size_t start = 0;
+        bool initialized = false;
+    };
+#endif
+
+    std::unique_ptr<Codec> createCodec(LoggerStream::SinkKind kind, [[maybe_unused]] int level)
+    {
+        switch (kind)
+        {
+#ifdef LOGGER_HAS_ZSTD
+        case LoggerStream::ZstdSink:
+        {
+            auto codec = std::make_unique<ZstdCodec>(level);
+            if (codec->valid())
+                return codec;
+            break;
+        }
+#endif
+#ifdef LOGGER_HAS_LZ4
+        case LoggerStream::Lz4Sink:
+        {
+            auto codec = std::make_unique<Lz4Codec>(level);
+            if (codec->valid())
+                return codec;
+            break;
+        }
+#endif
+#ifdef LOGGER_HAS_ZLIB
+        case LoggerStream::GzipSink:
+        {
+            auto codec = std::make_unique<GzipCodec>(level);
+            if (codec->valid())
+                return codec;
+            break;
+        }
+#endif
+        default:
+            errno = ENOTSUP;
+            return nullptr;
+        }
+
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    //! File compressed by the own thread. Writers append records to a buffer, the thread
+    //! takes the buffer when it reaches the chunk size or periodically.
+    class CompressedFile : public LoggerFile
+    {
+    public:
+        CompressedFile(int fd, std::unique_ptr<Codec> codec)
+            : fd(fd)
+            , codec(std::move(codec))
+            , frameSize(compressionFrameSize.load(std::memory_order_relaxed))
+            , frameInterval(compressionFrameInterval.load(std::memory_order_relaxed))
+        {
+            struct stat st;
+            if (fstat(fd, &st) == 0)
+                size = size_t(st.st_size);
+
+            thread = std::thread(&CompressedFile::run, this);
+        }
+
+        ~CompressedFile() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeCondition.notify_one();
+            thread.join();
+
+            ::close(fd);
+        }
+
+        void writeRecord(const char *s, std::size_t length) override
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            reserve(lock, length + 1);
+            pending.append(s, length);
+            pending += '\n';
+            notify();
+        }
+
+        void writeBatch(const char *data, std::size_t length) override
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            reserve(lock, length);
+            pending.append(data, length);
+            notify();
+        }
+
+        void writeFromSignal(const char *data, std::size_t length) override
+        {
+            // compressing is not async-signal-safe, the records go to stderr
+            while (length > 0)
+            {
+                ssize_t written = ::write(STDERR_FILENO, data, length);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    return;
+                }
+                data += written;
+                length -= size_t(written);
+            }
+        }
+
+        void sync() override
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            // the writer thread of the asynchronous mode syncs after every batch,
+            // frames are finished by size and time only
+            if (LoggerFile::isDeferred())
+            {
+                if (!pending.empty())
+                    wakeCondition.notify_one();
+                return;
+            }
+
+            uint64_t request = ++flushRequested;
+            wakeCondition.notify_one();
+            doneCondition.wait(lock, [&] { return flushed >= request; });
+        }
+
+        std::size_t initialSize() const override
+        {
+            return size;
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        // the thread is woken when so many bytes are pending
+        static const size_t chunkSize = 256 << 10;
+        // writers wait for the thread when so many bytes are pending
+        static const size_t maxPending = 64 << 20;
+
+        //! Waits while the pending buffer is full.
+        void reserve(std::unique_lock<std::mutex> &lock, size_t length)
+        {
+            if (pending.size() + length > maxPending && pending.size() > 0)
+            {
+                wakeCondition.notify_one();
+                doneCondition.wait(lock, [&] { return pending.size() + length <= maxPending || pending.empty(); });
+            }
+        }
+
+        //! Must be called under the mutex.
+        void notify()
+        {
+            if (pending.size() >= chunkSize && !woken)
+            {
+                woken = true;
+                wakeCondition.notify_one();
+            }
+        }
+
+        void run();
+        void writeAll(const std::string &data);
+
+        int fd;
+        std::unique_ptr<Codec> codec;
+        size_t frameSize;
+        unsigned frameInterval;
+        size_t size = 0;
+
+        std::mutex mutex;
+        std::condition_variable wakeCondition;
+        std::condition_variable doneCondition;
+        std::string pending;
+        uint64_t flushRequested = 0;
+        uint64_t flushed = 0;
+        bool woken = false;
+        bool stopping = false;
+        std::thread thread;
+    };
+
+    void CompressedFile::run()
+    {
+        std::string input;
+        std::string output;
+        size_t frameInput = 0;
+        Clock::time_point frameStart;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            // an open frame is finished when its interval expires
+            auto timeout = frameInput > 0
+                ? frameStart + std::chrono::milliseconds(frameInterval) - Clock::now()
+                : std::chrono::milliseconds(frameInterval);
+            if (pending.size() < chunkSize && flushRequested == flushed && !stopping && timeout.count() > 0)
+                wakeCondition.wait_for(lock, timeout);
+
+            woken = false;
+            input.swap(pending);
+            uint64_t request = flushRequested;
+            bool flushing = request != flushed;
+            bool stop = stopping;
+            lock.unlock();
+
+            // writers waiting for space continue
+            doneCondition.notify_all();
+
+            if (!input.empty())
+            {
+                if (frameInput == 0)
+                    frameStart = Clock::now();
+                codec->compress(input.data(), input.size(), output);
+                frameInput += input.size();
+                input.clear();
+            }
+
+            bool finish = frameInput > 0 &&
+                          (stop || flushing || frameInput >= frameSize ||
+                           Clock::now() - frameStart >= std::chrono::milliseconds(frameInterval));
+            if (finish)
+            {
+                codec->endFrame(output);
+                frameInput = 0;
+            }
+
+            if (!output.empty())
+            {
+                writeAll(output);
+                output.clear();
+            }
+
+            lock.lock();
+            if (request > flushed)
+            {
+                flushed = request;
+                doneCondition.notify_all();
+            }
+
+            if (stop && pending.empty())
+                break;
+        }
+    }
+
+    void CompressedFile::writeAll(const std::string &data)
+    {
+        const char *p = data.data();
+        size_t length = data.size();
+
+        while (length > 0)
+        {
+            ssize_t written = ::write(fd, p, length);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                fprintf(stderr, "cannot write compressed log: %s\n", strerror(errno));
+                return;
+            }
+            p += written;
+            length -= size_t(written);
+        }
+    }
+}
+
+LoggerFile *LoggerCompress::open(const std::string &fileName, LoggerStream::SinkKind kind)
+{
+    std::unique_ptr<Codec> codec = createCodec(kind, compressionLevel.load(std::memory_order_relaxed));
+    if (!codec)
+        return nullptr;
+
+    int fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return nullptr;
+
+    return new CompressedFile(fd, std::move(codec));
+}
+
+void LoggerCompress::configure(int level, std::size_t frameSize, unsigned frameInterval)
+{
+    compressionLevel.store(level, std::memory_order_relaxed);
+    compressionFrameSize.store(frameSize != 0 ? frameSize : 1, std::memory_order_relaxed);
+    compressionFrameInterval.store(frameInterval != 0 ? frameInterval : 1, std::memory_order_relaxed);
+}
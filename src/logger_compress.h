@@ -0,0 +1,24 @@
+#pragma once
+
+#include "logger_file.h"
+
+#include <string>
+#include <cstddef>
+
+/*!
+ * Compressed log files. Writers only append records to a buffer of the file, records
+ * are compressed and written by a thread of the file. The stream is split into
+ * independent frames, so a crash loses at most the frame being compressed. Frames
+ * of reopened files are appended, concatenated frames are one valid stream.
+ */
+class LoggerCompress
+{
+public:
+    //! Sets the compression level (0 selects the default of the codec), the input size and
+    //! the time in milliseconds after which a frame is finished. Applies to files opened later.
+    static void configure(int level, std::size_t frameSize, unsigned frameInterval);
+
+    //! Opens the file \a fileName compressed by the codec of \a kind for appending.
+    //! Returns nullptr and sets errno on error, ENOTSUP if the codec is not built in.
+    static LoggerFile *open(const std::string &fileName, LoggerStream::SinkKind kind);
+};
@@ -0,0 +1,252 @@
+
+#include "logger_degrade.h"
+#include "logger_stats.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace
+{
+    std::atomic<uint64_t> latencyLimit {0};
+    std::atomic<unsigned> queueLimit {0};
+    std::atomic<uint64_t> interval {0};
+    std::atomic<unsigned> recovery {1};
+    std::atomic<unsigned> sampleRate {1};
+    std::atomic<LoggerStream::DegradeMode> maxMode {LoggerStream::ErrorMode};
+
+    //! End of the current interval in steady clock nanoseconds
+    std::atomic<uint64_t> intervalEnd {0};
+    //! Longest write finished in the interval
+    std::atomic<uint64_t> maxLatency {0};
+    //! Highest queue fill in the interval
+    std::atomic<unsigned> maxQueue {0};
+    //! Writes in progress and the time of the last started or finished one,
+    //! a write stalled for longer than the limit overloads the interval before it ends
+    std::atomic<unsigned> writing {0};
+    std::atomic<uint64_t> progress {0};
+
+    // guards the interval check
+    std::mutex updateMutex;
+    unsigned calmIntervals = 0;
+    uint64_t droppedBefore = 0;
+    //! Multiplies the recovery, doubled by a step up after a step back so a storm
+    //! outlasting the recovery doesn't flap between the steps
+    unsigned recoveryScale = 1;
+    const unsigned maxRecoveryScale = 64;
+    bool steppedBack = false;
+
+    //! Set while the transition is written, the record is never dropped.
+    thread_local bool reporting = false;
+    thread_local unsigned sampleCount = 0;
+
+    template<typename T>
+    void storeMax(std::atomic<T> &value, T candidate)
+    {
+        T current = value.load(std::memory_order_relaxed);
+        while (candidate > current &&
+               !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    const char *modeName(LoggerStream::DegradeMode mode)
+    {
+        switch (mode)
+        {
+        case LoggerStream::NormalMode:
+            return "normal";
+        case LoggerStream::SampleMode:
+            return "sample";
+        case LoggerStream::WarningMode:
+            return "warning";
+        case LoggerStream::ErrorMode:
+            return "error";
+        }
+        return "unknown";
+    }
+
+    uint64_t droppedCount()
+    {
+        LoggerStream::Stats stats;
+        LoggerStats::collect(stats);
+        return stats.degraded;
+    }
+}
+
+std::atomic<bool> LoggerDegrade::active {false};
+std::atomic<LoggerStream::DegradeMode> LoggerDegrade::currentMode {LoggerStream::NormalMode};
+
+void LoggerDegrade::configure(const LoggerStream::DegradeOptions &options)
+{
+    std::lock_guard<std::mutex> lock(updateMutex);
+
+    uint64_t ns = uint64_t(std::chrono::nanoseconds(options.interval).count());
+    latencyLimit.store(uint64_t(std::chrono::nanoseconds(options.latency).count()), std::memory_order_relaxed);
+    queueLimit.store(std::min(std::max(options.queuePercent, 1u), 100u), std::memory_order_relaxed);
+    interval.store(std::max(ns, uint64_t(1000000)), std::memory_order_relaxed);
+    recovery.store(std::max(options.recovery, 1u), std::memory_order_relaxed);
+    sampleRate.store(std::max(options.sampleRate, 1u), std::memory_order_relaxed);
+    maxMode.store(std::max(options.maxMode, LoggerStream::SampleMode), std::memory_order_relaxed);
+
+    maxLatency.store(0, std::memory_order_relaxed);
+    maxQueue.store(0, std::memory_order_relaxed);
+    intervalEnd.store(LoggerStats::now() + interval.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    calmIntervals = 0;
+    droppedBefore = droppedCount();
+    recoveryScale = 1;
+    steppedBack = false;
+
+    active.store(true, std::memory_order_relaxed);
+}
+
+void LoggerDegrade::disable()
+{
+    std::lock_guard<std::mutex> lock(updateMutex);
+
+    active.store(false, std::memory_order_relaxed);
+    currentMode.store(LoggerStream::NormalMode, std::memory_order_relaxed);
+}
+
+bool LoggerDegrade::allow(LoggerStream::Level level)
+{
+    if (level >= LoggerStream::Error || reporting)
+        return true;
+
+    // the only check while records are dropped, the step back depends on it
+    update(LoggerStats::now());
+
+    switch (mode())
+    {
+    case LoggerStream::NormalMode:
+        return true;
+    case LoggerStream::SampleMode:
+        if (level >= LoggerStream::Warning || ++sampleCount % sampleRate.load(std::memory_order_relaxed) == 0)
+            return true;
+        break;
+    case LoggerStream::WarningMode:
+        if (level >= LoggerStream::Warning)
+            return true;
+        break;
+    case LoggerStream::ErrorMode:
+        break;
+    }
+
+    LoggerStats::add(LoggerStats::Degraded);
+    return false;
+}
+
+uint64_t LoggerDegrade::beginWrite()
+{
+    uint64_t now = LoggerStats::now();
+    if (writing.fetch_add(1, std::memory_order_relaxed) == 0)
+        progress.store(now, std::memory_order_relaxed);
+
+    update(now);
+    return now;
+}
+
+void LoggerDegrade::endWrite(uint64_t start)
+{
+    uint64_t now = LoggerStats::now();
+    storeMax(maxLatency, now > start ? now - start : 0);
+    progress.store(now, std::memory_order_relaxed);
+    writing.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void LoggerDegrade::queueFill(unsigned percent)
+{
+    storeMax(maxQueue, percent);
+    if (percent >= queueLimit.load(std::memory_order_relaxed))
+        update(LoggerStats::now());
+}
+
+void LoggerDegrade::update(uint64_t now)
+{
+    if (now < intervalEnd.load(std::memory_order_relaxed) || reporting || !enabled())
+        return;
+
+    std::unique_lock<std::mutex> lock(updateMutex, std::try_to_lock);
+    uint64_t end = intervalEnd.load(std::memory_order_relaxed);
+    if (!lock.owns_lock() || now < end || !enabled())
+        return;
+
+    // intervals without records are calm, also when all records are dropped by the step,
+    // the recovery backs off instead
+    uint64_t length = interval.load(std::memory_order_relaxed);
+    uint64_t elapsed = 1 + (now - end) / length;
+    intervalEnd.store(end + elapsed * length, std::memory_order_relaxed);
+
+    uint64_t latency = maxLatency.exchange(0, std::memory_order_relaxed);
+    unsigned queue = maxQueue.exchange(0, std::memory_order_relaxed);
+    uint64_t last = progress.load(std::memory_order_relaxed);
+    if (writing.load(std::memory_order_relaxed) > 0 && now > last)
+        latency = std::max(latency, now - last);
+
+    uint64_t latencyMax = latencyLimit.load(std::memory_order_relaxed);
+    unsigned queueMax = queueLimit.load(std::memory_order_relaxed);
+    LoggerStream::DegradeMode previous = mode();
+    LoggerStream::DegradeMode next = previous;
+
+    uint64_t required = uint64_t(recovery.load(std::memory_order_relaxed)) * recoveryScale;
+
+    if (latency >= latencyMax || queue >= queueMax)
+    {
+        calmIntervals = 0;
+        next = std::min(LoggerStream::DegradeMode(previous + 1), maxMode.load(std::memory_order_relaxed));
+        if (next != previous && steppedBack)
+        {
+            recoveryScale = std::min(recoveryScale * 2, maxRecoveryScale);
+            steppedBack = false;
+        }
+    }
+    else if (latency < latencyMax / 2 && queue < queueMax / 2)
+    {
+        calmIntervals += unsigned(std::min(elapsed, uint64_t(1000000)));
+        if (previous == LoggerStream::NormalMode)
+        {
+            // the backoff is forgotten after as long a calm in NormalMode
+            if (calmIntervals >= required)
+            {
+                calmIntervals = 0;
+                recoveryScale = 1;
+                steppedBack = false;
+            }
+        }
+        else if (calmIntervals >= required)
+        {
+            uint64_t steps = calmIntervals / required;
+            calmIntervals = 0;
+            steppedBack = true;
+            next = LoggerStream::DegradeMode(int(previous) - int(std::min(steps, uint64_t(previous))));
+        }
+    }
+    else
+    {
+        // between the thresholds the step is kept
+        calmIntervals = 0;
+    }
+
+    if (next == previous)
+        return;
+
+    currentMode.store(next, std::memory_order_relaxed);
+    LoggerStats::add(LoggerStats::DegradeTransitions);
+
+    uint64_t dropped = droppedCount();
+    uint64_t droppedSince = dropped - droppedBefore;
+    droppedBefore = dropped;
+    lock.unlock();
+
+    reporting = true;
+    if (next > previous)
+    {
+        LoggerStream(LoggerStream::Warning).format("logger degraded to {} mode: write latency {} ms, queue {}%, {} records dropped",
+                                                   modeName(next), latency / 1000000, queue, droppedSince);
+    }
+    else
+    {
+        LoggerStream(LoggerStream::Warning).format("logger recovered to {} mode: {} records dropped",
+                                                   modeName(next), droppedSince);
+    }
+    reporting = false;
+}
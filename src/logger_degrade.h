@@ -0,0 +1,51 @@
+#pragma once
+
+#include "logger.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*!
+ * Degradation of logging while the outputs can't keep up.
+ *
+ * Writers report the time of writing records and producers the fill of their asynchronous
+ * queues. Pressure is checked once per interval by the first thread passing the end of the
+ * interval: an overloaded interval takes one step up, calm intervals step back. Records below
+ * Error are dropped by steps before they are formatted.
+ */
+class LoggerDegrade
+{
+public:
+    static void configure(const LoggerStream::DegradeOptions &options);
+    //! Stops watching and returns to NormalMode.
+    static void disable();
+
+    static bool enabled()
+    {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    static LoggerStream::DegradeMode mode()
+    {
+        return currentMode.load(std::memory_order_relaxed);
+    }
+
+    //! Returns false if a record of \a level is dropped by the current step and counts it.
+    static bool allow(LoggerStream::Level level);
+
+    //! Called before writing a record to the outputs, returns the start time.
+    static uint64_t beginWrite();
+    //! Called after writing a record started at \a start.
+    static void endWrite(uint64_t start);
+
+    //! Reports the fill of the asynchronous queue of the calling thread in percent.
+    static void queueFill(unsigned percent);
+
+private:
+    //! Finishes the interval if it ended before \a now and takes a step.
+    static void update(uint64_t now);
+
+    static std::atomic<bool> active;
+    static std::atomic<LoggerStream::DegradeMode> currentMode;
+};
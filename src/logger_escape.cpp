@@ -0,0 +1,172 @@
+
+#include "logger_escape.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    const char hexDigits[] = "0123456789abcdef";
+
+    inline bool isSpecial(unsigned char c)
+    {
+        return c < 0x20 || c == '"' || c == '\\';
+    }
+
+    void escapeChar(std::string &out, unsigned char c)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        case '\b':
+            out += "\\b";
+            break;
+        case '\f':
+            out += "\\f";
+            break;
+        default:
+        {
+            char code[6] = {'\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 15]};
+            out.append(code, sizeof(code));
+            break;
+        }
+        }
+    }
+
+    //! Scanners return the first special character in [p, end) or end.
+    typedef const char *(*FindSpecial)(const char *p, const char *end);
+
+    const char *findSpecialScalar(const char *p, const char *end)
+    {
+        while (p < end && !isSpecial(static_cast<unsigned char>(*p)))
+            ++p;
+        return p;
+    }
+
+#if defined(__SSE2__)
+    const char *findSpecialSse2(const char *p, const char *end)
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control = _mm_set1_epi8(0x1f);
+
+        for (; end - p >= 16; p += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            // unsigned v <= 0x1f
+            __m128i isControl = _mm_cmpeq_epi8(_mm_min_epu8(v, control), v);
+            __m128i mask = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                        isControl);
+            unsigned bits = unsigned(_mm_movemask_epi8(mask));
+            if (bits != 0)
+                return p + __builtin_ctz(bits);
+        }
+        return findSpecialScalar(p, end);
+    }
+
+    __attribute__((target("avx2")))
+    const char *findSpecialAvx2(const char *p, const char *end)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i control = _mm256_set1_epi8(0x1f);
+
+        for (; end - p >= 32; p += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            __m256i isControl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, control), v);
+            __m256i mask = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                                           _mm256_cmpeq_epi8(v, backslash)),
+                                           isControl);
+            unsigned bits = unsigned(_mm256_movemask_epi8(mask));
+            if (bits != 0)
+                return p + __builtin_ctz(bits);
+        }
+        return findSpecialSse2(p, end);
+    }
+#endif
+
+#if defined(__ARM_NEON)
+    const char *findSpecialNeon(const char *p, const char *end)
+    {
+        const uint8x16_t quote = vdupq_n_u8('"');
+        const uint8x16_t backslash = vdupq_n_u8('\\');
+        const uint8x16_t control = vdupq_n_u8(0x20);
+
+        for (; end - p >= 16; p += 16)
+        {
+            uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+            uint8x16_t mask = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+                                       vcltq_u8(v, control));
+            // 4 bits for every byte
+            uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(mask), 4)), 0);
+            if (bits != 0)
+                return p + (__builtin_ctzll(bits) >> 2);
+        }
+        return findSpecialScalar(p, end);
+    }
+#endif
+
+    FindSpecial selectFindSpecial()
+    {
+#if defined(__SSE2__)
+        if (__builtin_cpu_supports("avx2"))
+            return &findSpecialAvx2;
+        return &findSpecialSse2;
+#elif defined(__ARM_NEON)
+        return &findSpecialNeon;
+#else
+        return &findSpecialScalar;
+#endif
+    }
+
+    const char *findSpecial(const char *p, const char *end)
+    {
+        // selected on the first use, records may be written by constructors of static objects
+        static const FindSpecial find = selectFindSpecial();
+        return find(p, end);
+    }
+}
+
+void appendEscaped(std::string &out, std::string_view s)
+{
+    const char *p = s.data();
+    const char *end = p + s.size();
+
+    out.reserve(out.size() + s.size());
+
+    // clean runs are copied in bulk, only special characters are handled one by one
+    for (;;)
+    {
+        const char *special = findSpecial(p, end);
+        out.append(p, special);
+        if (special == end)
+            break;
+
+        escapeChar(out, static_cast<unsigned char>(*special));
+        p = special + 1;
+    }
+}
+
+bool needsEscaping(std::string_view s)
+{
+    const char *end = s.data() + s.size();
+    return findSpecial(s.data(), end) != end;
+}
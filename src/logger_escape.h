@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/*!
+ * Escaping of quoted strings. Quotes, backslashes and control characters are escaped
+ * as in JSON, other bytes including UTF-8 sequences are copied as is.
+ */
+
+//! Appends escaped \a s to \a out.
+void appendEscaped(std::string &out, std::string_view s);
+
+//! Returns true if \a s has characters to escape.
+bool needsEscaping(std::string_view s);
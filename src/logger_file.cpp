@@ -0,0 +1,935 @@
+
+#include "logger_file.h"
+#include "logger_compress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <errno.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace
+{
+    thread_local bool deferWrites = false;
+
+    typedef std::atomic<uint64_t> FileEnd;
+
+    //! Ends of files written by io_uring. Shared by files opened on the same inode,
+    //! the writes of a retired file may be in flight when it is opened again.
+    std::mutex fileEndsMutex;
+    std::map<std::pair<dev_t, ino_t>, std::weak_ptr<FileEnd>> fileEnds;
+
+    std::shared_ptr<FileEnd> fileEnd(const struct stat &st)
+    {
+        std::lock_guard<std::mutex> lock(fileEndsMutex);
+
+        for (auto it = fileEnds.begin(); it != fileEnds.end();)
+        {
+            if (it->second.expired())
+                it = fileEnds.erase(it);
+            else
+                ++it;
+        }
+
+        std::weak_ptr<FileEnd> &entry = fileEnds[std::make_pair(st.st_dev, st.st_ino)];
+        std::shared_ptr<FileEnd> end = entry.lock();
+        if (!end)
+        {
+            end = std::make_shared<FileEnd>(uint64_t(st.st_size));
+            entry = end;
+        }
+        return end;
+    }
+
+    //! Writes all of \a data at the end of the descriptor, or at \a offset if it isn't negative.
+    void writeDescriptor(int fd, const char *data, size_t length, off_t offset = -1)
+    {
+        while (length > 0)
+        {
+            ssize_t written = offset < 0 ? ::write(fd, data, length) : ::pwrite(fd, data, length, offset);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+
+            data += written;
+            length -= size_t(written);
+            if (offset >= 0)
+                offset += written;
+        }
+    }
+
+    //! File written through stdio, each call is locked by stdio.
+    class StdioFile : public LoggerFile
+    {
+    public:
+        explicit StdioFile(FILE *file, bool owned = true)
+            : file(file)
+            , owned(owned)
+        {
+            struct stat st;
+            if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode))
+                size = size_t(st.st_size);
+        }
+
+        ~StdioFile() override
+        {
+            if (owned)
+                fclose(file);
+        }
+
+        void writeRecord(const char *s, std::size_t length) override
+        {
+            // one call keeps the line atomic
+            fprintf(file, "%.*s\n", int(length), s);
+            fflush(file);
+        }
+
+        void writeBatch(const char *data, std::size_t length) override
+        {
+            fwrite(data, 1, length, file);
+            fflush(file);
+        }
+
+        void writeParts(const LoggerStream::Bytes *parts, std::size_t count) override
+        {
+            // the lock keeps the line atomic, large parts bypass the stdio buffer
+            flockfile(file);
+            for (std::size_t i = 0; i < count; ++i)
+                fwrite_unlocked(parts[i].data, 1, parts[i].size, file);
+            fputc_unlocked('\n', file);
+            fflush_unlocked(file);
+            funlockfile(file);
+        }
+
+        void writeFromSignal(const char *data, std::size_t length) override
+        {
+            // records are flushed after every write, the stdio buffer is empty
+            writeDescriptor(fileno(file), data, length);
+        }
+
+        std::size_t initialSize() const override
+        {
+            return size;
+        }
+
+    private:
+        FILE *file;
+        bool owned;
+        std::size_t size = 0;
+    };
+
+    //! File opened with O_APPEND and written by whole records, bypasses stdio.
+    //! Every record or batch is one write(2), so appends stay line-atomic
+    //! even if several processes share the file.
+    class AppendFile : public LoggerFile
+    {
+    public:
+        explicit AppendFile(int fd)
+            : fd(fd)
+        {
+            struct stat st;
+            if (fstat(fd, &st) == 0)
+                size = size_t(st.st_size);
+        }
+
+        ~AppendFile() override
+        {
+            ::close(fd);
+        }
+
+        void writeRecord(const char *s, std::size_t length) override
+        {
+            iovec iov[2];
+            iov[0].iov_base = const_cast<char *>(s);
+            iov[0].iov_len = length;
+            iov[1].iov_base = const_cast<char *>("\n");
+            iov[1].iov_len = 1;
+
+            writeAll(iov, 2);
+        }
+
+        void writeBatch(const char *data, std::size_t length) override
+        {
+            iovec iov;
+            iov.iov_base = const_cast<char *>(data);
+            iov.iov_len = length;
+
+            writeAll(&iov, 1);
+        }
+
+        void writeParts(const LoggerStream::Bytes *parts, std::size_t count) override
+        {
+            // one writev(2) keeps the line atomic
+            if (count >= IOV_MAX)
+            {
+                LoggerFile::writeParts(parts, count);
+                return;
+            }
+
+            iovec local[16];
+            std::vector<iovec> allocated;
+            iovec *iov = local;
+            if (count + 1 > sizeof(local) / sizeof(local[0]))
+            {
+                allocated.resize(count + 1);
+                iov = allocated.data();
+            }
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                iov[i].iov_base = const_cast<char *>(parts[i].data);
+                iov[i].iov_len = parts[i].size;
+            }
+            iov[count].iov_base = const_cast<char *>("\n");
+            iov[count].iov_len = 1;
+
+            writeAll(iov, int(count + 1));
+        }
+
+        void writeFromSignal(const char *data, std::size_t length) override
+        {
+            writeDescriptor(fd, data, length);
+        }
+
+        std::size_t initialSize() const override
+        {
+            return size;
+        }
+
+    private:
+        void writeAll(iovec *iov, int count)
+        {
+            while (count > 0)
+            {
+                ssize_t written = ::writev(fd, iov, count);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    return;
+                }
+
+                // a short write is possible only on a full disk or a signal
+                while (count > 0 && size_t(written) >= iov->iov_len)
+                {
+                    written -= iov->iov_len;
+                    ++iov;
+                    --count;
+                }
+                if (count > 0)
+                {
+                    iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+                    iov->iov_len -= written;
+                }
+            }
+        }
+
+        int fd;
+        std::size_t size = 0;
+    };
+
+    //! Memory mapped file. The file is extended by fallocate in chunks, every chunk
+    //! is mapped once and stays mapped until the file is closed. Writers reserve space
+    //! by an atomic fetch_add and copy records into the mapping without syscalls.
+    //! The file is truncated to the written length when it is closed.
+    class MappedFile : public LoggerFile
+    {
+    public:
+        static MappedFile *open(const std::string &fileName);
+
+        ~MappedFile() override
+        {
+            size_t length = position.load();
+            for (std::atomic<char *> &chunk : chunks)
+            {
+                if (char *p = chunk.load())
+                    munmap(p, chunkSize);
+            }
+            if (ftruncate(fd, off_t(length)) != 0)
+            {
+                // the tail stays filled by zeroes
+            }
+            ::close(fd);
+        }
+
+        void writeRecord(const char *s, std::size_t length) override
+        {
+            LoggerStream::Bytes part{s, length};
+            writeParts(&part, 1);
+        }
+
+        void writeBatch(const char *data, std::size_t length) override
+        {
+            size_t offset = position.fetch_add(length, std::memory_order_relaxed);
+            if (!copy(offset, data, length))
+            {
+                fwrite(data, 1, length, stderr);
+                fill(offset, length);
+            }
+        }
+
+        void writeParts(const LoggerStream::Bytes *parts, std::size_t count) override
+        {
+            size_t length = 1;
+            for (std::size_t i = 0; i < count; ++i)
+                length += parts[i].size;
+
+            size_t offset = position.fetch_add(length, std::memory_order_relaxed);
+            size_t end = offset;
+            bool copied = true;
+            for (std::size_t i = 0; i < count && copied; ++i)
+            {
+                copied = copy(end, parts[i].data, parts[i].size);
+                end += parts[i].size;
+            }
+            if (copied && copy(end, "\n", 1))
+                return;
+
+            // no space for the file, the whole record goes to stderr
+            for (std::size_t i = 0; i < count; ++i)
+                fwrite(parts[i].data, 1, parts[i].size, stderr);
+            fputc('\n', stderr);
+            fill(offset, length);
+        }
+
+        void writeFromSignal(const char *data, std::size_t length) override
+        {
+            size_t offset = position.fetch_add(length, std::memory_order_relaxed);
+            size_t index = offset / chunkSize;
+            char *p = index < maxChunks && index == (offset + length - 1) / chunkSize
+                ? chunks[index].load(std::memory_order_acquire)
+                : nullptr;
+
+            // mapping a new chunk is not async-signal-safe
+            if (p)
+                memcpy(p + offset % chunkSize, data, length);
+            else
+                writeDescriptor(fd, data, length, off_t(offset));
+        }
+
+        std::size_t initialSize() const override
+        {
+            return size;
+        }
+
+    private:
+        // 64 MiB, a multiple of the page size
+        static const size_t chunkSize = 64 << 20;
+        // 1 TiB per file
+        static const size_t maxChunks = 16384;
+
+        explicit MappedFile(int fd, size_t size)
+            : fd(fd)
+            , size(size)
+            , position(size)
+        {
+        }
+
+        char *chunk(size_t index);
+        bool copy(size_t offset, const char *data, size_t length);
+        void fill(size_t offset, size_t length);
+
+        int fd;
+        size_t size;
+        std::atomic<size_t> position;
+        std::mutex mapMutex;
+        std::atomic<char *> chunks[maxChunks] = {};
+    };
+
+    //! File written by io_uring. Records are copied into registered buffers, a full buffer
+    //! is submitted at its own offset of the file, so several writes run in parallel and
+    //! the writer waits only when all buffers are in flight. Records of a thread deferring
+    //! writes are submitted by sync(), other threads wait until their records are written.
+    class UringFile : public LoggerFile
+    {
+    public:
+        //! Takes \a fd on success, returns nullptr if io_uring is not available.
+        static UringFile *create(int fd);
+
+        ~UringFile() override;
+
+        void writeRecord(const char *s, std::size_t length) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            append(s, length);
+            append("\n", 1);
+            commit();
+        }
+
+        void writeBatch(const char *data, std::size_t length) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            append(data, length);
+            commit();
+        }
+
+        void writeFromSignal(const char *data, std::size_t length) override
+        {
+            // the buffers are guarded by the mutex, the records are written around them
+            writeDescriptor(fd, data, length, off_t(end->fetch_add(length, std::memory_order_relaxed)));
+        }
+
+        void sync() override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            submitCurrent();
+            if (deferWrites)
+                reap();
+            else
+                waitAll();
+        }
+
+        std::size_t initialSize() const override
+        {
+            return size;
+        }
+
+    private:
+        static const unsigned bufferCount = 8;
+        static const size_t bufferSize = 256 << 10;
+
+        struct Buffer
+        {
+            char *data = nullptr;
+            size_t used = 0;        //!< Bytes copied to the buffer
+            size_t written = 0;     //!< Bytes written to the file
+            uint64_t offset = 0;    //!< Offset of the buffer in the file
+            bool busy = false;      //!< Filled or in flight
+        };
+
+        UringFile(int fd, size_t size, std::shared_ptr<FileEnd> end)
+            : fd(fd)
+            , size(size)
+            , end(std::move(end))
+        {
+        }
+
+        //! Creates the rings and registers buffers.
+        bool setup();
+
+        void append(const char *data, size_t length);
+
+        void commit()
+        {
+            if (!deferWrites)
+            {
+                submitCurrent();
+                waitAll();
+            }
+        }
+
+        //! Returns a free buffer, waits for a completion if all buffers are busy.
+        int acquire();
+        void submitCurrent();
+        //! Queues the write of the rest of the buffer \a index.
+        void submit(unsigned index);
+        void complete(unsigned index, int result);
+        //! Writes the rest of the buffer \a index by pwrite and retires it.
+        void writeDirect(unsigned index);
+        //! Processes completed writes, returns false if there were none.
+        bool reap();
+        void waitCompletion();
+
+        void waitAll()
+        {
+            while (inFlight > 0)
+                waitCompletion();
+        }
+
+        int fd;
+        size_t size;
+        std::shared_ptr<FileEnd> end;
+
+        std::mutex mutex;
+        Buffer buffers[bufferCount];
+        int current = -1;
+        unsigned inFlight = 0;
+        bool broken = false;    //!< The ring failed, buffers are written by pwrite
+        char *memory = nullptr;
+
+        // rings shared with the kernel
+        int ringFd = -1;
+        void *sqRing = nullptr;
+        void *cqRing = nullptr;
+        size_t sqRingSize = 0;
+        size_t cqRingSize = 0;
+        io_uring_sqe *sqes = nullptr;
+        size_t sqesSize = 0;
+        unsigned *sqTail = nullptr;
+        unsigned *sqMask = nullptr;
+        unsigned *sqArray = nullptr;
+        unsigned *cqHead = nullptr;
+        unsigned *cqTail = nullptr;
+        unsigned *cqMask = nullptr;
+        io_uring_cqe *cqes = nullptr;
+    };
+}
+
+MappedFile *MappedFile::open(const std::string &fileName)
+{
+    int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return nullptr;
+    }
+
+    // a crashed process leaves the preallocated tail filled by zeroes
+    size_t size = size_t(st.st_size);
+    char block[4096];
+    while (size > 0)
+    {
+        size_t length = size < sizeof(block) ? size : sizeof(block);
+        if (pread(fd, block, length, off_t(size - length)) != ssize_t(length))
+            break;
+
+        size_t end = length;
+        while (end > 0 && block[end - 1] == 0)
+            --end;
+
+        size -= length - end;
+        if (end > 0)
+            break;
+    }
+
+    return new MappedFile(fd, size);
+}
+
+char *MappedFile::chunk(size_t index)
+{
+    if (index >= maxChunks)
+        return nullptr;
+
+    char *p = chunks[index].load(std::memory_order_acquire);
+    if (p)
+        return p;
+
+    std::lock_guard<std::mutex> lock(mapMutex);
+
+    p = chunks[index].load(std::memory_order_relaxed);
+    if (!p)
+    {
+        off_t offset = off_t(index * chunkSize);
+
+        // allocated blocks guarantee no SIGBUS on a full disk
+        if (fallocate(fd, 0, offset, off_t(chunkSize)) != 0 &&
+            (errno != EOPNOTSUPP || ftruncate(fd, offset + off_t(chunkSize)) != 0))
+        {
+            return nullptr;
+        }
+
+        void *mapping = mmap(nullptr, chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+        if (mapping == MAP_FAILED)
+            return nullptr;
+
+        p = static_cast<char *>(mapping);
+        chunks[index].store(p, std::memory_order_release);
+    }
+    return p;
+}
+
+bool MappedFile::copy(size_t offset, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        char *p = chunk(offset / chunkSize);
+        if (!p)
+            return false;
+
+        size_t chunkOffset = offset % chunkSize;
+        size_t part = std::min(length, chunkSize - chunkOffset);
+        memcpy(p + chunkOffset, data, part);
+
+        offset += part;
+        data += part;
+        length -= part;
+    }
+    return true;
+}
+
+void MappedFile::fill(size_t offset, size_t length)
+{
+    // spaces ended by a line end, the range reads as an empty line instead of zeroes
+    char blank[4096];
+    memset(blank, ' ', sizeof(blank));
+    while (length > 0)
+    {
+        size_t index = offset / chunkSize;
+        size_t chunkOffset = offset % chunkSize;
+        size_t part = std::min({length, chunkSize - chunkOffset, sizeof(blank)});
+        if (part == length)
+            blank[part - 1] = '\n';
+
+        // a chunk failed to map is written by the descriptor, as far as the disk allows
+        char *p = index < maxChunks ? chunks[index].load(std::memory_order_acquire) : nullptr;
+        if (p)
+            memcpy(p + chunkOffset, blank, part);
+        else
+            writeDescriptor(fd, blank, part, off_t(offset));
+
+        offset += part;
+        length -= part;
+    }
+}
+
+UringFile *UringFile::create(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return nullptr;
+
+    UringFile *file = new UringFile(fd, size_t(st.st_size), fileEnd(st));
+    if (!file->setup())
+    {
+        file->fd = -1;
+        delete file;
+        return nullptr;
+    }
+    return file;
+}
+
+UringFile::~UringFile()
+{
+    submitCurrent();
+    waitAll();
+
+    if (ringFd >= 0)
+        ::close(ringFd);
+    if (sqes)
+        munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    if (sqRing)
+        munmap(sqRing, sqRingSize);
+    if (memory)
+        munmap(memory, bufferCount * bufferSize);
+    if (fd >= 0)
+        ::close(fd);
+}
+
+bool UringFile::setup()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ringFd = int(syscall(__NR_io_uring_setup, bufferCount, &params));
+    if (ringFd < 0)
+        return false;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    void *p = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd, IORING_OFF_SQ_RING);
+    if (p == MAP_FAILED)
+        return false;
+    sqRing = p;
+
+    if (single)
+    {
+        cqRing = sqRing;
+    }
+    else
+    {
+        p = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 ringFd, IORING_OFF_CQ_RING);
+        if (p == MAP_FAILED)
+            return false;
+        cqRing = p;
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    p = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+             ringFd, IORING_OFF_SQES);
+    if (p == MAP_FAILED)
+        return false;
+    sqes = static_cast<io_uring_sqe *>(p);
+
+    char *sq = static_cast<char *>(sqRing);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+    char *cq = static_cast<char *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    p = mmap(nullptr, bufferCount * bufferSize, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return false;
+    memory = static_cast<char *>(p);
+
+    iovec iov[bufferCount];
+    for (unsigned i = 0; i < bufferCount; ++i)
+    {
+        buffers[i].data = memory + i * bufferSize;
+        iov[i].iov_base = buffers[i].data;
+        iov[i].iov_len = bufferSize;
+    }
+
+    // fails if the locked memory limit is too small
+    return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, iov, bufferCount) == 0;
+}
+
+void UringFile::append(const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        if (current < 0)
+            current = acquire();
+
+        Buffer &buffer = buffers[current];
+        size_t part = std::min(length, bufferSize - buffer.used);
+        memcpy(buffer.data + buffer.used, data, part);
+        buffer.used += part;
+        data += part;
+        length -= part;
+
+        if (buffer.used == bufferSize)
+            submitCurrent();
+    }
+}
+
+int UringFile::acquire()
+{
+    for (;;)
+    {
+        for (unsigned i = 0; i < bufferCount; ++i)
+        {
+            Buffer &buffer = buffers[i];
+            if (!buffer.busy)
+            {
+                buffer.busy = true;
+                buffer.used = 0;
+                buffer.written = 0;
+                return int(i);
+            }
+        }
+        waitCompletion();
+    }
+}
+
+void UringFile::submitCurrent()
+{
+    if (current < 0 || buffers[current].used == 0)
+        return;
+
+    // offsets are reserved in the submission order, the writes may complete in any order
+    Buffer &buffer = buffers[current];
+    buffer.offset = end->fetch_add(buffer.used, std::memory_order_relaxed);
+
+    ++inFlight;
+    submit(unsigned(current));
+    current = -1;
+}
+
+void UringFile::submit(unsigned index)
+{
+    if (broken)
+    {
+        writeDirect(index);
+        return;
+    }
+
+    Buffer &buffer = buffers[index];
+
+    // only this object submits, at most bufferCount entries are queued
+    unsigned tail = *sqTail;
+    unsigned slot = tail & *sqMask;
+
+    io_uring_sqe *sqe = &sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer.data + buffer.written);
+    sqe->len = unsigned(buffer.used - buffer.written);
+    sqe->off = buffer.offset + buffer.written;
+    sqe->buf_index = uint16_t(index);
+    sqe->user_data = index;
+
+    sqArray[slot] = slot;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    while (syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0) < 0)
+    {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            // the queued entry is never submitted, no later call enters with entries to submit
+            broken = true;
+            writeDirect(index);
+            return;
+        }
+        sched_yield();
+    }
+}
+
+void UringFile::writeDirect(unsigned index)
+{
+    Buffer &buffer = buffers[index];
+    writeDescriptor(fd, buffer.data + buffer.written, buffer.used - buffer.written,
+                    off_t(buffer.offset + buffer.written));
+    buffer.busy = false;
+    --inFlight;
+}
+
+void UringFile::complete(unsigned index, int result)
+{
+    Buffer &buffer = buffers[index];
+
+    if (result == -EINTR || result == -EAGAIN)
+    {
+        submit(index);
+        return;
+    }
+
+    if (result > 0)
+    {
+        buffer.written += size_t(result);
+        // a short write is possible only on a full disk or a signal
+        if (buffer.written < buffer.used)
+        {
+            submit(index);
+            return;
+        }
+    }
+
+    // written or failed, records are lost like with a failed write(2)
+    buffer.busy = false;
+    --inFlight;
+}
+
+bool UringFile::reap()
+{
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return false;
+
+    while (head != tail)
+    {
+        const io_uring_cqe &cqe = cqes[head & *cqMask];
+        unsigned index = unsigned(cqe.user_data);
+        int result = cqe.res;
+
+        ++head;
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+        complete(index, result);
+    }
+    return true;
+}
+
+void UringFile::waitCompletion()
+{
+    while (!reap())
+    {
+        if (syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+            errno != EINTR)
+        {
+            // the ring is unusable, writes in flight are repeated at their offsets
+            broken = true;
+            for (unsigned i = 0; i < bufferCount; ++i)
+            {
+                if (buffers[i].busy && int(i) != current)
+                    writeDirect(i);
+            }
+            return;
+        }
+    }
+}
+
+LoggerFile *LoggerFile::open(const std::string &fileName, LoggerStream::SinkKind kind)
+{
+    switch (kind)
+    {
+    case LoggerStream::FdSink:
+    {
+        int fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return nullptr;
+        return new AppendFile(fd);
+    }
+    case LoggerStream::MmapSink:
+        return MappedFile::open(fileName);
+    case LoggerStream::UringSink:
+    {
+        int fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return nullptr;
+        if (UringFile *file = UringFile::create(fd))
+            return file;
+
+        // io_uring is disabled or not supported by the kernel
+        fcntl(fd, F_SETFL, O_APPEND);
+        return new AppendFile(fd);
+    }
+    case LoggerStream::ZstdSink:
+    case LoggerStream::Lz4Sink:
+    case LoggerStream::GzipSink:
+        return LoggerCompress::open(fileName, kind);
+    case LoggerStream::StdioSink:
+    default:
+    {
+        FILE *file = fopen(fileName.c_str(), "ae");
+        if (!file)
+            return nullptr;
+        return new StdioFile(file);
+    }
+    }
+}
+
+void LoggerFile::writeParts(const LoggerStream::Bytes *parts, std::size_t count)
+{
+    std::string text;
+    for (std::size_t i = 0; i < count; ++i)
+        text.append(parts[i].data, parts[i].size);
+
+    writeRecord(text.data(), text.size());
+}
+
+LoggerFile *LoggerFile::standardError()
+{
+    // intentionally leaked, records may be written by destructors of static objects
+    static LoggerFile *file = new StdioFile(stderr, false);
+    return file;
+}
+
+void LoggerFile::setDeferred(bool deferred)
+{
+    deferWrites = deferred;
+}
+
+bool LoggerFile::isDeferred()
+{
+    return deferWrites;
+}
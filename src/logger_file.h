@@ -0,0 +1,55 @@
+#pragma once
+
+#include "logger.h"
+
+#include <string>
+#include <cstddef>
+
+/*!
+ * Output file of the logger. Implementations must be thread-safe.
+ */
+class LoggerFile
+{
+public:
+    virtual ~LoggerFile() = default;
+
+    //! Writes one record followed by the line end and flushes it.
+    virtual void writeRecord(const char *s, std::size_t size) = 0;
+
+    //! Writes records already terminated by line ends and flushes them.
+    virtual void writeBatch(const char *data, std::size_t size) = 0;
+
+    //! Writes one record of \a count parts followed by the line end and flushes it.
+    //! The default joins the parts and calls writeRecord().
+    virtual void writeParts(const LoggerStream::Bytes *parts, std::size_t count);
+
+    //! Writes records already terminated by line ends with async-signal-safe calls only.
+    //! Used by crash dumps, records kept by the file are not submitted.
+    virtual void writeFromSignal(const char *data, std::size_t size) = 0;
+
+    //! Submits records kept by the file. Waits until they are written unless
+    //! the calling thread defers writes.
+    virtual void sync()
+    {
+    }
+
+    //! Returns the size of the file when it was opened.
+    virtual std::size_t initialSize() const
+    {
+        return 0;
+    }
+
+    //! Opens the file \a fileName of kind \a kind for appending.
+    //! Returns nullptr and sets errno on error.
+    static LoggerFile *open(const std::string &fileName, LoggerStream::SinkKind kind);
+
+    //! Returns the file writing to stderr. Never destroyed.
+    static LoggerFile *standardError();
+
+    //! Allows files to keep records written by the calling thread until sync().
+    //! Set by the writer thread of the asynchronous mode.
+    static void setDeferred(bool deferred);
+
+    //! Returns true if the calling thread defers writes.
+    static bool isDeferred();
+};
@@ -0,0 +1,254 @@
+
+#include "logger_flight.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include <string.h>
+
+namespace
+{
+    const std::size_t maxRings = 256;
+    const std::size_t maxEntrySize = 4096;
+
+    //! Entries of a ring. Entry n is valid while its sequence is 2n + 2, it is odd while
+    //! the entry is written.
+    struct Entries
+    {
+        Entries(std::size_t count, std::size_t entrySize)
+            : count(count)
+            , entrySize(entrySize)
+            , sequences(new std::atomic<uint64_t>[count]())
+            , times(new uint64_t[count]())
+            , sizes(new uint32_t[count]())
+            , text(new char[count * entrySize])
+        {
+        }
+
+        const std::size_t count;
+        const std::size_t entrySize;
+        std::unique_ptr<std::atomic<uint64_t>[]> sequences;
+        std::unique_ptr<uint64_t[]> times;
+        std::unique_ptr<uint32_t[]> sizes;
+        std::unique_ptr<char[]> text;
+
+        //! Count of records written
+        std::atomic<uint64_t> head {0};
+        //! Records before are dumped
+        std::atomic<uint64_t> dumped {0};
+
+        // used by dump() only
+        uint64_t cursor = 0;
+        uint64_t end = 0;
+    };
+
+    struct alignas(64) FlightRing
+    {
+        std::atomic<bool> used {false};
+        //! Never freed, replaced if the ring is taken with another configuration
+        std::atomic<Entries *> entries {nullptr};
+    };
+
+    FlightRing flightRings[maxRings];
+
+    std::atomic<std::size_t> entryCount {0};
+    std::atomic<std::size_t> entrySize {256};
+    std::atomic<bool> dumping {false};
+
+    //! Ring owned by the thread.
+    struct RingOwner
+    {
+        ~RingOwner()
+        {
+            if (ring)
+            {
+                // records stay readable until another thread takes the ring
+                ring->used.store(false, std::memory_order_release);
+                ring = nullptr;
+            }
+            destroyed = true;
+        }
+
+        Entries *get();
+
+        FlightRing *ring = nullptr;
+        Entries *entries = nullptr;
+        bool exhausted = false;
+        bool destroyed = false;
+    };
+
+    thread_local RingOwner ringOwner;
+
+    Entries *RingOwner::get()
+    {
+        if (entries || exhausted || destroyed)
+            return entries;
+
+        std::size_t count = entryCount.load(std::memory_order_relaxed);
+        std::size_t size = entrySize.load(std::memory_order_relaxed);
+        if (count == 0)
+            return nullptr;
+
+        // rings of exited threads are taken last, their records may be dumped yet
+        for (int pass = 0; pass < 2 && !ring; ++pass)
+        {
+            for (FlightRing &r : flightRings)
+            {
+                bool expected = false;
+                if ((pass == 1 || !r.entries.load(std::memory_order_relaxed)) &&
+                    !r.used.load(std::memory_order_relaxed) &&
+                    r.used.compare_exchange_strong(expected, true))
+                {
+                    ring = &r;
+                    break;
+                }
+            }
+        }
+
+        if (!ring)
+        {
+            // more threads than rings, records of this thread are not kept
+            exhausted = true;
+            return nullptr;
+        }
+
+        entries = ring->entries.load(std::memory_order_acquire);
+        if (!entries || entries->count != count || entries->entrySize != size)
+        {
+            // the previous entries may be read by a dump, they are leaked
+            entries = new Entries(count, size);
+            ring->entries.store(entries, std::memory_order_release);
+        }
+        return entries;
+    }
+
+    //! Reads the time of the entry \a n, returns false if it was overwritten.
+    bool entryTime(const Entries &e, uint64_t n, uint64_t &time)
+    {
+        std::size_t index = n % e.count;
+        uint64_t sequence = e.sequences[index].load(std::memory_order_acquire);
+        if (sequence != 2 * n + 2)
+            return false;
+
+        time = e.times[index];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return e.sequences[index].load(std::memory_order_relaxed) == sequence;
+    }
+
+    //! Moves the cursor of \a e to the next valid entry, returns false if there is none.
+    bool nextEntry(Entries &e, uint64_t &time)
+    {
+        for (; e.cursor < e.end; ++e.cursor)
+        {
+            if (entryTime(e, e.cursor, time))
+                return true;
+        }
+        return false;
+    }
+}
+
+void LoggerFlight::configure(std::size_t entries, std::size_t size)
+{
+    entrySize.store(std::min(std::max(size, std::size_t(16)), maxEntrySize), std::memory_order_relaxed);
+    entryCount.store(entries, std::memory_order_relaxed);
+}
+
+void LoggerFlight::record(uint64_t time, const char *s, std::size_t size)
+{
+    Entries *e = ringOwner.get();
+    if (!e)
+        return;
+
+    uint64_t n = e->head.load(std::memory_order_relaxed);
+    std::size_t index = n % e->count;
+    std::atomic<uint64_t> &sequence = e->sequences[index];
+
+    sequence.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    size = std::min(size, e->entrySize);
+    memcpy(e->text.get() + index * e->entrySize, s, size);
+    e->sizes[index] = uint32_t(size);
+    e->times[index] = time;
+
+    sequence.store(2 * n + 2, std::memory_order_release);
+    e->head.store(n + 1, std::memory_order_release);
+}
+
+std::size_t LoggerFlight::dump(Writer writer, void *context)
+{
+    if (dumping.exchange(true, std::memory_order_acquire))
+        return 0;
+
+    // static, the stack of a crashed thread may be almost exhausted
+    static char buffer[64 * 1024];
+    std::size_t used = 0;
+    std::size_t count = 0;
+
+    Entries *rings[maxRings];
+    uint64_t times[maxRings];
+    std::size_t ringCount = 0;
+
+    for (FlightRing &r : flightRings)
+    {
+        Entries *e = r.entries.load(std::memory_order_acquire);
+        if (!e)
+            continue;
+
+        e->end = e->head.load(std::memory_order_acquire);
+        uint64_t oldest = e->end > e->count ? e->end - e->count : 0;
+        e->cursor = std::max(oldest, e->dumped.load(std::memory_order_relaxed));
+
+        if (nextEntry(*e, times[ringCount]))
+            rings[ringCount++] = e;
+        else
+            e->dumped.store(e->end, std::memory_order_relaxed);
+    }
+
+    while (ringCount > 0)
+    {
+        std::size_t oldest = 0;
+        for (std::size_t i = 1; i < ringCount; ++i)
+        {
+            if (times[i] < times[oldest])
+                oldest = i;
+        }
+
+        Entries &e = *rings[oldest];
+        std::size_t index = e.cursor % e.count;
+        uint64_t sequence = e.sequences[index].load(std::memory_order_acquire);
+        std::size_t size = std::min(std::size_t(e.sizes[index]), e.entrySize);
+
+        if (sizeof(buffer) - used < size + 1)
+        {
+            writer(buffer, used, context);
+            used = 0;
+        }
+
+        memcpy(buffer + used, e.text.get() + index * e.entrySize, size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // the entry is discarded if the owner overwrote it meanwhile
+        if (sequence == 2 * e.cursor + 2 && e.sequences[index].load(std::memory_order_relaxed) == sequence)
+        {
+            used += size;
+            buffer[used++] = '\n';
+            ++count;
+        }
+
+        ++e.cursor;
+        if (!nextEntry(e, times[oldest]))
+        {
+            e.dumped.store(e.end, std::memory_order_relaxed);
+            rings[oldest] = rings[--ringCount];
+            times[oldest] = times[ringCount];
+        }
+    }
+
+    if (used > 0)
+        writer(buffer, used, context);
+
+    dumping.store(false, std::memory_order_release);
+    return count;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*!
+ * Flight recorder: the last records of every thread kept in memory.
+ *
+ * A thread owns a ring of fixed size entries, longer records are truncated. Rings
+ * are never freed, a ring of an exited thread stays readable until another thread
+ * takes it. Entries are guarded by sequence numbers, so rings are read without locks
+ * and allocations, from a signal handler too.
+ */
+class LoggerFlight
+{
+public:
+    //! Sets count of entries and maximum size of a record of rings created later.
+    static void configure(std::size_t entries, std::size_t entrySize);
+
+    //! Producer. Keeps the record in the ring of the calling thread, overwrites the oldest one.
+    static void record(uint64_t time, const char *s, std::size_t size);
+
+    //! Output of dump(), receives records terminated by line ends.
+    typedef void(*Writer)(const char *data, std::size_t size, void *context);
+
+    //! Passes records not dumped before, merged in the timestamp order, to \a writer.
+    //! Async-signal-safe. Returns count of records, a concurrent dump returns 0.
+    static std::size_t dump(Writer writer, void *context);
+};
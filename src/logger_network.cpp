@@ -0,0 +1,661 @@
+
+#include "logger_network.h"
+#include "logger_clock.h"
+#include "logger_stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    //! Queued record, the text is kept in the text buffer of the queue.
+    struct Entry
+    {
+        size_t offset;
+        uint32_t size;
+        LoggerStream::Level level;
+        //! Microseconds since the epoch, for the syslog header
+        uint64_t time;
+    };
+
+    struct Queue
+    {
+        std::vector<Entry> entries;
+        std::string text;
+
+        bool empty() const
+        {
+            return entries.empty();
+        }
+
+        void clear()
+        {
+            entries.clear();
+            text.clear();
+        }
+
+        void append(LoggerStream::Level level, const char *s, size_t size, uint64_t time)
+        {
+            entries.push_back(Entry{text.size(), uint32_t(size), level, time});
+            text.append(s, size);
+        }
+    };
+
+    class NetworkSink : public LoggerStream::Sink
+    {
+    public:
+        NetworkSink(LoggerStream::NetworkOptions options, LoggerNetwork::Fallback fallback);
+        ~NetworkSink() override;
+
+        void write(LoggerStream::Level level, const char *s, std::size_t size) override;
+        void writeRecord(const LoggerStream::Record &record) override;
+        void flush() override;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        // the sender is woken when so many records or bytes are queued
+        static constexpr size_t batchRecords = 256;
+        static constexpr size_t batchBytes = 64 << 10;
+        // datagrams sent by one sendmmsg(2)
+        static constexpr size_t datagramBatch = 64;
+        // enough for the syslog header with truncated names
+        static constexpr size_t maxHeader = 256;
+        // seconds a send may block
+        static constexpr int sendTimeout = 5;
+        // milliseconds a connection or a name lookup may take
+        static constexpr int connectTimeout = 1000;
+        // milliseconds a writer waits for space under Block before the record goes to the fallback
+        static constexpr int blockTimeout = 100;
+
+        //! Name lookup by getaddrinfo_a(3), kept until it finishes when it takes too long.
+        struct Resolve
+        {
+            std::string host;
+            std::string port;
+            addrinfo hints;
+            gaicb request;
+        };
+
+        //! Queues a record created at \a time in microseconds.
+        void append(LoggerStream::Level level, const char *s, size_t size, uint64_t time);
+        //! Waits up to blockTimeout for space for \a size bytes, returns false if there is none.
+        bool waitSpace(std::unique_lock<std::mutex> &lock, size_t size);
+        void run();
+        //! Returns true if all records were sent.
+        bool send(const Queue &queue);
+        //! Sends entries starting at \a first, returns the index of the first entry not sent.
+        size_t sendDatagrams(const Queue &queue, size_t first);
+        size_t sendStream(const Queue &queue, size_t first);
+        bool connect();
+        //! Connects \a fd within connectTimeout.
+        bool connect(const sockaddr *addr, socklen_t size);
+        //! Returns the addresses of the collector, null while the lookup is in progress or failed.
+        addrinfo *resolve();
+        void disconnect();
+        //! Closes the socket after an error, the next connection is delayed.
+        void fail();
+        //! Writes the syslog header of the record, returns its size.
+        size_t formatHeader(const Entry &entry, char *header);
+        void drop(const Queue &queue, size_t first);
+
+        LoggerStream::NetworkOptions options;
+        LoggerNetwork::Fallback fallback;
+        bool datagram;
+        std::string hostName;
+        std::string appName;
+        pid_t pid;
+
+        std::mutex mutex;
+        std::condition_variable wakeCondition;
+        std::condition_variable doneCondition;
+        Queue pending;
+        uint64_t flushRequested = 0;
+        uint64_t flushed = 0;
+        bool woken = false;
+        bool stopping = false;
+        //! A writer waited for space in vain, Block drops records until a batch is sent
+        bool stalled = false;
+
+        // used by the sender thread only
+        int fd = -1;
+        std::unique_ptr<Resolve> resolving;
+        Clock::time_point nextConnect;
+        std::chrono::milliseconds retryDelay {0};
+        time_t headerSecond = -1;
+        char headerTime[32];
+
+        std::thread thread;
+    };
+
+    //! Syslog severity of a level.
+    int severity(LoggerStream::Level level)
+    {
+        static const int severities[] = {7, 6, 4, 3, 2};
+        return severities[level];
+    }
+
+    NetworkSink::NetworkSink(LoggerStream::NetworkOptions options, LoggerNetwork::Fallback fallback)
+        : options(std::move(options))
+        , fallback(this->options.fallback ? fallback : nullptr)
+        , datagram(this->options.transport == LoggerStream::UdpTransport ||
+                   this->options.transport == LoggerStream::UnixDatagramTransport)
+        , pid(getpid())
+    {
+        char name[HOST_NAME_MAX + 1] = {};
+        if (gethostname(name, sizeof(name) - 1) != 0 || name[0] == '\0')
+            strcpy(name, "-");
+        hostName.assign(name, std::min(strlen(name), size_t(64)));
+
+        appName = this->options.appName.empty() ? program_invocation_short_name : this->options.appName;
+        if (appName.empty())
+            appName = "-";
+        // APP-NAME is 48 printable characters at most
+        appName.resize(std::min(appName.size(), size_t(48)));
+        std::replace(appName.begin(), appName.end(), ' ', '_');
+
+        this->options.maxDatagram = std::max(this->options.maxDatagram, size_t(maxHeader) + 1);
+        this->options.batchInterval = std::max(this->options.batchInterval, 1u);
+
+        thread = std::thread(&NetworkSink::run, this);
+    }
+
+    NetworkSink::~NetworkSink()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeCondition.notify_one();
+        doneCondition.notify_all();
+        thread.join();
+
+        if (resolving)
+        {
+            // a lookup still running can't be freed, it writes to the request when it finishes
+            if (gai_cancel(&resolving->request) == EAI_NOTCANCELED)
+                resolving.release();
+            else if (gai_error(&resolving->request) == 0)
+                freeaddrinfo(resolving->request.ar_result);
+        }
+    }
+
+    void NetworkSink::write(LoggerStream::Level level, const char *s, std::size_t size)
+    {
+        // records with borrowed parts are written by the thread which created them
+        append(level, s, size, LoggerClock::now() / 1000);
+    }
+
+    void NetworkSink::writeRecord(const LoggerStream::Record &record)
+    {
+        append(record.level, record.text.data(), record.text.size(), record.time);
+    }
+
+    void NetworkSink::append(LoggerStream::Level level, const char *s, size_t size, uint64_t time)
+    {
+        Queue dropped;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            if (pending.text.size() + size > options.queueSize && !pending.empty())
+            {
+                LoggerStream::OverflowPolicy policy = options.policy;
+                if (policy == LoggerStream::Block && !waitSpace(lock, size))
+                    policy = LoggerStream::DropNewest;
+
+                switch (policy)
+                {
+                case LoggerStream::Block:
+                    break;
+
+                case LoggerStream::DropNewest:
+                    lock.unlock();
+                    LoggerStats::add(LoggerStats::NetworkDropped);
+                    if (fallback)
+                        fallback(level, s, size);
+                    return;
+
+                case LoggerStream::DropOldest:
+                {
+                    // frees the older half of the queue, the text is moved once per half
+                    size_t count = 0;
+                    size_t bytes = 0;
+                    while (count < pending.entries.size() &&
+                           (bytes < options.queueSize / 2 || pending.text.size() - bytes + size > options.queueSize))
+                    {
+                        bytes += pending.entries[count++].size;
+                    }
+
+                    dropped.entries.assign(pending.entries.begin(), pending.entries.begin() + count);
+                    dropped.text.assign(pending.text, 0, bytes);
+                    pending.entries.erase(pending.entries.begin(), pending.entries.begin() + count);
+                    pending.text.erase(0, bytes);
+                    for (Entry &entry : pending.entries)
+                        entry.offset -= bytes;
+                    break;
+                }
+                }
+            }
+
+            pending.append(level, s, size, time);
+
+            if ((pending.entries.size() >= batchRecords || pending.text.size() >= batchBytes) && !woken)
+            {
+                woken = true;
+                wakeCondition.notify_one();
+            }
+        }
+
+        if (!dropped.empty())
+            drop(dropped, 0);
+    }
+
+    bool NetworkSink::waitSpace(std::unique_lock<std::mutex> &lock, size_t size)
+    {
+        auto hasSpace = [&] {
+            return pending.text.size() + size <= options.queueSize || pending.empty() || stopping;
+        };
+
+        // a stalled collector would stop every logging thread for the send timeout,
+        // one writer waits and the next ones don't until a batch is sent
+        if (!stalled)
+        {
+            wakeCondition.notify_one();
+            stalled = !doneCondition.wait_for(lock, std::chrono::milliseconds(blockTimeout), hasSpace);
+        }
+        return hasSpace();
+    }
+
+    void NetworkSink::flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        uint64_t request = ++flushRequested;
+        wakeCondition.notify_one();
+        doneCondition.wait(lock, [&] { return flushed >= request || stopping; });
+    }
+
+    void NetworkSink::run()
+    {
+        Queue batch;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            // records wait for a batch up to the interval
+            if (!woken && flushRequested == flushed && !stopping)
+            {
+                wakeCondition.wait_for(lock, std::chrono::milliseconds(options.batchInterval));
+            }
+
+            woken = false;
+            std::swap(batch, pending);
+            uint64_t request = flushRequested;
+            bool stop = stopping;
+            lock.unlock();
+
+            // writers waiting for space continue
+            doneCondition.notify_all();
+
+            bool sent = true;
+            if (!batch.empty())
+            {
+                sent = send(batch);
+                batch.clear();
+            }
+
+            lock.lock();
+            if (sent)
+                stalled = false;
+            if (request > flushed)
+            {
+                flushed = request;
+                doneCondition.notify_all();
+            }
+
+            if (stop && pending.empty())
+                break;
+        }
+        lock.unlock();
+
+        disconnect();
+    }
+
+    bool NetworkSink::send(const Queue &queue)
+    {
+        size_t next = 0;
+
+        while (next < queue.entries.size())
+        {
+            if (fd < 0 && !connect())
+                break;
+
+            size_t sent = datagram ? sendDatagrams(queue, next) : sendStream(queue, next);
+            LoggerStats::add(LoggerStats::NetworkSent, sent - next);
+            next = sent;
+        }
+
+        if (next == queue.entries.size())
+            return true;
+
+        drop(queue, next);
+        return false;
+    }
+
+    size_t NetworkSink::sendDatagrams(const Queue &queue, size_t first)
+    {
+        char headers[datagramBatch][maxHeader];
+        iovec iov[datagramBatch][2];
+        mmsghdr messages[datagramBatch];
+
+        while (first < queue.entries.size())
+        {
+            size_t count = std::min(queue.entries.size() - first, datagramBatch);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                const Entry &entry = queue.entries[first + i];
+                size_t headerSize = formatHeader(entry, headers[i]);
+
+                iov[i][0].iov_base = headers[i];
+                iov[i][0].iov_len = headerSize;
+                iov[i][1].iov_base = const_cast<char *>(queue.text.data() + entry.offset);
+                iov[i][1].iov_len = std::min(size_t(entry.size), options.maxDatagram - headerSize);
+
+                memset(&messages[i], 0, sizeof(messages[i]));
+                messages[i].msg_hdr.msg_iov = iov[i];
+                messages[i].msg_hdr.msg_iovlen = 2;
+            }
+
+            int result = sendmmsg(fd, messages, unsigned(count), MSG_NOSIGNAL);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                // the collector is gone or the socket was closed
+                fail();
+                return first;
+            }
+
+            first += size_t(result);
+            retryDelay = std::chrono::milliseconds(0);
+        }
+        return first;
+    }
+
+    size_t NetworkSink::sendStream(const Queue &queue, size_t first)
+    {
+        // three iovecs per record: the header, the text and the line end
+        static const size_t maxRecords = std::min(IOV_MAX, 1024) / 3;
+        static char lineEnd = '\n';
+        char headers[maxRecords][maxHeader + 24];
+        iovec iov[maxRecords * 3];
+        size_t ends[maxRecords];
+
+        while (first < queue.entries.size())
+        {
+            size_t count = std::min(queue.entries.size() - first, maxRecords);
+            size_t iovCount = 0;
+            size_t total = 0;
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                const Entry &entry = queue.entries[first + i];
+
+                if (options.framing == LoggerStream::SyslogFraming)
+                {
+                    // octet counting: the length of the message, then the message
+                    char syslogHeader[maxHeader];
+                    size_t headerSize = formatHeader(entry, syslogHeader);
+                    int countSize = snprintf(headers[i], 24, "%zu ", headerSize + entry.size);
+                    memcpy(headers[i] + countSize, syslogHeader, headerSize);
+
+                    iov[iovCount].iov_base = headers[i];
+                    iov[iovCount++].iov_len = size_t(countSize) + headerSize;
+                    total += size_t(countSize) + headerSize;
+                }
+
+                iov[iovCount].iov_base = const_cast<char *>(queue.text.data() + entry.offset);
+                iov[iovCount++].iov_len = entry.size;
+                total += entry.size;
+
+                if (options.framing == LoggerStream::LineFraming)
+                {
+                    iov[iovCount].iov_base = &lineEnd;
+                    iov[iovCount++].iov_len = 1;
+                    total += 1;
+                }
+                ends[i] = total;
+            }
+
+            size_t index = 0;
+            size_t sentBytes = 0;
+            while (index < iovCount)
+            {
+                msghdr message;
+                memset(&message, 0, sizeof(message));
+                message.msg_iov = iov + index;
+                message.msg_iovlen = iovCount - index;
+
+                ssize_t written = sendmsg(fd, &message, MSG_NOSIGNAL);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    // a partially sent record is passed to the fallback whole
+                    fail();
+                    return first + size_t(std::upper_bound(ends, ends + count, sentBytes) - ends);
+                }
+
+                sentBytes += size_t(written);
+                for (size_t left = size_t(written); left > 0 && index < iovCount;)
+                {
+                    if (left >= iov[index].iov_len)
+                    {
+                        left -= iov[index++].iov_len;
+                    }
+                    else
+                    {
+                        iov[index].iov_base = static_cast<char *>(iov[index].iov_base) + left;
+                        iov[index].iov_len -= left;
+                        left = 0;
+                    }
+                }
+            }
+
+            first += count;
+            retryDelay = std::chrono::milliseconds(0);
+        }
+        return first;
+    }
+
+    bool NetworkSink::connect()
+    {
+        if (Clock::now() < nextConnect)
+            return false;
+
+        int type = (datagram ? SOCK_DGRAM : SOCK_STREAM) | SOCK_CLOEXEC;
+        const std::string &address = options.address;
+
+        if (options.transport == LoggerStream::UnixDatagramTransport ||
+            options.transport == LoggerStream::UnixStreamTransport)
+        {
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+
+            if (address.size() < sizeof(addr.sun_path))
+            {
+                memcpy(addr.sun_path, address.data(), address.size());
+
+                fd = socket(AF_UNIX, type, 0);
+                if (fd >= 0 && !connect(reinterpret_cast<sockaddr *>(&addr), sizeof(addr)))
+                    disconnect();
+            }
+        }
+        else
+        {
+            addrinfo *addresses = resolve();
+            for (addrinfo *a = addresses; a && fd < 0; a = a->ai_next)
+            {
+                fd = socket(a->ai_family, type, a->ai_protocol);
+                if (fd >= 0 && !connect(a->ai_addr, a->ai_addrlen))
+                    disconnect();
+            }
+            if (addresses)
+                freeaddrinfo(addresses);
+        }
+
+        if (fd < 0)
+        {
+            fail();
+            return false;
+        }
+
+        // a stalled collector fails sends instead of stopping the sender forever
+        timeval timeout = {sendTimeout, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        return true;
+    }
+
+    bool NetworkSink::connect(const sockaddr *addr, socklen_t size)
+    {
+        int flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+            return false;
+
+        int result = ::connect(fd, addr, size);
+        if (result != 0 && errno == EINPROGRESS)
+        {
+            pollfd p = {fd, POLLOUT, 0};
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (poll(&p, 1, connectTimeout) == 1 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0)
+                result = 0;
+        }
+
+        // sends block up to sendTimeout
+        return result == 0 && fcntl(fd, F_SETFL, flags) == 0;
+    }
+
+    addrinfo *NetworkSink::resolve()
+    {
+        if (!resolving)
+        {
+            // host:port or [ipv6]:port
+            const std::string &address = options.address;
+            size_t colon = address.rfind(':');
+            if (colon == std::string::npos || colon + 1 == address.size())
+                return nullptr;
+
+            std::unique_ptr<Resolve> r(new Resolve());
+            r->host = address.substr(0, colon);
+            r->port = address.substr(colon + 1);
+            if (r->host.size() >= 2 && r->host.front() == '[' && r->host.back() == ']')
+                r->host = r->host.substr(1, r->host.size() - 2);
+
+            r->hints.ai_family = AF_UNSPEC;
+            r->hints.ai_socktype = datagram ? SOCK_DGRAM : SOCK_STREAM;
+            r->request.ar_name = r->host.empty() ? nullptr : r->host.c_str();
+            r->request.ar_service = r->port.c_str();
+            r->request.ar_request = &r->hints;
+
+            gaicb *list[] = {&r->request};
+            if (getaddrinfo_a(GAI_NOWAIT, list, 1, nullptr) != 0)
+                return nullptr;
+            resolving = std::move(r);
+        }
+
+        const gaicb *list[] = {&resolving->request};
+        timespec timeout = {connectTimeout / 1000, (connectTimeout % 1000) * 1000000L};
+        gai_suspend(list, 1, &timeout);
+
+        // a slow lookup goes on while the records are dropped, the next attempt waits for it again
+        int error = gai_error(&resolving->request);
+        if (error == EAI_INPROGRESS)
+            return nullptr;
+
+        addrinfo *addresses = error == 0 ? resolving->request.ar_result : nullptr;
+        resolving.reset();
+        return addresses;
+    }
+
+    void NetworkSink::fail()
+    {
+        disconnect();
+
+        retryDelay = retryDelay.count() == 0 ? std::chrono::milliseconds(100)
+                                             : std::min(retryDelay * 2, std::chrono::milliseconds(10000));
+        nextConnect = Clock::now() + retryDelay;
+    }
+
+    void NetworkSink::disconnect()
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    size_t NetworkSink::formatHeader(const Entry &entry, char *header)
+    {
+        if (options.framing != LoggerStream::SyslogFraming)
+            return 0;
+
+        time_t second = time_t(entry.time / 1000000);
+        if (second != headerSecond)
+        {
+            tm parts;
+            gmtime_r(&second, &parts);
+            strftime(headerTime, sizeof(headerTime), "%Y-%m-%dT%H:%M:%S", &parts);
+            headerSecond = second;
+        }
+
+        int size = snprintf(header, maxHeader, "<%d>1 %s.%06uZ %s %s %d - - ",
+                            options.facility * 8 + severity(entry.level), headerTime,
+                            unsigned(entry.time % 1000000), hostName.c_str(), appName.c_str(), int(pid));
+        return std::min(size_t(std::max(size, 0)), maxHeader - 1);
+    }
+
+    void NetworkSink::drop(const Queue &queue, size_t first)
+    {
+        LoggerStats::add(LoggerStats::NetworkDropped, queue.entries.size() - first);
+
+        if (!fallback)
+            return;
+
+        for (size_t i = first; i < queue.entries.size(); ++i)
+        {
+            const Entry &entry = queue.entries[i];
+            fallback(entry.level, queue.text.data() + entry.offset, entry.size);
+        }
+    }
+}
+
+std::shared_ptr<LoggerStream::Sink> LoggerNetwork::create(LoggerStream::NetworkOptions options, Fallback fallback)
+{
+    return std::make_shared<NetworkSink>(std::move(options), fallback);
+}
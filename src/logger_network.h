@@ -0,0 +1,22 @@
+#pragma once
+
+#include "logger.h"
+
+#include <memory>
+#include <cstddef>
+
+/*!
+ * Sink sending records to a log collector over UDP, TCP or Unix sockets.
+ *
+ * Logging threads append records to a queue of the sink under a short lock, a thread
+ * of the sink sends them in batches. Records which cannot be sent while the collector
+ * is unreachable, and records dropped by the overflow policy, are passed to the fallback.
+ */
+class LoggerNetwork
+{
+public:
+    //! Receives records not sent to the collector.
+    typedef void(*Fallback)(LoggerStream::Level level, const char *s, std::size_t size);
+
+    static std::shared_ptr<LoggerStream::Sink> create(LoggerStream::NetworkOptions options, Fallback fallback);
+};
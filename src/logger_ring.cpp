@@ -0,0 +1,142 @@
+
+#include "logger_ring.h"
+
+#include <string.h>
+
+LoggerRing::LoggerRing(std::size_t size)
+    : capacity(roundCapacity(size))
+{
+    mask = capacity - 1;
+    buffer = new char[capacity];
+}
+
+std::size_t LoggerRing::roundCapacity(std::size_t size)
+{
+    std::size_t capacity = 4096;
+    while (capacity < size)
+        capacity *= 2;
+    return capacity;
+}
+
+LoggerRing::~LoggerRing()
+{
+    delete [] buffer;
+}
+
+bool LoggerRing::push(const Record &record, const char *data)
+{
+    std::size_t need = recordSpace(record.size);
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint64_t t = tail.load(std::memory_order_acquire);
+
+    std::size_t offset = h & mask;
+    std::size_t contiguous = capacity - offset;
+    // a record is never split, the end of the buffer is skipped
+    std::size_t padding = need > contiguous ? contiguous : 0;
+
+    if (record.size > maxRecordSize() || h + padding + need - t > capacity)
+        return false;
+
+    if (padding)
+    {
+        memcpy(buffer + offset, &Padding, sizeof(Padding));
+        h += padding;
+        offset = 0;
+    }
+
+    memcpy(buffer + offset, &record, sizeof(record));
+    memcpy(buffer + offset + sizeof(record), data, record.size);
+
+    head.store(h + need, std::memory_order_release);
+    return true;
+}
+
+bool LoggerRing::dropOldest()
+{
+    uint64_t t = tail.load(std::memory_order_acquire);
+
+    for (;;)
+    {
+        if (t == head.load(std::memory_order_relaxed))
+            return false;
+
+        // records are written by this thread, the header is always consistent
+        std::size_t offset = t & mask;
+        uint32_t size;
+        memcpy(&size, buffer + offset, sizeof(size));
+
+        uint64_t next = size == Padding ? t + (capacity - offset) : t + recordSpace(size);
+        if (tail.compare_exchange_weak(t, next, std::memory_order_acq_rel))
+        {
+            if (size != Padding)
+                return true;
+            t = next;
+        }
+    }
+}
+
+bool LoggerRing::readHeader(uint64_t position, Record &record) const
+{
+    std::size_t offset = position & mask;
+    memcpy(&record.size, buffer + offset, sizeof(record.size));
+
+    if (record.size == Padding)
+        return true;
+
+    if (offset + recordSpace(record.size) > capacity)
+        return false;
+
+    memcpy(&record, buffer + offset, sizeof(record));
+    return true;
+}
+
+bool LoggerRing::front(uint64_t &time, uint64_t limit)
+{
+    for (;;)
+    {
+        uint64_t t = tail.load(std::memory_order_acquire);
+        if (t == head.load(std::memory_order_acquire) || t >= limit)
+            return false;
+
+        Record record;
+        if (!readHeader(t, record))
+            continue;
+
+        if (record.size == Padding)
+        {
+            tail.compare_exchange_strong(t, t + (capacity - (t & mask)), std::memory_order_acq_rel);
+            continue;
+        }
+
+        // the header is valid if the producer didn't drop it meanwhile
+        if (tail.load(std::memory_order_acquire) == t)
+        {
+            time = record.time;
+            return true;
+        }
+    }
+}
+
+bool LoggerRing::pop(Record &record, std::string &data, uint64_t limit)
+{
+    for (;;)
+    {
+        uint64_t t = tail.load(std::memory_order_acquire);
+        if (t == head.load(std::memory_order_acquire) || t >= limit)
+            return false;
+
+        if (!readHeader(t, record))
+            continue;
+
+        if (record.size == Padding)
+        {
+            tail.compare_exchange_strong(t, t + (capacity - (t & mask)), std::memory_order_acq_rel);
+            continue;
+        }
+
+        data.assign(buffer + (t & mask) + sizeof(record), record.size);
+
+        if (tail.compare_exchange_strong(t, t + recordSpace(record.size), std::memory_order_acq_rel))
+            return true;
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/*!
+ * Lock-free ring buffer of variable length records for a single producer thread.
+ *
+ * Records are written in place. The tail is moved by compare-and-swap, so the oldest
+ * records may be consumed by a consumer or dropped by the producer (drop-oldest policy).
+ * A consumer copies the record first and discards the copy if the tail was moved
+ * concurrently.
+ */
+class LoggerRing
+{
+public:
+    //! Header of a record.
+    struct Record
+    {
+        uint32_t size;      //!< Payload size
+        uint8_t level;
+        uint8_t binary;
+        uint16_t flags;
+        uint64_t time;      //!< Timestamp used to merge rings
+        uint32_t threadId;
+        uint32_t headerSize;
+    };
+
+    //! Creates the ring of roundCapacity(\a capacity) bytes.
+    explicit LoggerRing(std::size_t capacity);
+
+    //! Returns \a size rounded up to a power of two, at least 4096.
+    static std::size_t roundCapacity(std::size_t size);
+
+    //! Maximum payload size of a record in a ring created with \a size.
+    static std::size_t recordLimit(std::size_t size)
+    {
+        return roundCapacity(size) / 2 - sizeof(Record);
+    }
+    ~LoggerRing();
+
+    LoggerRing(const LoggerRing &) = delete;
+    LoggerRing & operator = (const LoggerRing &) = delete;
+
+    //! Producer. Returns false if there is no space for the record.
+    bool push(const Record &record, const char *data);
+
+    //! Producer. Drops the oldest record, returns false if the ring is empty.
+    bool dropOldest();
+
+    //! Consumer. Gets the time of the oldest record pushed before the position \a limit,
+    //! returns false if there is none.
+    bool front(uint64_t &time, uint64_t limit = UINT64_MAX);
+
+    //! Consumer. Copies and removes the oldest record pushed before the position \a limit,
+    //! returns false if there is none.
+    bool pop(Record &record, std::string &data, uint64_t limit = UINT64_MAX);
+
+    //! Position after the last pushed record.
+    uint64_t headPosition() const
+    {
+        return head.load(std::memory_order_acquire);
+    }
+
+    //! Position of the oldest record not consumed or dropped.
+    uint64_t tailPosition() const
+    {
+        return tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+
+    //! Maximum payload size of a record.
+    std::size_t maxRecordSize() const
+    {
+        return capacity / 2 - sizeof(Record);
+    }
+
+    //! Producer. Returns the used part of the ring in percent.
+    unsigned fillPercent() const
+    {
+        uint64_t used = head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed);
+        return unsigned(used * 100 / capacity);
+    }
+
+    //! Set by the producer thread on exit.
+    std::atomic<bool> closed {false};
+
+    //! Set by the consumer, records before this position are written or dropped.
+    std::atomic<uint64_t> flushed {0};
+
+    //! Set by the producer while it waits for space.
+    std::atomic<bool> waiting {false};
+
+private:
+    static constexpr uint32_t Padding = 0xffffffff;
+
+    static std::size_t recordSpace(std::size_t size)
+    {
+        return (sizeof(Record) + size + 7) & ~std::size_t(7);
+    }
+
+    //! Reads the header at \a position, returns false if it was overwritten.
+    bool readHeader(uint64_t position, Record &record) const;
+
+    alignas(64) std::atomic<uint64_t> head {0};
+    alignas(64) std::atomic<uint64_t> tail {0};
+    alignas(64) std::size_t capacity;
+    std::size_t mask;
+    char *buffer;
+};
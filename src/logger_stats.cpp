@@ -0,0 +1,133 @@
+
+#include "logger_stats.h"
+
+namespace
+{
+    struct alignas(64) ShardSlot
+    {
+        std::atomic<bool> used {false};
+        std::atomic<LoggerStats::Shard *> shard {nullptr};
+    };
+
+    const std::size_t maxShards = 256;
+    ShardSlot shardSlots[maxShards];
+
+    //! Shard of threads without own slot
+    LoggerStats::Shard *sharedShard()
+    {
+        // intentionally leaked, records may be written by destructors of static objects
+        static LoggerStats::Shard *shard = [] {
+            LoggerStats::Shard *s = new LoggerStats::Shard;
+            s->shared = true;
+            return s;
+        }();
+        return shard;
+    }
+
+    //! Slot owned by the thread.
+    struct SlotOwner
+    {
+        ~SlotOwner();
+
+        ShardSlot *slot = nullptr;
+        bool destroyed = false;
+    };
+
+    thread_local SlotOwner slotOwner;
+}
+
+thread_local LoggerStats::Shard *LoggerStats::currentShard = nullptr;
+std::atomic<bool> LoggerStats::latencyEnabled {false};
+
+SlotOwner::~SlotOwner()
+{
+    // later records of the exiting thread go to the shared shard
+    LoggerStats::detach();
+    destroyed = true;
+
+    if (slot)
+    {
+        // counters stay in the shard, the next thread taking it continues them
+        slot->used.store(false, std::memory_order_release);
+        slot = nullptr;
+    }
+}
+
+LoggerStats::Shard &LoggerStats::attach()
+{
+    SlotOwner &owner = slotOwner;
+
+    if (!owner.destroyed)
+    {
+        for (ShardSlot &slot : shardSlots)
+        {
+            bool expected = false;
+            if (!slot.used.load(std::memory_order_relaxed) &&
+                slot.used.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            {
+                Shard *shard = slot.shard.load(std::memory_order_acquire);
+                if (!shard)
+                {
+                    shard = new Shard;
+                    slot.shard.store(shard, std::memory_order_release);
+                }
+
+                owner.slot = &slot;
+                currentShard = shard;
+                return *shard;
+            }
+        }
+    }
+
+    currentShard = sharedShard();
+    return *currentShard;
+}
+
+void LoggerStats::detach()
+{
+    currentShard = sharedShard();
+}
+
+void LoggerStats::collect(LoggerStream::Stats &stats)
+{
+    uint64_t counters[CounterCount] = {};
+    LoggerStream::Histogram *histograms[LatencyCount] = {&stats.recordLatency, &stats.writeLatency};
+
+    for (LoggerStream::Histogram *histogram : histograms)
+    {
+        for (uint64_t &count : histogram->counts)
+            count = 0;
+    }
+
+    auto addShard = [&](const Shard &shard) {
+        for (unsigned i = 0; i < CounterCount; ++i)
+            counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+
+        for (unsigned h = 0; h < LatencyCount; ++h)
+        {
+            for (unsigned i = 0; i < LoggerStream::Histogram::bucketCount; ++i)
+                histograms[h]->counts[i] += shard.histograms[h][i].load(std::memory_order_relaxed);
+        }
+    };
+
+    for (ShardSlot &slot : shardSlots)
+    {
+        if (const Shard *shard = slot.shard.load(std::memory_order_acquire))
+            addShard(*shard);
+    }
+    addShard(*sharedShard());
+
+    for (unsigned level = 0; level <= LoggerStream::Fatal; ++level)
+        stats.records[level] = counters[DebugRecords + level];
+    stats.bytes = counters[Bytes];
+    stats.filtered = counters[Filtered];
+    stats.poolHits = counters[PoolHits];
+    stats.poolMisses = counters[PoolMisses];
+    stats.queueFull = counters[QueueFull];
+    stats.flushes = counters[Flushes];
+    stats.networkSent = counters[NetworkSent];
+    stats.networkDropped = counters[NetworkDropped];
+    stats.degraded = counters[Degraded];
+    stats.degradeTransitions = counters[DegradeTransitions];
+    stats.suppressed = counters[Suppressed];
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*!
+ * Counters of the logger sharded by threads.
+ *
+ * A thread updates own shard by relaxed loads and stores, stats() sums all shards.
+ * Shards are never freed, a shard of an exited thread is taken by a new thread and
+ * keeps counting, so totals are not lost. Threads exceeding the shard table share
+ * one shard updated by atomic additions.
+ */
+class LoggerStats
+{
+public:
+    enum Counter
+    {
+        // in the order of levels
+        DebugRecords,
+        InfoRecords,
+        WarningRecords,
+        ErrorRecords,
+        FatalRecords,
+        Bytes,
+        Filtered,
+        PoolHits,
+        PoolMisses,
+        QueueFull,
+        Flushes,
+        NetworkSent,
+        NetworkDropped,
+        Degraded,
+        DegradeTransitions,
+        Suppressed,
+
+        CounterCount
+    };
+
+    enum Latency
+    {
+        RecordLatency,
+        WriteLatency,
+
+        LatencyCount
+    };
+
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> counters[CounterCount] = {};
+        std::atomic<uint64_t> histograms[LatencyCount][LoggerStream::Histogram::bucketCount] = {};
+        bool shared = false;
+    };
+
+    static void add(Counter counter, uint64_t value = 1)
+    {
+        Shard &s = shard();
+        increment(s.counters[counter], value, s.shared);
+    }
+
+    //! Returns true if latency histograms are enabled.
+    static bool measureLatency()
+    {
+        return latencyEnabled.load(std::memory_order_relaxed);
+    }
+
+    static void setLatencyEnabled(bool enabled)
+    {
+        latencyEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    //! Returns steady clock nanoseconds.
+    static uint64_t now()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    //! Adds the time since \a start to the histogram.
+    static void addLatency(Latency latency, uint64_t start)
+    {
+        uint64_t end = now();
+        Shard &s = shard();
+        increment(s.histograms[latency][LoggerStream::Histogram::bucket(end > start ? end - start : 0)],
+                  1, s.shared);
+    }
+
+    //! Moves the calling thread to the shared shard, called when the thread exits.
+    static void detach();
+
+    //! Sums counters of all shards into \a stats, doesn't set the dropped count.
+    static void collect(LoggerStream::Stats &stats);
+
+    static void increment(std::atomic<uint64_t> &value, uint64_t delta, bool shared)
+    {
+        if (shared)
+            value.fetch_add(delta, std::memory_order_relaxed);
+        else
+            value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    static Shard &shard()
+    {
+        Shard *s = currentShard;
+        return s ? *s : attach();
+    }
+
+    //! Takes a shard for the calling thread.
+    static Shard &attach();
+
+    static thread_local Shard *currentShard;
+    static std::atomic<bool> latencyEnabled;
+};
@@ -0,0 +1,199 @@
+#include "logger_test.h"
+#include "logger_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <unistd.h>
+
+namespace
+{
+    LoggerRing::Record header(uint32_t size, uint64_t time)
+    {
+        LoggerRing::Record record = {};
+        record.size = size;
+        record.time = time;
+        return record;
+    }
+
+    //! Logs faster than the handler writes, every record is written or counted as dropped.
+    void checkDrops(LoggerStream::OverflowPolicy policy)
+    {
+        static std::atomic<bool> slow {true};
+        LoggerStream::setOutputHandler([](LoggerStream::Level level, const char *s) {
+            if (slow.load())
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            collect(level, s);
+        });
+        LoggerStream::setAsync(4096, policy);
+
+        const long count = 20000;
+        for (long i = 0; i < count; ++i)
+            LOG_INFO << "seq" << i;
+        slow.store(false);
+        LoggerStream::flush();
+
+        std::vector<std::string> records = collected();
+        long last = -1;
+        for (const std::string &record : records)
+        {
+            long seq = numberAfter(record, "seq ");
+            CHECK(seq > last);
+            last = seq;
+        }
+
+        size_t dropped = LoggerStream::droppedCount();
+        CHECK(dropped > 0);
+        CHECK(records.size() + dropped == size_t(count));
+        CHECK(LoggerStream::stats().queueFull > 0);
+        if (policy == LoggerStream::DropOldest)
+            CHECK(last == count - 1);
+    }
+}
+
+LOGGER_TEST(ringOrder)
+{
+    LoggerRing ring(1024);
+    LoggerRing::Record record;
+    std::string data;
+    uint64_t next = 0;
+    uint64_t popped = 0;
+
+    // wraps around the buffer several times
+    for (int round = 0; round < 20; ++round)
+    {
+        while (true)
+        {
+            std::string text = "record " + std::to_string(next);
+            if (!ring.push(header(uint32_t(text.size()), next), text.data()))
+                break;
+            ++next;
+        }
+        CHECK(!ring.empty());
+
+        while (ring.pop(record, data))
+        {
+            CHECK(record.time == popped);
+            CHECK(data == "record " + std::to_string(popped));
+            ++popped;
+        }
+        CHECK(ring.empty());
+    }
+    CHECK(popped == next);
+    CHECK(popped > 100);
+
+    // the limit hides records pushed after it
+    ring.push(header(1, 1), "a");
+    uint64_t limit = ring.headPosition();
+    ring.push(header(1, 2), "b");
+    uint64_t time = 0;
+    CHECK(ring.front(time, limit) && time == 1);
+    CHECK(ring.pop(record, data, limit) && data == "a");
+    CHECK(!ring.pop(record, data, limit));
+    CHECK(ring.pop(record, data) && data == "b");
+
+    // dropping keeps the newest records
+    ring.push(header(1, 3), "c");
+    ring.push(header(1, 4), "d");
+    CHECK(ring.dropOldest());
+    CHECK(ring.pop(record, data) && data == "d");
+    CHECK(!ring.dropOldest());
+
+    // sizes are rounded as by the ring
+    CHECK(LoggerRing::roundCapacity(32) == 4096);
+    CHECK(LoggerRing::roundCapacity(5000) == 8192);
+    CHECK(LoggerRing::recordLimit(32) == ring.maxRecordSize());
+}
+
+LOGGER_TEST(dropNewest)
+{
+    checkDrops(LoggerStream::DropNewest);
+}
+
+LOGGER_TEST(dropOldest)
+{
+    checkDrops(LoggerStream::DropOldest);
+}
+
+//! Records logged before flush() are written when it returns, while other threads log.
+LOGGER_TEST(flushUnderLoad)
+{
+    static std::atomic<long> lastMarker {-1};
+    LoggerStream::setOutputHandler([](LoggerStream::Level, const char *s) {
+        long marker = numberAfter(s, "marker ");
+        if (marker >= 0)
+            lastMarker.store(marker);
+    });
+    LoggerStream::setAsync(1 << 16, LoggerStream::Block);
+
+    std::atomic<bool> stop {false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&stop] {
+            for (long i = 0; !stop.load(std::memory_order_relaxed); ++i)
+                LOG_INFO << "load" << i;
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < 200; ++i)
+    {
+        LOG_INFO << "marker" << i;
+        LoggerStream::flush();
+        CHECK(lastMarker.load() == i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    stop.store(true);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    // flushes never wait for records logged after them
+    CHECK(elapsed < std::chrono::seconds(10));
+}
+
+//! A ring smaller than the minimum is rounded up, records too long for it are written
+//! synchronously in order with the queued ones.
+LOGGER_TEST(smallRing)
+{
+    LoggerStream::setStreamingThreshold(1000);
+
+    for (LoggerStream::OverflowPolicy policy : {LoggerStream::Block, LoggerStream::DropNewest})
+    {
+        std::string path = tempPath("small");
+        LoggerStream::setLogFileName(path);
+        LoggerStream::setAsync(32, policy);
+
+        // queued, borrowed and written as parts, and joined records too long for the ring
+        const std::string large(1500, 'l');
+        const std::string huge(20000, 'h');
+        for (long i = 0; i < 30; ++i)
+        {
+            switch (i % 3)
+            {
+            case 0:
+                LOG_INFO << "seq" << i;
+                break;
+            case 1:
+                LOG_INFO << "seq" << i << large;
+                break;
+            case 2:
+                LOG_INFO << "seq" << i << std::string_view(huge);
+                break;
+            }
+        }
+        LoggerStream::setSync();
+
+        std::vector<std::string> lines = readLines(path);
+        CHECK(lines.size() == 30);
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            CHECK(numberAfter(lines[i], "seq ") == long(i));
+            CHECK(lines[i].size() > (i % 3 == 2 ? huge.size() : i % 3 == 1 ? large.size() : 0));
+        }
+        CHECK(LoggerStream::droppedCount() == 0);
+        unlink(path.c_str());
+    }
+}
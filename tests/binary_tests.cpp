@@ -0,0 +1,65 @@
+#include "logger_test.h"
+
+#include <limits>
+
+namespace
+{
+    void logAll()
+    {
+        std::string s = "string";
+        LOG_INFO << "text" << 42 << -7L << 3.25 << 'c' << true << s << std::string_view("view");
+        LOG_WARNING.hex() << 255u << std::numeric_limits<int64_t>::min();
+        LOG_ERROR.precision(2).quote() << "quoted \"text\"" << 1.005f;
+        LOG_INFO.nospace() << "no" << "space" << 1;
+        LOG_DEBUG << "fields" << kv("key", 5) << kv("name", s);
+        LOG_INFO << "";
+    }
+
+    std::vector<std::string> messages()
+    {
+        std::vector<std::string> result;
+        for (const TestRecord &record : captured())
+            result.push_back(record.message);
+        return result;
+    }
+}
+
+//! Records captured in binary mode are decoded to the text of records formatted at once.
+LOGGER_TEST(binaryDecode)
+{
+    captureRecords();
+    logAll();
+    std::vector<std::string> text = messages();
+
+    LoggerStream::setBinaryMode(true);
+    logAll();
+    LoggerStream::setAsync(1 << 16);
+    logAll();
+    LoggerStream::setSync();
+
+    std::vector<std::string> all = messages();
+    CHECK(all.size() == text.size() * 3);
+    if (all.size() != text.size() * 3)
+        return;
+
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        CHECK(all[text.size() + i] == text[i]);
+        CHECK(all[text.size() * 2 + i] == text[i]);
+    }
+}
+
+//! Prefixes are resolved when the record is formatted.
+LOGGER_TEST(binaryPrefix)
+{
+    captureRecords();
+    LoggerStream::setBinaryMode(true);
+    LoggerStream::setMessagePrefix("module");
+
+    LOG_INFO << "record";
+
+    std::vector<TestRecord> records = captured();
+    CHECK(records.size() == 1);
+    CHECK(!records.empty() && contains(records[0].header, "module: "));
+    CHECK(!records.empty() && records[0].message == " record");
+}
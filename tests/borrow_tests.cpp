@@ -0,0 +1,127 @@
+#include "logger_test.h"
+
+#include <memory>
+
+#include <unistd.h>
+
+namespace
+{
+    //! Sink keeping the records and the count of parts of every record.
+    class PartsSink : public LoggerStream::Sink
+    {
+    public:
+        void write(LoggerStream::Level, const char *s, std::size_t size) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            records.emplace_back(std::string(s, size), 1);
+        }
+
+        void writeParts(LoggerStream::Level, const LoggerStream::Bytes *parts, std::size_t count,
+                        std::size_t size) override
+        {
+            std::string text;
+            for (std::size_t i = 0; i < count; ++i)
+                text.append(parts[i].data, parts[i].size);
+            CHECK(text.size() == size);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            records.emplace_back(text, count);
+        }
+
+        std::vector<std::pair<std::string, std::size_t>> taken()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return std::move(records);
+        }
+
+        std::mutex mutex;
+        std::vector<std::pair<std::string, std::size_t>> records;
+    };
+
+    //! Returns the record text after the header and the space before the first argument.
+    std::string message(const std::string &record)
+    {
+        size_t position = record.find(" :  ");
+        return position == std::string::npos ? record : record.substr(position + 4);
+    }
+}
+
+//! Large lvalue strings and logBytes() are passed as parts in order, small strings and
+//! temporaries are copied. The log file gets the same records.
+LOGGER_TEST(borrowedParts)
+{
+    std::string path = tempPath("borrowed");
+    LoggerStream::setLogFileName(path, LoggerStream::FdSink);
+    std::shared_ptr<PartsSink> sink = std::make_shared<PartsSink>();
+    LoggerStream::addSink(sink);
+    LoggerStream::setStreamingThreshold(64);
+
+    std::string large(100, 'a');
+    std::string other(200, 'b');
+    std::string small = "small";
+    const char bytes[] = "raw bytes";
+
+    LOG_INFO << "first" << large << "middle" << other << 1;
+    LOG_INFO << "temporary" << std::string(100, 'c');
+    LOG_INFO << "small" << small;
+    LOG_INFO << "bytes" << logBytes(bytes, sizeof(bytes) - 1) << "end";
+    LOG_INFO.quote() << "quoted" << large;
+    closeLogFile();
+
+    std::vector<std::pair<std::string, std::size_t>> records = sink->taken();
+    CHECK(records.size() == 5);
+    if (records.size() != 5)
+        return;
+
+    CHECK(message(records[0].first) == "first " + large + " middle " + other + " 1");
+    CHECK(records[0].second > 1);
+    CHECK(message(records[1].first) == "temporary " + std::string(100, 'c'));
+    CHECK(records[1].second == 1);
+    CHECK(message(records[2].first) == "small small");
+    CHECK(records[2].second == 1);
+    CHECK(message(records[3].first) == "bytes raw bytes end");
+    CHECK(records[3].second > 1);
+    CHECK(message(records[4].first) == "\"quoted\" \"" + large + "\"");
+    CHECK(records[4].second == 1);
+
+    std::vector<std::string> lines = readLines(path);
+    CHECK(lines.size() == records.size());
+    for (size_t i = 0; i < lines.size() && i < records.size(); ++i)
+        CHECK(lines[i] == records[i].first);
+    unlink(path.c_str());
+}
+
+//! Records passed to handlers or kept by the asynchronous queue are joined while the
+//! strings are alive, later changes of the strings don't apply.
+LOGGER_TEST(borrowedJoined)
+{
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::setStreamingThreshold(64);
+    std::string large(100, 'a');
+
+    LOG_INFO << "handler" << large;
+
+    LoggerStream::setAsync(1 << 16);
+    for (int i = 0; i < 100; ++i)
+    {
+        LOG_INFO << "async" << large << i;
+        large.assign(100, char('a' + i % 26));
+    }
+    large.assign(100, 'z');
+    LoggerStream::flush();
+    LoggerStream::setSync();
+
+    std::vector<std::string> records = collected();
+    CHECK(records.size() == 101);
+    if (records.size() != 101)
+        return;
+
+    CHECK(message(records[0]) == "handler " + std::string(100, 'a'));
+    for (int i = 0; i < 100; ++i)
+    {
+        // the string logged by iteration i was assigned by the previous one
+        char c = i == 0 ? 'a' : char('a' + (i - 1) % 26);
+        CHECK(message(records[i + 1]) ==
+              "async " + std::string(100, c) + " " + std::to_string(i));
+    }
+}
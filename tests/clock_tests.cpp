@@ -0,0 +1,86 @@
+#include "logger_test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+    uint64_t nowUs()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+}
+
+//! Every source stays close to the wall clock and doesn't go back within a thread.
+LOGGER_TEST(clockSources)
+{
+    captureRecords();
+
+    const LoggerStream::ClockSource sources[] = {LoggerStream::RealtimeClock, LoggerStream::MonotonicClock,
+                                                 LoggerStream::CoarseClock, LoggerStream::TscClock};
+    for (LoggerStream::ClockSource source : sources)
+    {
+        LoggerStream::setClock(source);
+        size_t start = captured().size();
+        uint64_t before = nowUs();
+        for (int i = 0; i < 1000; ++i)
+            LOG_INFO << "record" << i;
+        uint64_t after = nowUs();
+
+        std::vector<TestRecord> records = captured();
+        records.erase(records.begin(), records.begin() + start);
+        CHECK(records.size() == 1000);
+        uint64_t previous = 0;
+        for (const TestRecord &record : records)
+        {
+            // the coarse clock lags by a tick
+            CHECK(record.time + 20000 >= before && record.time <= after + 20000);
+            CHECK(record.time >= previous);
+            previous = record.time;
+        }
+    }
+}
+
+//! Readers see whole calibrations while the source changes.
+LOGGER_TEST(clockSwitch)
+{
+    captureRecords();
+
+    std::atomic<bool> stop {false};
+    std::thread switcher([&stop] {
+        const LoggerStream::ClockSource sources[] = {LoggerStream::MonotonicClock, LoggerStream::CoarseClock,
+                                                     LoggerStream::RealtimeClock};
+        for (unsigned i = 0; !stop.load(); ++i)
+            LoggerStream::setClock(sources[i % 3]);
+    });
+
+    uint64_t before = nowUs();
+    for (int i = 0; i < 20000; ++i)
+        LOG_INFO << "record";
+    uint64_t after = nowUs();
+    stop.store(true);
+    switcher.join();
+
+    std::vector<TestRecord> records = captured();
+    CHECK(records.size() == 20000);
+    for (const TestRecord &record : records)
+        CHECK(record.time + 20000 >= before && record.time <= after + 20000);
+}
+
+LOGGER_TEST(timePrecision)
+{
+    captureRecords();
+
+    LOG_INFO << "milliseconds";
+    LoggerStream::setTimePrecision(LoggerStream::Microseconds);
+    LOG_INFO << "microseconds";
+
+    std::vector<TestRecord> records = captured();
+    CHECK(records.size() == 2);
+    if (records.size() != 2)
+        return;
+    CHECK(records[0].header.compare(0, 24, headerTime(records[0].time, 3) + " ") == 0);
+    CHECK(records[1].header.compare(0, 27, headerTime(records[1].time, 6) + " ") == 0);
+}
@@ -0,0 +1,197 @@
+#include "logger_test.h"
+#include "logger_file.h"
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef LOGGER_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LOGGER_HAS_ZSTD
+#include <zstd.h>
+#endif
+#ifdef LOGGER_HAS_LZ4
+#include <lz4frame.h>
+#endif
+
+namespace
+{
+    std::string readFile(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    std::vector<std::string> splitLines(const std::string &text)
+    {
+        std::vector<std::string> lines;
+        std::istringstream stream(text);
+        for (std::string line; std::getline(stream, line);)
+            lines.push_back(line);
+        return lines;
+    }
+
+    //! Decodes concatenated frames, returns false if a frame is broken.
+    bool decode(LoggerStream::SinkKind kind, const std::string &data, std::string &text)
+    {
+        char out[1 << 16];
+        switch (kind)
+        {
+#ifdef LOGGER_HAS_ZLIB
+        case LoggerStream::GzipSink:
+        {
+            z_stream stream = {};
+            // gzip members
+            if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+                return false;
+            stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+            stream.avail_in = uInt(data.size());
+            int result = Z_OK;
+            while (stream.avail_in > 0)
+            {
+                stream.next_out = reinterpret_cast<Bytef *>(out);
+                stream.avail_out = sizeof(out);
+                result = inflate(&stream, Z_NO_FLUSH);
+                text.append(out, sizeof(out) - stream.avail_out);
+                if (result == Z_STREAM_END)
+                    inflateReset(&stream);
+                else if (result != Z_OK)
+                    break;
+            }
+            inflateEnd(&stream);
+            return result == Z_STREAM_END;
+        }
+#endif
+#ifdef LOGGER_HAS_ZSTD
+        case LoggerStream::ZstdSink:
+        {
+            std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx *)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+            ZSTD_inBuffer input = {data.data(), data.size(), 0};
+            size_t result = 0;
+            while (input.pos < input.size)
+            {
+                ZSTD_outBuffer output = {out, sizeof(out), 0};
+                result = ZSTD_decompressStream(context.get(), &output, &input);
+                if (ZSTD_isError(result))
+                    return false;
+                text.append(out, output.pos);
+            }
+            return result == 0;
+        }
+#endif
+#ifdef LOGGER_HAS_LZ4
+        case LoggerStream::Lz4Sink:
+        {
+            LZ4F_dctx *context = nullptr;
+            if (LZ4F_isError(LZ4F_createDecompressionContext(&context, LZ4F_VERSION)))
+                return false;
+            const char *p = data.data();
+            size_t left = data.size();
+            size_t result = 0;
+            while (left > 0)
+            {
+                size_t outSize = sizeof(out);
+                size_t inSize = left;
+                result = LZ4F_decompress(context, out, &outSize, p, &inSize, nullptr);
+                if (LZ4F_isError(result))
+                    break;
+                text.append(out, outSize);
+                p += inSize;
+                left -= inSize;
+            }
+            LZ4F_freeDecompressionContext(context);
+            return result == 0;
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+
+    bool available(LoggerStream::SinkKind kind)
+    {
+        switch (kind)
+        {
+#ifdef LOGGER_HAS_ZLIB
+        case LoggerStream::GzipSink:
+            return true;
+#endif
+#ifdef LOGGER_HAS_ZSTD
+        case LoggerStream::ZstdSink:
+            return true;
+#endif
+#ifdef LOGGER_HAS_LZ4
+        case LoggerStream::Lz4Sink:
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    //! Writes records in many small frames, twice to the same file, and decodes all of them.
+    void checkRoundTrip(LoggerStream::SinkKind kind, const char *name)
+    {
+        if (!available(kind))
+            return;
+
+        std::string path = tempPath(name);
+        LoggerStream::setCompression(1, 4096, 10);
+
+        for (int open = 0; open < 2; ++open)
+        {
+            LoggerStream::setLogFileName(path, kind);
+            for (int i = 0; i < 10000; ++i)
+                LOG_INFO << "open" << open << "seq" << i << "payload";
+            closeLogFile();
+        }
+
+        std::string text;
+        CHECK(decode(kind, readFile(path), text));
+        std::vector<std::string> lines = splitLines(text);
+        CHECK(lines.size() == 20000);
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            CHECK(numberAfter(lines[i], " open ") == long(i / 10000));
+            CHECK(numberAfter(lines[i], " seq ") == long(i % 10000));
+        }
+        unlink(path.c_str());
+    }
+}
+
+LOGGER_TEST(gzipSink)
+{
+    checkRoundTrip(LoggerStream::GzipSink, "gz");
+}
+
+LOGGER_TEST(zstdSink)
+{
+    checkRoundTrip(LoggerStream::ZstdSink, "zst");
+}
+
+LOGGER_TEST(lz4Sink)
+{
+    checkRoundTrip(LoggerStream::Lz4Sink, "lz4");
+}
+
+//! A codec missing at build time fails the opening with ENOTSUP.
+LOGGER_TEST(codecMissing)
+{
+    const LoggerStream::SinkKind kinds[] = {LoggerStream::GzipSink, LoggerStream::ZstdSink, LoggerStream::Lz4Sink};
+    for (LoggerStream::SinkKind kind : kinds)
+    {
+        std::string path = tempPath("codec");
+        errno = 0;
+        std::unique_ptr<LoggerFile> file(LoggerFile::open(path, kind));
+        CHECK(available(kind) == bool(file));
+        if (!file)
+            CHECK(errno == ENOTSUP);
+        file.reset();
+        unlink(path.c_str());
+    }
+}
@@ -0,0 +1,180 @@
+#include "logger_test.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+    //! Time spent by slowHandler() in every record.
+    std::atomic<int> delayMs {0};
+
+    void slowHandler(LoggerStream::Level level, const char *s)
+    {
+        int delay = delayMs.load();
+        if (delay > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        collect(level, s);
+    }
+
+    LoggerStream::DegradeOptions fastOptions()
+    {
+        LoggerStream::DegradeOptions options;
+        options.latency = std::chrono::milliseconds(5);
+        options.interval = std::chrono::milliseconds(10);
+        options.recovery = 1000;
+        return options;
+    }
+
+    //! Logs Info records until the mode is reached, returns false after 5 s.
+    bool logUntil(LoggerStream::DegradeMode mode)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        for (int i = 0; LoggerStream::degradeMode() != mode; ++i)
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+            LOG_INFO << "storm" << i;
+        }
+        return true;
+    }
+
+    //! Returns the transitions written by the logger.
+    std::vector<std::string> transitions()
+    {
+        std::vector<std::string> result;
+        for (const std::string &record : collected())
+        {
+            if (contains(record, " logger degraded ") || contains(record, " logger recovered "))
+                result.push_back(record);
+        }
+        return result;
+    }
+
+    size_t countRecords(const char *part)
+    {
+        std::vector<std::string> records = collected();
+        return size_t(std::count_if(records.begin(), records.end(),
+                                    [part](const std::string &record) { return contains(record, part); }));
+    }
+}
+
+//! A slow output takes one step per interval up to ErrorMode, Error records are never dropped.
+LOGGER_TEST(degradeSteps)
+{
+    LoggerStream::setOutputHandler(slowHandler);
+    LoggerStream::setDegradation(fastOptions());
+    delayMs = 10;
+
+    CHECK(logUntil(LoggerStream::ErrorMode));
+    delayMs = 0;
+
+    LOG_WARNING << "dropped warning";
+    for (int i = 0; i < 10; ++i)
+        LOG_ERROR << "kept error";
+
+    std::vector<std::string> steps = transitions();
+    CHECK(steps.size() == 3);
+    CHECK(steps.size() == 3 && contains(steps[0], " W ") && contains(steps[0], "degraded to sample mode"));
+    CHECK(steps.size() == 3 && contains(steps[1], "degraded to warning mode"));
+    CHECK(steps.size() == 3 && contains(steps[2], "degraded to error mode"));
+    CHECK(countRecords("dropped warning") == 0);
+    CHECK(countRecords("kept error") == 10);
+
+    LoggerStream::Stats stats = LoggerStream::stats();
+    CHECK(stats.degradeMode == LoggerStream::ErrorMode);
+    CHECK(stats.degradeTransitions == 3);
+    CHECK(stats.degraded > 0);
+
+    LoggerStream::disableDegradation();
+    CHECK(LoggerStream::degradeMode() == LoggerStream::NormalMode);
+    LOG_INFO << "enabled again";
+    CHECK(countRecords("enabled again") == 1);
+}
+
+//! Calm intervals step back to NormalMode, the last transition reports the dropped records.
+LOGGER_TEST(degradeRecovery)
+{
+    LoggerStream::setOutputHandler(slowHandler);
+    LoggerStream::DegradeOptions options = fastOptions();
+    options.recovery = 2;
+    options.maxMode = LoggerStream::WarningMode;
+    LoggerStream::setDegradation(options);
+    delayMs = 10;
+
+    CHECK(logUntil(LoggerStream::WarningMode));
+    delayMs = 0;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (LoggerStream::degradeMode() != LoggerStream::NormalMode &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        LOG_INFO << "calm";
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(LoggerStream::degradeMode() == LoggerStream::NormalMode);
+
+    std::vector<std::string> steps = transitions();
+    CHECK(steps.size() >= 3);
+    CHECK(!steps.empty() && contains(steps.back(), "recovered to normal mode"));
+    CHECK(!steps.empty() && numberAfter(steps.back(), "normal mode: ") >= 0);
+
+    LoggerStream::Stats stats = LoggerStream::stats();
+    CHECK(stats.degradeMode == LoggerStream::NormalMode);
+    CHECK(stats.degradeTransitions == steps.size());
+
+    size_t before = countRecords(" after");
+    for (int i = 0; i < 10; ++i)
+        LOG_INFO << "after";
+    CHECK(countRecords(" after") == before + 10);
+}
+
+//! SampleMode writes one of sampleRate Debug and Info records and every Warning,
+//! maxMode bounds the steps.
+LOGGER_TEST(degradeSample)
+{
+    LoggerStream::setOutputHandler(slowHandler);
+    LoggerStream::DegradeOptions options = fastOptions();
+    options.sampleRate = 4;
+    options.maxMode = LoggerStream::SampleMode;
+    LoggerStream::setDegradation(options);
+    delayMs = 10;
+
+    CHECK(logUntil(LoggerStream::SampleMode));
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    while (std::chrono::steady_clock::now() < end)
+        LOG_INFO << "storm";
+    CHECK(LoggerStream::degradeMode() == LoggerStream::SampleMode);
+    delayMs = 0;
+
+    for (int i = 0; i < 400; ++i)
+        LOG_INFO << "sampled";
+    for (int i = 0; i < 10; ++i)
+        LOG_WARNING << "warning";
+
+    CHECK(countRecords("sampled") == 100);
+    CHECK(countRecords(" warning") == 10);
+    CHECK(transitions().size() == 1);
+}
+
+//! A filled asynchronous queue takes a step without slow writes.
+LOGGER_TEST(degradeQueue)
+{
+    LoggerStream::setOutputHandler(slowHandler);
+    LoggerStream::DegradeOptions options = fastOptions();
+    options.latency = std::chrono::hours(1);
+    options.queuePercent = 50;
+    LoggerStream::setDegradation(options);
+    LoggerStream::setAsync(4096);
+    delayMs = 2;
+
+    CHECK(logUntil(LoggerStream::SampleMode));
+    delayMs = 0;
+    LoggerStream::flush();
+    LoggerStream::setSync();
+
+    std::vector<std::string> steps = transitions();
+    CHECK(!steps.empty() && contains(steps[0], "degraded to sample mode: write latency "));
+    CHECK(!steps.empty() && numberAfter(steps[0], "queue ") >= 50);
+}
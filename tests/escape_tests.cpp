@@ -0,0 +1,116 @@
+#include "logger_test.h"
+#include "logger_escape.h"
+
+#include <stdio.h>
+
+namespace
+{
+    //! Escapes byte by byte.
+    std::string reference(const std::string &s)
+    {
+        std::string out;
+        for (unsigned char c : s)
+        {
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            case '\b':
+                out += "\\b";
+                break;
+            case '\f':
+                out += "\\f";
+                break;
+            default:
+                if (c < 0x20)
+                {
+                    char code[8];
+                    snprintf(code, sizeof(code), "\\u%04x", c);
+                    out += code;
+                }
+                else
+                {
+                    out += char(c);
+                }
+                break;
+            }
+        }
+        return out;
+    }
+
+    void checkEscaped(const std::string &s)
+    {
+        std::string out = "prefix";
+        appendEscaped(out, s);
+        CHECK(out == "prefix" + reference(s));
+        CHECK(needsEscaping(s) == (reference(s) != s));
+    }
+}
+
+//! Every byte value at every position of the vector blocks and the tail.
+LOGGER_TEST(escapePositions)
+{
+    for (size_t length = 0; length <= 100; ++length)
+    {
+        std::string clean(length, 'a');
+        checkEscaped(clean);
+
+        for (size_t position = 0; position < length; ++position)
+        {
+            for (int c = 0; c < 256; ++c)
+            {
+                std::string s = clean;
+                s[position] = char(c);
+                checkEscaped(s);
+            }
+        }
+    }
+}
+
+//! Long strings with several specials and UTF-8 sequences.
+LOGGER_TEST(escapeLong)
+{
+    std::string s;
+    for (int i = 0; i < 10000; ++i)
+    {
+        s += "text \xd0\xbf\xd1\x80\xd0\xb8 ";
+        if (i % 7 == 0)
+            s += '"';
+        if (i % 11 == 0)
+            s += "\\\n";
+        if (i % 13 == 0)
+            s += char(i % 32);
+    }
+    checkEscaped(s);
+    checkEscaped(std::string(100000, 'x'));
+    checkEscaped(std::string(100000, '\n'));
+}
+
+//! Quoted arguments stay on one line, the same in binary mode.
+LOGGER_TEST(escapeQuoted)
+{
+    captureRecords();
+    const std::string value = "line\n\"quoted\" \\ end";
+
+    LOG_INFO.quote() << value << 42;
+    LoggerStream::setBinaryMode(true);
+    LOG_INFO.quote() << value << 42;
+
+    std::vector<TestRecord> records = captured();
+    CHECK(records.size() == 2);
+    for (const TestRecord &record : records)
+        CHECK(record.message == " \"line\\n\\\"quoted\\\" \\\\ end\" \"42\"");
+}
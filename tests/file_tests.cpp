@@ -0,0 +1,153 @@
+#include "logger_test.h"
+
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    //! Logs records "thread T seq N end" from four threads, some with borrowed strings,
+    //! and checks that the file holds all of them whole.
+    void checkConcurrentWrites(LoggerStream::SinkKind kind, const char *name)
+    {
+        std::string path = tempPath(name);
+        LoggerStream::setLogFileName(path, kind);
+        LoggerStream::setStreamingThreshold(1000);
+
+        const long count = 5000;
+        const std::string large(3000, 'l');
+        std::vector<std::thread> threads;
+        for (long t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([t, &large] {
+                for (long i = 0; i < count; ++i)
+                {
+                    if (i % 10 == 0)
+                        LOG_INFO << "thread" << t << "seq" << i << large << "end";
+                    else
+                        LOG_INFO << "thread" << t << "seq" << i << "end";
+                }
+            });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+
+        closeLogFile();
+
+        std::vector<std::string> lines = readLines(path);
+        CHECK(lines.size() == size_t(count * 4));
+
+        std::vector<long> next(4, 0);
+        for (const std::string &line : lines)
+        {
+            long thread = numberAfter(line, "thread ");
+            CHECK(thread >= 0 && thread < 4);
+            if (thread < 0 || thread >= 4)
+                continue;
+            CHECK(numberAfter(line, " seq ") == next[thread]++);
+            CHECK(line.compare(line.size() - 4, 4, " end") == 0);
+        }
+        unlink(path.c_str());
+    }
+}
+
+LOGGER_TEST(fdSink)
+{
+    checkConcurrentWrites(LoggerStream::FdSink, "fd");
+}
+
+//! Records are appended after writes of other descriptors.
+LOGGER_TEST(fdSinkAppend)
+{
+    std::string path = tempPath("append");
+    LoggerStream::setLogFileName(path, LoggerStream::FdSink);
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+    CHECK(fd >= 0);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        LOG_INFO << "logger" << i;
+        std::string line = "other " + std::to_string(i) + "\n";
+        CHECK(write(fd, line.data(), line.size()) == ssize_t(line.size()));
+    }
+    close(fd);
+    closeLogFile();
+
+    std::vector<std::string> lines = readLines(path);
+    CHECK(lines.size() == 200);
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        if (i % 2 == 0)
+            CHECK(numberAfter(lines[i], "logger ") == long(i / 2));
+        else
+            CHECK(lines[i] == "other " + std::to_string(i / 2));
+    }
+    unlink(path.c_str());
+}
+
+//! Falls back to the descriptor if io_uring is not available.
+LOGGER_TEST(uringSink)
+{
+    checkConcurrentWrites(LoggerStream::UringSink, "uring");
+}
+
+//! The file is truncated to the written records when it is closed.
+LOGGER_TEST(mmapSink)
+{
+    checkConcurrentWrites(LoggerStream::MmapSink, "mmap");
+
+    std::string path = tempPath("mmapsize");
+    LoggerStream::setLogFileName(path, LoggerStream::MmapSink);
+    LOG_INFO << "record";
+    closeLogFile();
+
+    std::vector<std::string> lines = readLines(path);
+    CHECK(lines.size() == 1);
+    struct stat st;
+    CHECK(stat(path.c_str(), &st) == 0);
+    CHECK(size_t(st.st_size) == lines[0].size() + 1);
+    unlink(path.c_str());
+}
+
+//! A record without space in the file goes whole to stderr, the file gets an empty line.
+LOGGER_TEST(mmapSinkNoSpace)
+{
+    std::string path = tempPath("nospace");
+    std::string errors = tempPath("stderr");
+    int fd = open(errors.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    CHECK(fd >= 0);
+    fflush(stderr);
+    int saved = dup(2);
+    dup2(fd, 2);
+    close(fd);
+
+    // the first chunk can't be allocated, only writes by the descriptor fit
+    signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit = {1 << 20, 1 << 20};
+    CHECK(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+    LoggerStream::setLogFileName(path, LoggerStream::MmapSink);
+    LOG_INFO << "first" << std::string(100, 'x') << "end";
+    LOG_INFO << "second";
+    closeLogFile();
+
+    fflush(stderr);
+    dup2(saved, 2);
+    close(saved);
+
+    std::vector<std::string> lines = readLines(errors);
+    CHECK(lines.size() == 2);
+    CHECK(lines.size() == 2 && contains(lines[0], " first ") && contains(lines[0], " end"));
+    CHECK(lines.size() == 2 && contains(lines[1], " second"));
+
+    std::vector<std::string> blanks = readLines(path);
+    CHECK(blanks.size() == 2);
+    for (const std::string &line : blanks)
+        CHECK(line.find_first_not_of(' ') == std::string::npos);
+    unlink(path.c_str());
+    unlink(errors.c_str());
+}
@@ -0,0 +1,112 @@
+#include "logger_test.h"
+
+#include <thread>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    size_t countContaining(const std::vector<std::string> &lines, const char *part)
+    {
+        size_t count = 0;
+        for (const std::string &line : lines)
+            count += contains(line, part) ? 1 : 0;
+        return count;
+    }
+}
+
+//! A dump writes the last filtered records of every thread once, in the timestamp order.
+LOGGER_TEST(flightDump)
+{
+    std::string path = tempPath("flight");
+    LoggerStream::setLogFileName(path);
+    LoggerStream::setSeverityLevel(LoggerStream::Info);
+    LoggerStream::setFlightRecorder(100);
+    CHECK(LoggerStream::isEnabled(LoggerStream::Debug));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; ++t)
+    {
+        threads.emplace_back([t] {
+            for (int i = 0; i < 300; ++i)
+                LOG_DEBUG << "thread" << t << "seq" << i;
+            LOG_INFO << "written" << t;
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    LoggerStream::flush();
+    std::vector<std::string> lines = readLines(path);
+    CHECK(lines.size() == 2);
+    CHECK(countContaining(lines, " D [") == 0);
+
+    LoggerStream::dumpFlightRecorder();
+    LoggerStream::dumpFlightRecorder();
+    closeLogFile();
+
+    lines = readLines(path);
+    CHECK(lines.size() == 202);
+    std::vector<long> next = {200, 200};
+    std::string previous;
+    for (size_t i = 2; i < lines.size(); ++i)
+    {
+        const std::string &line = lines[i];
+        CHECK(contains(line, " D ["));
+        long t = numberAfter(line, "thread ");
+        CHECK(t == 0 || t == 1);
+        if (t != 0 && t != 1)
+            continue;
+        CHECK(numberAfter(line, " seq ") == next[t]++);
+        // the header starts with the time, equal dates compare as strings
+        CHECK(previous.compare(0, 23, line, 0, 23) <= 0 || previous.empty());
+        previous = line;
+    }
+    unlink(path.c_str());
+}
+
+LOGGER_TEST(flightTruncate)
+{
+    std::string path = tempPath("truncate");
+    LoggerStream::setLogFileName(path);
+    LoggerStream::setSeverityLevel(LoggerStream::Info);
+    LoggerStream::setFlightRecorder(10, LoggerStream::Debug, 64);
+
+    LOG_DEBUG << std::string(1000, 'x');
+    LoggerStream::dumpFlightRecorder();
+    closeLogFile();
+
+    std::vector<std::string> lines = readLines(path);
+    CHECK(lines.size() == 1);
+    CHECK(lines.size() == 1 && lines[0].size() == 64);
+    unlink(path.c_str());
+}
+
+//! A fatal signal dumps the recorder and kills the process by the signal.
+LOGGER_TEST(flightSignal)
+{
+    std::string path = tempPath("signal");
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        LoggerStream::setLogFileName(path, LoggerStream::FdSink);
+        LoggerStream::setSeverityLevel(LoggerStream::Error);
+        LoggerStream::setFlightRecorder(10);
+        for (int i = 0; i < 20; ++i)
+            LOG_INFO << "before crash" << i;
+        raise(SIGSEGV);
+        _exit(0);
+    }
+
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+
+    std::vector<std::string> lines = readLines(path);
+    CHECK(lines.size() == 10);
+    CHECK(lines.size() == 10 && numberAfter(lines[0], "before crash ") == 10);
+    CHECK(lines.size() == 10 && numberAfter(lines[9], "before crash ") == 19);
+    unlink(path.c_str());
+}
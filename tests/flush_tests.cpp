@@ -0,0 +1,70 @@
+#include "logger_test.h"
+
+#include <chrono>
+#include <thread>
+
+#include <unistd.h>
+
+typedef LoggerStream::FlushPolicy FlushPolicy;
+
+LOGGER_TEST(flushOnLevel)
+{
+    std::string path = tempPath("level");
+    LoggerStream::setLogFileName(path);
+    LoggerStream::setFlushPolicy(FlushPolicy::onLevel(LoggerStream::Warning));
+
+    LOG_INFO << "buffered";
+    CHECK(readLines(path).empty());
+    LOG_WARNING << "flushing";
+    CHECK(readLines(path).size() == 2);
+
+    // Error records are flushed by every policy
+    LoggerStream::setFlushPolicy(FlushPolicy::bufferBytes(1 << 20));
+    LOG_INFO << "buffered";
+    LOG_ERROR << "error";
+    CHECK(readLines(path).size() == 4);
+
+    LOG_INFO << "buffered";
+    LoggerStream::flush();
+    CHECK(readLines(path).size() == 5);
+    unlink(path.c_str());
+}
+
+LOGGER_TEST(flushOnBytes)
+{
+    std::string path = tempPath("bytes");
+    LoggerStream::setLogFileName(path);
+    LoggerStream::setFlushPolicy(FlushPolicy::bufferBytes(1000));
+
+    uint64_t flushes = LoggerStream::stats().flushes;
+    // records of about 50 bytes
+    for (int i = 0; i < 10; ++i)
+        LOG_INFO << "record" << i;
+    CHECK(readLines(path).empty());
+
+    for (int i = 10; i < 30; ++i)
+        LOG_INFO << "record" << i;
+    CHECK(readLines(path).size() >= 19);
+    CHECK(LoggerStream::stats().flushes - flushes == 1);
+    unlink(path.c_str());
+}
+
+LOGGER_TEST(flushOnInterval)
+{
+    std::string path = tempPath("interval");
+    LoggerStream::setLogFileName(path);
+    LoggerStream::setFlushPolicy(FlushPolicy::interval(50) | FlushPolicy::onLevel(LoggerStream::Error));
+
+    LOG_INFO << "first";
+    LOG_INFO << "second";
+    CHECK(readLines(path).empty());
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    LOG_INFO << "third";
+    CHECK(readLines(path).size() == 3);
+
+    // every record is flushed again
+    LoggerStream::setFlushPolicy(FlushPolicy::everyMessage());
+    LOG_DEBUG << "fourth";
+    CHECK(readLines(path).size() == 4);
+    unlink(path.c_str());
+}
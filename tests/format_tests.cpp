@@ -0,0 +1,116 @@
+#include "logger_test.h"
+
+#include <string>
+
+namespace
+{
+    enum class Color
+    {
+        Red,
+        Green
+    };
+
+    void logFormats()
+    {
+        std::string name = "disk";
+        LOG_INFO_F("user {} took {} ms", 42, 3.5);
+        LOG_INFO_F("{} {} {} {}", name, std::string_view("view"), true, 'c');
+        LOG_WARNING_F("mask {:x} ratio {:.2}", 255u, 0.125);
+        LOG_ERROR_F("{{literal}} {} {{{}}}", -7L, Color::Green);
+        LOG_INFO_F("no arguments");
+    }
+
+    std::vector<std::string> messages()
+    {
+        std::vector<std::string> result;
+        for (const TestRecord &record : captured())
+            result.push_back(record.message);
+        return result;
+    }
+
+    int evaluations = 0;
+
+    int evaluate()
+    {
+        return ++evaluations;
+    }
+}
+
+//! Placeholders are replaced by the arguments in order, specs and escaped braces apply.
+//! Doubles are written like by operator <<.
+LOGGER_TEST(formatPlaceholders)
+{
+    captureRecords();
+    logFormats();
+
+    std::vector<std::string> all = messages();
+    CHECK(all.size() == 5);
+    if (all.size() != 5)
+        return;
+
+    // separated from the header like the first argument of operator <<
+    CHECK(all[0] == " user 42 took 3.500000 ms");
+    CHECK(all[1] == " disk view true c");
+    CHECK(all[2] == " mask ff ratio 0.12" || all[2] == " mask ff ratio 0.13");
+    CHECK(all[3] == " {literal} -7 {1}");
+    CHECK(all[4] == " no arguments");
+}
+
+//! Arguments of a disabled level are not evaluated.
+LOGGER_TEST(formatLevel)
+{
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::setSeverityLevel(LoggerStream::Warning);
+
+    LOG_INFO_F("value {}", evaluate());
+    LOG_DEBUG_F("value {}", evaluate());
+    LOG_WARNING_F("value {}", evaluate());
+
+    CHECK(evaluations == 1);
+    std::vector<std::string> records = collected();
+    CHECK(records.size() == 1);
+    CHECK(records.size() == 1 && contains(records[0], " W ") && contains(records[0], "value 1"));
+}
+
+//! Binary mode and the asynchronous queue decode to the message formatted at once.
+LOGGER_TEST(formatBinary)
+{
+    captureRecords();
+    logFormats();
+    std::vector<std::string> text = messages();
+
+    LoggerStream::setBinaryMode(true);
+    logFormats();
+    LoggerStream::setAsync(1 << 16);
+    logFormats();
+    LoggerStream::setSync();
+
+    std::vector<std::string> all = messages();
+    CHECK(all.size() == text.size() * 3);
+    if (all.size() != text.size() * 3)
+        return;
+
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        CHECK(all[text.size() + i] == text[i]);
+        CHECK(all[text.size() * 2 + i] == text[i]);
+    }
+}
+
+//! Formatted messages are escaped as the msg field of logfmt and JSON records.
+LOGGER_TEST(formatStructured)
+{
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::setOutputFormat(LoggerStream::LogfmtFormat);
+    LOG_INFO_F("name \"{}\" {}", "quoted", 5);
+    LoggerStream::setOutputFormat(LoggerStream::JsonFormat);
+    LOG_INFO_F("name \"{}\" {}", "quoted", 5);
+
+    std::vector<std::string> records = collected();
+    CHECK(records.size() == 2);
+    if (records.size() != 2)
+        return;
+
+    CHECK(contains(records[0], "msg=\"name \\\"quoted\\\" 5\""));
+    CHECK(contains(records[1], "\"msg\":\"name \\\"quoted\\\" 5\""));
+}
@@ -0,0 +1,61 @@
+#include "logger_test.h"
+
+#include <chrono>
+#include <thread>
+
+#include <unistd.h>
+
+namespace
+{
+    void checkHeaders(const std::vector<TestRecord> &records)
+    {
+        std::string pid = " [" + std::to_string(getpid());
+        for (const TestRecord &record : records)
+        {
+            const char levels[] = "DIWEF";
+            std::string expected = headerTime(record.time) + " " + levels[record.level] + pid;
+            CHECK(record.header.compare(0, expected.size(), expected) == 0);
+        }
+    }
+}
+
+//! Cached headers follow the time across seconds.
+LOGGER_TEST(headerTime)
+{
+    captureRecords();
+
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(1100);
+    long count = 0;
+    while (std::chrono::steady_clock::now() < end)
+    {
+        LOG_INFO << "record" << count++;
+        LOG_WARNING << "record" << count++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    std::vector<TestRecord> records = captured();
+    CHECK(records.size() == size_t(count));
+    CHECK(records.front().time / 1000000 != records.back().time / 1000000);
+    checkHeaders(records);
+}
+
+//! Every thread keeps its own cache.
+LOGGER_TEST(headerThreads)
+{
+    captureRecords();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([t] {
+            for (int i = 0; i < 2000; ++i)
+                LoggerStream(LoggerStream::Level((t + i) % LoggerStream::Fatal)) << "thread" << t << i;
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    std::vector<TestRecord> records = captured();
+    CHECK(records.size() == 8000);
+    checkHeaders(records);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "logger.h"
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+ * Test harness of the logger. Tests are registered by LOGGER_TEST and run one per process
+ * by `logger_tests <name>`, since the settings of the logger are global. Every name is
+ * added to LOGGER_TESTS in CMakeLists.txt.
+ */
+
+typedef void (*LoggerTestFunction)();
+
+//! Registers a test, see LOGGER_TEST.
+struct LoggerTestRegistration
+{
+    LoggerTestRegistration(const char *name, LoggerTestFunction function);
+};
+
+#define LOGGER_TEST(name) \
+    static void name(); \
+    static LoggerTestRegistration name##Registration(#name, name); \
+    static void name()
+
+//! Counts a failure, the test goes on.
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) \
+            testFailed(__FILE__, __LINE__, #condition); \
+    } while (0)
+
+void testFailed(const char *file, int line, const char *condition);
+
+//! Records written by collect(), guarded by testMutex.
+extern std::mutex testMutex;
+extern std::vector<std::string> testRecords;
+
+//! Output handler keeping the records in testRecords.
+void collect(LoggerStream::Level level, const char *s);
+
+//! Returns a copy of testRecords.
+std::vector<std::string> collected();
+
+//! Record received by the record handler set by captureRecords().
+struct TestRecord
+{
+    LoggerStream::Level level;
+    uint64_t time;
+    uint32_t threadId;
+    std::string header;
+    std::string message;
+};
+
+//! Sets a record handler keeping the records, they are returned by captured().
+void captureRecords();
+std::vector<TestRecord> captured();
+
+//! Returns the local date and time of the header for \a time in microseconds since the epoch,
+//! with \a digits of fractions of a second.
+std::string headerTime(uint64_t time, int digits = 3);
+
+//! Returns the number following \a key in \a record, or -1.
+long numberAfter(const std::string &record, const char *key);
+
+//! Returns a path in the temporary directory unique to the process, the file is removed.
+std::string tempPath(const char *name);
+
+//! Closes the log file, records go to a removed file afterwards.
+void closeLogFile();
+
+//! Returns the lines of the file \a path.
+std::vector<std::string> readLines(const std::string &path);
+
+//! Returns true if \a s contains \a part.
+inline bool contains(const std::string &s, const char *part)
+{
+    return s.find(part) != std::string::npos;
+}
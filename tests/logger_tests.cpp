@@ -0,0 +1,135 @@
+#include "logger_test.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+#include <unistd.h>
+
+namespace
+{
+    int failures = 0;
+
+    std::map<std::string, LoggerTestFunction> &registry()
+    {
+        static std::map<std::string, LoggerTestFunction> tests;
+        return tests;
+    }
+}
+
+std::mutex testMutex;
+std::vector<std::string> testRecords;
+
+namespace
+{
+    std::vector<TestRecord> capturedRecords;
+
+    void keepRecord(const LoggerStream::Record &record, void *)
+    {
+        std::string_view text = record.text;
+        std::lock_guard<std::mutex> lock(testMutex);
+        capturedRecords.push_back(TestRecord{record.level, record.time, record.threadId,
+                                             std::string(text.substr(0, record.headerSize)),
+                                             std::string(record.message())});
+    }
+}
+
+LoggerTestRegistration::LoggerTestRegistration(const char *name, LoggerTestFunction function)
+{
+    registry()[name] = function;
+}
+
+void testFailed(const char *file, int line, const char *condition)
+{
+    fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, condition);
+    ++failures;
+}
+
+void collect(LoggerStream::Level, const char *s)
+{
+    std::lock_guard<std::mutex> lock(testMutex);
+    testRecords.emplace_back(s);
+}
+
+std::vector<std::string> collected()
+{
+    std::lock_guard<std::mutex> lock(testMutex);
+    return testRecords;
+}
+
+void captureRecords()
+{
+    LoggerStream::setRecordHandler(keepRecord);
+}
+
+std::vector<TestRecord> captured()
+{
+    std::lock_guard<std::mutex> lock(testMutex);
+    return capturedRecords;
+}
+
+std::string headerTime(uint64_t time, int digits)
+{
+    time_t second = time_t(time / 1000000);
+    struct tm tm;
+    localtime_r(&second, &tm);
+
+    char text[64];
+    strftime(text, sizeof(text), "%d.%m.%Y %H:%M:%S", &tm);
+
+    std::string fraction = std::to_string(time % 1000000 + 1000000).substr(1);
+    fraction.resize(std::min(digits, 6));
+    return std::string(text) + "." + fraction;
+}
+
+long numberAfter(const std::string &record, const char *key)
+{
+    size_t position = record.find(key);
+    return position == std::string::npos ? -1 : strtol(record.c_str() + position + strlen(key), nullptr, 10);
+}
+
+std::string tempPath(const char *name)
+{
+    std::string path = "/tmp/logger_tests." + std::to_string(getpid()) + "." + name;
+    unlink(path.c_str());
+    return path;
+}
+
+void closeLogFile()
+{
+    std::string path = tempPath("closed");
+    LoggerStream::setLogFileName(path);
+    unlink(path.c_str());
+}
+
+std::vector<std::string> readLines(const std::string &path)
+{
+    std::vector<std::string> lines;
+    std::ifstream file(path);
+    for (std::string line; std::getline(file, line);)
+        lines.push_back(line);
+    return lines;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        for (const auto &test : registry())
+            printf("%s\n", test.first.c_str());
+        return 0;
+    }
+
+    auto test = registry().find(argv[1]);
+    if (test == registry().end())
+    {
+        fprintf(stderr, "unknown test '%s'\n", argv[1]);
+        return 2;
+    }
+
+    test->second();
+    return failures == 0 ? 0 : 1;
+}
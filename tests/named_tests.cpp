@@ -0,0 +1,83 @@
+#include "logger_test.h"
+
+namespace
+{
+    int evaluated = 0;
+
+    int evaluate()
+    {
+        return ++evaluated;
+    }
+}
+
+//! Levels are inherited by dotted names until a logger gets its own level.
+LOGGER_TEST(namedLevels)
+{
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::setSeverityLevel(LoggerStream::Warning);
+
+    Logger net("net");
+    Logger tcp("net.tcp");
+    Logger udp("net.udp");
+    Logger other("network");
+    CHECK(tcp.name() == "net.tcp");
+
+    // loggers without a level follow the severity level
+    CHECK(!tcp.isEnabled(LoggerStream::Info));
+    CHECK(tcp.isEnabled(LoggerStream::Warning));
+
+    Logger::setLevel("net", LoggerStream::Debug);
+    CHECK(net.isEnabled(LoggerStream::Debug));
+    CHECK(tcp.isEnabled(LoggerStream::Debug));
+    CHECK(udp.isEnabled(LoggerStream::Debug));
+    CHECK(!other.isEnabled(LoggerStream::Debug));
+
+    Logger::setLevel("net.udp", LoggerStream::Error);
+    CHECK(!udp.isEnabled(LoggerStream::Warning));
+    Logger::setLevel("net", LoggerStream::Info);
+    CHECK(!tcp.isEnabled(LoggerStream::Debug));
+    CHECK(tcp.isEnabled(LoggerStream::Info));
+    CHECK(!udp.isEnabled(LoggerStream::Warning));
+
+    Logger::resetLevel("net.udp");
+    CHECK(udp.isEnabled(LoggerStream::Info));
+    Logger::resetLevel("net");
+    CHECK(!tcp.isEnabled(LoggerStream::Info));
+    LoggerStream::setSeverityLevel(LoggerStream::Debug);
+    CHECK(tcp.isEnabled(LoggerStream::Debug));
+
+    // a logger created later finds the levels of its ancestors
+    Logger::setLevel("late", LoggerStream::Error);
+    Logger late("late.child.leaf");
+    CHECK(!late.isEnabled(LoggerStream::Warning));
+    CHECK(late.isEnabled(LoggerStream::Error));
+}
+
+//! Records of a named logger pass its level, not the level of the log file, and carry the name.
+LOGGER_TEST(namedRecords)
+{
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::setSeverityLevel(LoggerStream::Error);
+
+    Logger tcp("net.tcp");
+    Logger::setLevel("net", LoggerStream::Debug);
+
+    LOG_DEBUG_TO(tcp) << "connected" << 7;
+    LOG_DEBUG << "unnamed";
+    tcp.info() << "info";
+
+    Logger::setLevel("net", LoggerStream::Error);
+    LOG_WARNING_TO(tcp) << "skipped" << evaluate();
+    CHECK(evaluated == 0);
+
+    std::vector<std::string> records = collected();
+    CHECK(records.size() == 2);
+    CHECK(records.size() == 2 && contains(records[0], " D ["));
+    CHECK(records.size() == 2 && contains(records[0], " net.tcp: connected 7"));
+    CHECK(records.size() == 2 && contains(records[1], " net.tcp: info"));
+
+    LoggerStream::setOutputFormat(LoggerStream::JsonFormat);
+    LOG_ERROR_TO(tcp) << "json";
+    records = collected();
+    CHECK(records.size() == 3 && contains(records[2], "\"logger\":\"net.tcp\""));
+}
@@ -0,0 +1,178 @@
+#include "logger_test.h"
+
+#include <chrono>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    //! Binds a socket of \a type to a free port of the loopback, returns "127.0.0.1:port".
+    std::string bindLoopback(int fd)
+    {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t size = sizeof(addr);
+        if (bind(fd, reinterpret_cast<sockaddr *>(&addr), size) != 0 ||
+            getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &size) != 0)
+            return std::string();
+        return "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    }
+
+    //! Returns the datagrams received within \a ms milliseconds after the last one.
+    std::vector<std::string> receive(int fd, int ms)
+    {
+        std::vector<std::string> datagrams;
+        char buffer[65536];
+        pollfd p = {fd, POLLIN, 0};
+        while (poll(&p, 1, ms) == 1)
+        {
+            ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+            if (size < 0)
+                break;
+            datagrams.emplace_back(buffer, size_t(size));
+        }
+        return datagrams;
+    }
+
+    uint64_t nowUs()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    //! Returns the timestamp of a syslog header in microseconds, or 0.
+    uint64_t syslogTime(const std::string &datagram)
+    {
+        tm parts = {};
+        unsigned micros = 0;
+        size_t start = datagram.find(">1 ");
+        if (start == std::string::npos ||
+            sscanf(datagram.c_str() + start + 3, "%d-%d-%dT%d:%d:%d.%6uZ", &parts.tm_year, &parts.tm_mon,
+                   &parts.tm_mday, &parts.tm_hour, &parts.tm_min, &parts.tm_sec, &micros) != 7)
+            return 0;
+        parts.tm_year -= 1900;
+        parts.tm_mon -= 1;
+        return uint64_t(timegm(&parts)) * 1000000 + micros;
+    }
+
+    //! Sink stalling the writer thread on records containing "slow".
+    class SlowSink : public LoggerStream::Sink
+    {
+    public:
+        void write(LoggerStream::Level, const char *s, std::size_t size) override
+        {
+            if (std::string(s, size).find(" slow") != std::string::npos)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        }
+    };
+}
+
+LOGGER_TEST(networkDatagrams)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    std::string address = bindLoopback(fd);
+    CHECK(!address.empty());
+
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::NetworkOptions options;
+    options.address = address;
+    std::shared_ptr<LoggerStream::Sink> sink = LoggerStream::networkSink(options);
+    LoggerStream::addSink(sink);
+
+    for (int i = 0; i < 100; ++i)
+        LOG_INFO << "record" << i;
+    LoggerStream::flush();
+
+    std::vector<std::string> datagrams = receive(fd, 500);
+    std::vector<std::string> records = collected();
+    CHECK(datagrams.size() == 100);
+    for (size_t i = 0; i < datagrams.size() && i < records.size(); ++i)
+        CHECK(datagrams[i] == records[i]);
+    CHECK(LoggerStream::stats().networkSent == 100);
+
+    LoggerStream::removeSink(sink);
+    close(fd);
+}
+
+//! Syslog headers carry the time of the record, not the time of sending.
+LOGGER_TEST(networkRecordTime)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    std::string address = bindLoopback(fd);
+
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::addSink(std::make_shared<SlowSink>());
+    LoggerStream::NetworkOptions options;
+    options.address = address;
+    options.framing = LoggerStream::SyslogFraming;
+    std::shared_ptr<LoggerStream::Sink> sink = LoggerStream::networkSink(options);
+    LoggerStream::addSink(sink);
+
+    LoggerStream::setAsync(1 << 16);
+    LOG_INFO << "slow";
+    uint64_t created = nowUs();
+    LOG_INFO << "timed";
+    LoggerStream::setSync();
+    LoggerStream::flush();
+
+    std::vector<std::string> datagrams = receive(fd, 500);
+    CHECK(datagrams.size() == 2);
+    if (datagrams.size() == 2)
+    {
+        CHECK(contains(datagrams[1], " timed"));
+        uint64_t time = syslogTime(datagrams[1]);
+        CHECK(time + 100000 > created && time < created + 100000);
+    }
+
+    LoggerStream::removeSink(sink);
+    close(fd);
+}
+
+//! A collector which stops reading delays a logging thread once, later records go to the log file.
+LOGGER_TEST(networkBlockStall)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int small = 4096;
+    setsockopt(listener, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    std::string address = bindLoopback(listener);
+    CHECK(listen(listener, 16) == 0);
+
+    std::string path = tempPath("stall");
+    LoggerStream::setLogFileName(path, LoggerStream::FdSink);
+    LoggerStream::setSeverityLevel(LoggerStream::Fatal);
+
+    LoggerStream::NetworkOptions options;
+    options.transport = LoggerStream::TcpTransport;
+    options.address = address;
+    options.policy = LoggerStream::Block;
+    options.queueSize = 64 << 10;
+    options.batchInterval = 10;
+    std::shared_ptr<LoggerStream::Sink> sink = LoggerStream::networkSink(options);
+    LoggerStream::addSink(sink, LoggerStream::Info);
+
+    const std::string payload(1000, 'p');
+    std::chrono::steady_clock::duration longest {};
+    for (int i = 0; i < 20000; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        LOG_INFO << "record" << i << payload;
+        longest = std::max(longest, std::chrono::steady_clock::now() - start);
+    }
+
+    CHECK(longest < std::chrono::seconds(1));
+    CHECK(LoggerStream::stats().networkDropped > 0);
+
+    LoggerStream::removeSink(sink);
+    sink.reset();
+    closeLogFile();
+    CHECK(!readLines(path).empty());
+    unlink(path.c_str());
+    close(listener);
+}
@@ -0,0 +1,73 @@
+#include "logger_test.h"
+
+#include <cinttypes>
+#include <cstdarg>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    //! Returns the message of the only captured record without the leading space.
+    std::string lastMessage()
+    {
+        std::vector<TestRecord> records = captured();
+        std::string message = records.empty() ? std::string() : records.back().message;
+        return message.size() > 0 && message[0] == ' ' ? message.substr(1) : message;
+    }
+
+    std::string formatted(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+    std::string formatted(const char *format, ...)
+    {
+        char text[512];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        return text;
+    }
+}
+
+LOGGER_TEST(integers)
+{
+    captureRecords();
+
+    LOG_INFO << std::numeric_limits<int64_t>::min() << std::numeric_limits<uint64_t>::max() << 0 << -1;
+    CHECK(lastMessage() == formatted("%" PRId64 " %" PRIu64 " 0 -1", std::numeric_limits<int64_t>::min(),
+                                  std::numeric_limits<uint64_t>::max()));
+
+    LOG_INFO << short(-5) << (unsigned char)200 << true << false;
+    CHECK(lastMessage() == "-5 200 1 0");
+
+    LOG_INFO.hex() << 255 << 0xdeadbeefu << -16;
+    CHECK(lastMessage() == "ff deadbeef -10");
+
+    (LoggerStream(LoggerStream::Info).hex() << 16).dec() << 16;
+    CHECK(lastMessage() == "10 16");
+
+    // hex applies to its record only
+    LOG_INFO << 16;
+    CHECK(lastMessage() == "16");
+}
+
+LOGGER_TEST(floatingPoint)
+{
+    captureRecords();
+
+    LOG_INFO << 1.5 << -0.25f << 3.0;
+    CHECK(lastMessage() == "1.500000 -0.250000 3.000000");
+
+    LOG_INFO.precision(2) << 3.14159 << 2.005;
+    CHECK(lastMessage() == formatted("%.2f %.2f", 3.14159, 2.005));
+
+    LOG_INFO.precision(0) << 2.5 << 99.9;
+    CHECK(lastMessage() == formatted("%.0f %.0f", 2.5, 99.9));
+
+    // beyond the buffer, written as by std::to_string
+    LOG_INFO << 1e300;
+    CHECK(lastMessage() == std::to_string(1e300));
+
+    LOG_INFO << std::numeric_limits<double>::infinity() << -std::numeric_limits<double>::infinity()
+             << std::nan("");
+    CHECK(lastMessage() == "inf -inf nan");
+}
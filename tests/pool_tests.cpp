@@ -0,0 +1,85 @@
+#include "logger_test.h"
+
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+// counts allocations of every thread of logger_tests, only the tests below read them
+static thread_local size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++allocations;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+    void discard(LoggerStream::Level, const char *)
+    {
+    }
+
+    const std::string text(4096, 'x');
+    const size_t sizes[] = {16, 200, 1000, 4000};
+}
+
+//! Records up to the buffer limit and nested records are built without allocations
+//! once the pool is warm.
+LOGGER_TEST(poolAllocations)
+{
+    LoggerStream::setOutputHandler(discard);
+
+    for (size_t i = 0; i < 64; ++i)
+        LOG_INFO << std::string_view(text.data(), sizes[i % 4]) << i;
+
+    size_t before = allocations;
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        LoggerStream outer(LoggerStream::Info);
+        outer << std::string_view(text.data(), sizes[i % 4]) << 1.5 << i;
+        LOG_WARNING << "nested" << i;
+    }
+    CHECK(allocations == before);
+}
+
+LOGGER_TEST(poolReserve)
+{
+    LoggerStream::setOutputHandler(discard);
+    // applies to threads which didn't log yet
+    LoggerStream::setPoolReserve(2, 512, 8192);
+
+    std::thread([] {
+        LoggerStream::Stats before = LoggerStream::stats();
+        {
+            LoggerStream first(LoggerStream::Info);
+            LoggerStream second(LoggerStream::Info);
+            LoggerStream third(LoggerStream::Info);
+            first << "first";
+            second << "second";
+            third << "third";
+        }
+        LoggerStream::Stats after = LoggerStream::stats();
+        CHECK(after.poolHits - before.poolHits == 2);
+        CHECK(after.poolMisses - before.poolMisses == 1);
+
+        // a buffer grown over the limit is shrunk, it grows once for the next records
+        LOG_INFO << std::string(20000, 'l');
+        LOG_INFO << std::string_view(text.data(), 500);
+        size_t count = allocations;
+        for (int i = 0; i < 100; ++i)
+            LOG_INFO << std::string_view(text.data(), 500);
+        CHECK(allocations == count);
+    }).join();
+}
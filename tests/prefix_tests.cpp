@@ -0,0 +1,69 @@
+#include "logger_test.h"
+
+#include <atomic>
+#include <thread>
+
+LOGGER_TEST(prefixes)
+{
+    captureRecords();
+
+    LOG_INFO << "none";
+    LoggerStream::setApplicationPrefix("app ");
+    LoggerStream::setMessagePrefix("module");
+    LOG_INFO << "both";
+    LoggerStream::setApplicationPrefix("");
+    LOG_INFO << "message";
+
+    std::vector<TestRecord> records = captured();
+    CHECK(records.size() == 3);
+    if (records.size() != 3)
+        return;
+
+    CHECK(records[0].header.compare(0, 4, "app ") != 0);
+    CHECK(!contains(records[0].header, "module"));
+    CHECK(records[1].header.compare(0, 4, "app ") == 0);
+    CHECK(contains(records[1].header, "] module: "));
+    CHECK(records[2].header.compare(0, 4, "app ") != 0);
+    CHECK(contains(records[2].header, "] module: "));
+}
+
+//! Readers see whole snapshots while the prefixes change.
+LOGGER_TEST(prefixSnapshots)
+{
+    captureRecords();
+
+    std::atomic<bool> stop {false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&stop] {
+            for (int i = 0; i < 1000 || !stop.load(std::memory_order_relaxed); ++i)
+                LOG_INFO << "record";
+        });
+    }
+
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::string prefix(size_t(i % 50), char('a' + i % 26));
+        LoggerStream::setMessagePrefix(prefix);
+        LoggerStream::setApplicationPrefix(prefix);
+    }
+    stop.store(true);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    std::vector<TestRecord> records = captured();
+    CHECK(!records.empty());
+    for (const TestRecord &record : records)
+    {
+        // the message prefix is a run of one letter ended by ": "
+        size_t end = record.header.rfind(": ");
+        size_t start = record.header.find("] ");
+        CHECK(end != std::string::npos && start != std::string::npos && start + 2 <= end);
+        if (end == std::string::npos || start == std::string::npos || start + 2 > end)
+            continue;
+
+        std::string message = record.header.substr(start + 2, end - start - 2);
+        CHECK(message.find_first_not_of(message.empty() ? ' ' : message[0]) == std::string::npos);
+    }
+}
@@ -0,0 +1,120 @@
+#include "logger_test.h"
+
+#include <chrono>
+#include <thread>
+
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    size_t countContaining(const std::vector<std::string> &records, const char *part)
+    {
+        size_t count = 0;
+        for (const std::string &record : records)
+            count += contains(record, part) ? 1 : 0;
+        return count;
+    }
+}
+
+//! The count of suppressed records is written before the next record of the site.
+LOGGER_TEST(everyN)
+{
+    LoggerStream::setOutputHandler(collect);
+    for (int i = 0; i < 25; ++i)
+        LOG_EVERY_N(LoggerStream::Info, 10) << "record" << i;
+
+    std::vector<std::string> records = collected();
+    CHECK(records.size() == 5);
+    if (records.size() != 5)
+        return;
+    CHECK(numberAfter(records[0], "record ") == 0);
+    CHECK(contains(records[1], " suppressed 9 similar messages"));
+    CHECK(numberAfter(records[2], "record ") == 10);
+    CHECK(contains(records[3], " suppressed 9 similar messages"));
+    CHECK(numberAfter(records[4], "record ") == 20);
+    CHECK(LoggerStream::stats().suppressed == 22);
+
+    LoggerStream::writeSuppressed();
+    records = collected();
+    CHECK(records.size() == 6);
+    CHECK(records.size() == 6 && contains(records[5], " suppressed 4 similar messages at "));
+    CHECK(records.size() == 6 && contains(records[5], "rate_tests.cpp:"));
+}
+
+LOGGER_TEST(rateLimits)
+{
+    LoggerStream::setOutputHandler(collect);
+
+    // a burst, then one record per second
+    for (int i = 0; i < 10; ++i)
+        LOG_RATE_LIMIT(LoggerStream::Info, 1, 3) << "burst";
+    CHECK(countContaining(collected(), " burst") == 3);
+
+    for (int i = 0; i < 10; ++i)
+        LOG_EVERY_MS(LoggerStream::Info, 60000) << "interval";
+    CHECK(countContaining(collected(), " interval") == 1);
+
+    for (int i = 0; i < 10; ++i)
+        LOG_RATE_LIMIT(LoggerStream::Info, 0.5, 1) << "fraction";
+    CHECK(countContaining(collected(), " fraction") == 1);
+
+    for (int i = 0; i < 10; ++i)
+        LOG_RATE_LIMIT(LoggerStream::Info, 0, 1) << "never";
+    CHECK(countContaining(collected(), " never") == 0);
+    CHECK(LoggerStream::stats().suppressed == 7 + 9 + 9 + 10);
+
+    // a site suppressing everything is reported by writeSuppressed()
+    LoggerStream::writeSuppressed();
+    std::vector<std::string> records = collected();
+    CHECK(countContaining(records, " suppressed 10 similar messages at ") == 1);
+    CHECK(countContaining(records, " suppressed 9 similar messages at ") == 2);
+    CHECK(countContaining(records, " suppressed 7 similar messages at ") == 1);
+
+    size_t count = records.size();
+    LoggerStream::writeSuppressed();
+    CHECK(collected().size() == count);
+}
+
+//! The asynchronous writer reports suppressed records without a next record.
+LOGGER_TEST(suppressedAsync)
+{
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::setAsync(1 << 16);
+    for (int i = 0; i < 10; ++i)
+        LOG_EVERY_N(LoggerStream::Warning, 100) << "record";
+
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (countContaining(collected(), " suppressed 9 similar messages at ") == 0 &&
+           std::chrono::steady_clock::now() < end)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    LoggerStream::setSync();
+    CHECK(countContaining(collected(), " suppressed 9 similar messages at ") == 1);
+}
+
+//! Suppressed records are reported at exit.
+LOGGER_TEST(suppressedAtExit)
+{
+    std::string path = tempPath("exit");
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        LoggerStream::setLogFileName(path);
+        for (int i = 0; i < 10; ++i)
+            LOG_RATE_LIMIT(LoggerStream::Error, 0, 1) << "never";
+        exit(0);
+    }
+
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::vector<std::string> lines = readLines(path);
+    CHECK(lines.size() == 1);
+    CHECK(lines.size() == 1 && contains(lines[0], " E ["));
+    CHECK(lines.size() == 1 && contains(lines[0], " suppressed 10 similar messages at "));
+    unlink(path.c_str());
+}
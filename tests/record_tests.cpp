@@ -0,0 +1,110 @@
+#include "logger_test.h"
+
+#include <chrono>
+#include <thread>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    struct Context
+    {
+        std::mutex mutex;
+        std::vector<LoggerStream::Record> records;
+        std::vector<std::string> texts;
+    };
+
+    void keep(const LoggerStream::Record &record, void *context)
+    {
+        Context *c = static_cast<Context *>(context);
+        std::lock_guard<std::mutex> lock(c->mutex);
+        c->records.push_back(record);
+        c->texts.emplace_back(record.text);
+    }
+
+    uint64_t nowUs()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    uint32_t threadId()
+    {
+        return uint32_t(syscall(SYS_gettid));
+    }
+}
+
+//! The handler gets its context and replaces the output handler.
+LOGGER_TEST(recordHandler)
+{
+    Context context;
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::setRecordHandler(keep, &context);
+
+    uint64_t before = nowUs();
+    LOG_WARNING << "message" << 1;
+    uint64_t after = nowUs();
+    CHECK(collected().empty());
+    CHECK(context.records.size() == 1);
+    if (context.records.size() != 1)
+        return;
+
+    const LoggerStream::Record &record = context.records[0];
+    const std::string &text = context.texts[0];
+    CHECK(record.level == LoggerStream::Warning);
+    CHECK(record.time >= before && record.time <= after);
+    CHECK(record.threadId == threadId());
+    CHECK(record.headerSize < text.size());
+    CHECK(text.compare(record.headerSize, std::string::npos, " message 1") == 0);
+    CHECK(text.compare(0, 6, headerTime(record.time).substr(0, 6)) == 0);
+
+    LoggerStream::setRecordHandler(nullptr);
+    LOG_WARNING << "output";
+    CHECK(context.records.size() == 1);
+    CHECK(collected().size() == 1);
+}
+
+//! Asynchronous and binary records keep the thread id and the time of the caller.
+LOGGER_TEST(recordHandlerAsync)
+{
+    Context context;
+    LoggerStream::setRecordHandler(keep, &context);
+
+    for (int binary = 0; binary < 2; ++binary)
+    {
+        LoggerStream::setBinaryMode(binary != 0);
+        LoggerStream::setAsync(1 << 16);
+
+        std::vector<uint32_t> ids(4);
+        std::vector<std::thread> threads;
+        uint64_t before = nowUs();
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([t, &ids] {
+                ids[t] = threadId();
+                for (int i = 0; i < 100; ++i)
+                    LOG_INFO << "thread" << t << "seq" << i;
+            });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+        LoggerStream::setSync();
+        uint64_t after = nowUs();
+
+        std::lock_guard<std::mutex> lock(context.mutex);
+        CHECK(context.records.size() == 400);
+        for (size_t i = 0; i < context.records.size(); ++i)
+        {
+            const LoggerStream::Record &record = context.records[i];
+            std::string message = context.texts[i].substr(record.headerSize);
+            long t = numberAfter(message, "thread ");
+            CHECK(t >= 0 && t < 4);
+            CHECK(t >= 0 && t < 4 && record.threadId == ids[t]);
+            CHECK(record.time >= before && record.time <= after);
+            CHECK(message.compare(0, 8, " thread ") == 0);
+        }
+        context.records.clear();
+        context.texts.clear();
+    }
+}
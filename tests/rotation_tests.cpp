@@ -0,0 +1,104 @@
+#include "logger_test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <set>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    bool exists(const std::string &path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0;
+    }
+
+    //! Checks that every line is a whole record "thread T seq N" and collects them.
+    void readRecords(const std::string &path, std::set<std::pair<long, long>> &records)
+    {
+        for (const std::string &line : readLines(path))
+        {
+            long thread = numberAfter(line, "thread ");
+            long seq = numberAfter(line, " seq ");
+            CHECK(thread >= 0 && seq >= 0 && contains(line, " end"));
+            CHECK(records.insert({thread, seq}).second);
+        }
+    }
+}
+
+//! Files rotated under load lose no records and split none.
+LOGGER_TEST(rotateUnderLoad)
+{
+    std::string path = tempPath("rotate");
+    LoggerStream::setLogFileName(path);
+
+    const long count = 20000;
+    std::vector<std::thread> threads;
+    for (long t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([t] {
+            for (long i = 0; i < count; ++i)
+                LOG_INFO << "thread" << t << "seq" << i << "end";
+        });
+    }
+
+    std::vector<std::string> archives;
+    for (int i = 0; i < 20; ++i)
+    {
+        std::string archive = path + "." + std::to_string(i);
+        rename(path.c_str(), archive.c_str());
+        LoggerStream::rotateFile();
+        archives.push_back(archive);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    LoggerStream::flush();
+
+    std::set<std::pair<long, long>> records;
+    archives.push_back(path);
+    for (const std::string &archive : archives)
+    {
+        readRecords(archive, records);
+        unlink(archive.c_str());
+    }
+    CHECK(records.size() == size_t(count * 4));
+}
+
+LOGGER_TEST(autoRotation)
+{
+    std::string path = tempPath("auto");
+    LoggerStream::setLogFileName(path);
+    LoggerStream::setAutoRotation(4096, 0, 3);
+
+    for (long i = 0; i < 1000; ++i)
+        LOG_INFO << "thread" << 0 << "seq" << i << "end";
+    LoggerStream::flush();
+
+    // name.1 is the newest archive, every file holds records after those of the next one
+    std::set<std::pair<long, long>> records;
+    long newer = 1000;
+    for (const char *suffix : {"", ".1", ".2", ".3"})
+    {
+        std::string name = path + suffix;
+        CHECK(exists(name));
+
+        struct stat st;
+        if (stat(name.c_str(), &st) == 0)
+            CHECK(st.st_size <= 4096 + 100);
+
+        std::set<std::pair<long, long>> file;
+        readRecords(name, file);
+        CHECK(!file.empty() && file.rbegin()->second < newer);
+        if (!file.empty())
+            newer = file.begin()->second;
+        records.insert(file.begin(), file.end());
+        unlink(name.c_str());
+    }
+    CHECK(!exists(path + ".4"));
+    CHECK(records.count({0, 999}) == 1);
+    CHECK(records.size() < 1000);
+}
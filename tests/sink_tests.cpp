@@ -0,0 +1,115 @@
+#include "logger_test.h"
+
+#include <memory>
+
+#include <unistd.h>
+
+namespace
+{
+    //! Sink keeping the records and counting flushes.
+    class TestSink : public LoggerStream::Sink
+    {
+    public:
+        void write(LoggerStream::Level level, const char *s, std::size_t size) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            records.emplace_back(level, std::string(s, size));
+        }
+
+        void flush() override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++flushes;
+        }
+
+        std::vector<std::pair<LoggerStream::Level, std::string>> taken()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return std::move(records);
+        }
+
+        std::mutex mutex;
+        std::vector<std::pair<LoggerStream::Level, std::string>> records;
+        int flushes = 0;
+    };
+}
+
+LOGGER_TEST(sinkLevels)
+{
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::setSeverityLevel(LoggerStream::Warning);
+    CHECK(!LoggerStream::isEnabled(LoggerStream::Debug));
+
+    std::shared_ptr<TestSink> sink = std::make_shared<TestSink>();
+    LoggerStream::addSink(sink, LoggerStream::Debug);
+    CHECK(LoggerStream::isEnabled(LoggerStream::Debug));
+
+    LOG_DEBUG << "debug";
+    LOG_WARNING << "warning";
+    std::vector<std::pair<LoggerStream::Level, std::string>> records = sink->taken();
+    CHECK(records.size() == 2);
+    CHECK(records.size() == 2 && records[0].first == LoggerStream::Debug);
+    CHECK(records.size() == 2 && contains(records[0].second, " debug"));
+    CHECK(records.size() == 2 && records[1].first == LoggerStream::Warning);
+    CHECK(collected().size() == 1);
+
+    // the lowest level of all outputs filters the records
+    LoggerStream::setSinkLevel(sink, LoggerStream::Error);
+    CHECK(!LoggerStream::isEnabled(LoggerStream::Info));
+    CHECK(LoggerStream::isEnabled(LoggerStream::Warning));
+    LOG_WARNING << "warning";
+    LOG_ERROR << "error";
+    records = sink->taken();
+    CHECK(records.size() == 1 && contains(records[0].second, " error"));
+    CHECK(collected().size() == 3);
+
+    LoggerStream::removeSink(sink);
+    LOG_ERROR << "removed";
+    CHECK(sink->taken().empty());
+    CHECK(collected().size() == 4);
+}
+
+//! Records with borrowed strings reach the sink joined, the same text as the log file.
+LOGGER_TEST(sinkParts)
+{
+    std::string path = tempPath("sink");
+    LoggerStream::setLogFileName(path, LoggerStream::FdSink);
+    LoggerStream::setStreamingThreshold(100);
+
+    std::shared_ptr<TestSink> sink = std::make_shared<TestSink>();
+    LoggerStream::addSink(sink);
+
+    const std::string large(1000, 'l');
+    LOG_INFO << "before" << large << "after";
+    LOG_INFO << "short";
+    closeLogFile();
+
+    std::vector<std::string> lines = readLines(path);
+    std::vector<std::pair<LoggerStream::Level, std::string>> records = sink->taken();
+    CHECK(lines.size() == 2);
+    CHECK(records.size() == 2);
+    for (size_t i = 0; i < lines.size() && i < records.size(); ++i)
+        CHECK(records[i].second == lines[i]);
+    CHECK(records.size() == 2 && contains(records[0].second, (" before " + large + " after").c_str()));
+    unlink(path.c_str());
+}
+
+LOGGER_TEST(sinkFlush)
+{
+    LoggerStream::setOutputHandler(collect);
+    std::shared_ptr<TestSink> sink = std::make_shared<TestSink>();
+    LoggerStream::addSink(sink);
+
+    LoggerStream::setAsync(1 << 16);
+    for (int i = 0; i < 100; ++i)
+        LOG_INFO << "record" << i;
+    LoggerStream::flush();
+    LoggerStream::setSync();
+
+    std::vector<std::pair<LoggerStream::Level, std::string>> records = sink->taken();
+    CHECK(records.size() == 100);
+    for (size_t i = 0; i < records.size(); ++i)
+        CHECK(numberAfter(records[i].second, "record ") == long(i));
+    std::lock_guard<std::mutex> lock(sink->mutex);
+    CHECK(sink->flushes >= 1);
+}
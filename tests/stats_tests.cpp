@@ -0,0 +1,91 @@
+#include "logger_test.h"
+
+#include <cstring>
+#include <thread>
+
+typedef LoggerStream::Histogram Histogram;
+
+//! Every value falls into the bucket whose bounds hold it, buckets are within 12.5%.
+LOGGER_TEST(histogramBuckets)
+{
+    for (unsigned b = 0; b < Histogram::bucketCount; ++b)
+    {
+        uint64_t upper = Histogram::upperBound(b);
+        CHECK(Histogram::bucket(upper) == b);
+        if (b + 1 < Histogram::bucketCount)
+            CHECK(Histogram::bucket(upper + 1) == b + 1);
+        if (b > 0)
+        {
+            uint64_t lower = Histogram::upperBound(b - 1) + 1;
+            CHECK(Histogram::bucket(lower) == b);
+            CHECK(upper - lower <= lower / 8);
+        }
+    }
+    CHECK(Histogram::upperBound(Histogram::bucketCount - 1) == UINT64_MAX);
+
+    Histogram histogram;
+    memset(histogram.counts, 0, sizeof(histogram.counts));
+    CHECK(histogram.quantile(0.5) == 0);
+    for (uint64_t value = 1; value <= 1000; ++value)
+        ++histogram.counts[Histogram::bucket(value)];
+    CHECK(histogram.count() == 1000);
+    CHECK(histogram.quantile(0.5) >= 500 && histogram.quantile(0.5) <= 500 + 500 / 8);
+    CHECK(histogram.quantile(0.99) >= 990 && histogram.quantile(0.99) <= 990 + 990 / 8);
+    CHECK(histogram.quantile(1) >= 1000);
+}
+
+//! Counters of exited threads are kept.
+LOGGER_TEST(statsCounters)
+{
+    LoggerStream::setOutputHandler(collect);
+    LoggerStream::setSeverityLevel(LoggerStream::Info);
+    LoggerStream::Stats before = LoggerStream::stats();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([] {
+            for (int i = 0; i < 100; ++i)
+            {
+                LOG_DEBUG << "skipped";
+                LOG_INFO << "info";
+                LOG_ERROR << "error";
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    LoggerStream::Stats stats = LoggerStream::stats();
+    CHECK(stats.records[LoggerStream::Debug] == before.records[LoggerStream::Debug]);
+    CHECK(stats.records[LoggerStream::Info] - before.records[LoggerStream::Info] == 400);
+    CHECK(stats.records[LoggerStream::Error] - before.records[LoggerStream::Error] == 400);
+
+    uint64_t bytes = 0;
+    for (const std::string &record : collected())
+        bytes += record.size() + 1;
+    CHECK(stats.bytes - before.bytes == bytes);
+    CHECK(stats.poolHits + stats.poolMisses - before.poolHits - before.poolMisses >= 800);
+}
+
+LOGGER_TEST(statsLatency)
+{
+    LoggerStream::setOutputHandler(collect);
+
+    LOG_INFO << "not measured";
+    LoggerStream::Stats stats = LoggerStream::stats();
+    CHECK(stats.recordLatency.count() == 0);
+    CHECK(stats.writeLatency.count() == 0);
+
+    LoggerStream::setLatencyStats(true);
+    for (int i = 0; i < 100; ++i)
+        LOG_INFO << "measured" << i;
+    LoggerStream::setLatencyStats(false);
+    LOG_INFO << "not measured";
+
+    stats = LoggerStream::stats();
+    CHECK(stats.recordLatency.count() == 100);
+    CHECK(stats.writeLatency.count() == 100);
+    CHECK(stats.recordLatency.quantile(0.5) > 0);
+    CHECK(stats.recordLatency.quantile(1) >= stats.writeLatency.quantile(0.5));
+}
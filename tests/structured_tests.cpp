@@ -0,0 +1,161 @@
+#include "logger_test.h"
+
+#include <map>
+
+#include <stdlib.h>
+
+namespace
+{
+    //! Reverses appendEscaped().
+    std::string unescape(const std::string &s)
+    {
+        std::string out;
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if (s[i] != '\\' || i + 1 == s.size())
+            {
+                out += s[i];
+                continue;
+            }
+
+            switch (s[++i])
+            {
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'u':
+                out += char(strtol(s.substr(i + 1, 4).c_str(), nullptr, 16));
+                i += 4;
+                break;
+            default:
+                out += s[i];
+                break;
+            }
+        }
+        return out;
+    }
+
+    //! Reads a quoted string at \a i, returns it unescaped and moves \a i after it.
+    std::string readQuoted(const std::string &s, size_t &i)
+    {
+        size_t start = ++i;
+        while (i < s.size() && s[i] != '"')
+            i += s[i] == '\\' ? 2 : 1;
+        return unescape(s.substr(start, i++ - start));
+    }
+
+    std::map<std::string, std::string> parseLogfmt(const std::string &record)
+    {
+        std::map<std::string, std::string> fields;
+        size_t i = 0;
+        while (i < record.size())
+        {
+            size_t equals = record.find('=', i);
+            if (equals == std::string::npos)
+                break;
+
+            std::string key = record.substr(i, equals - i);
+            i = equals + 1;
+            if (i < record.size() && record[i] == '"')
+            {
+                fields[key] = readQuoted(record, i);
+            }
+            else
+            {
+                size_t end = std::min(record.find(' ', i), record.size());
+                fields[key] = record.substr(i, end - i);
+                i = end;
+            }
+            ++i;
+        }
+        return fields;
+    }
+
+    //! Parses a flat object of strings and numbers.
+    std::map<std::string, std::string> parseJson(const std::string &record)
+    {
+        std::map<std::string, std::string> fields;
+        size_t i = 1;
+        while (i < record.size() && record[i] == '"')
+        {
+            std::string key = readQuoted(record, i);
+            CHECK(record[i] == ':');
+            ++i;
+            if (record[i] == '"')
+            {
+                fields[key] = readQuoted(record, i);
+            }
+            else
+            {
+                size_t end = record.find_first_of(",}", i);
+                fields[key] = record.substr(i, end - i);
+                i = end;
+            }
+            if (record[i] == ',')
+                ++i;
+        }
+        CHECK(record.back() == '}');
+        return fields;
+    }
+}
+
+//! Records of both formats parse back to the logged message and fields.
+LOGGER_TEST(structuredRoundTrip)
+{
+    LoggerStream::setOutputHandler(collect);
+    const std::string message = "quoted \"text\" with\nnew line, tab\t, \\ and \x01";
+    const std::string value = "a value = with \"quotes\"";
+
+    LoggerStream::setOutputFormat(LoggerStream::LogfmtFormat);
+    LOG_INFO << message << kv("plain", 42) << kv("text", value) << kv("bad key=\"x\"", "v") << kv("", 7);
+
+    LoggerStream::setOutputFormat(LoggerStream::JsonFormat);
+    LOG_WARNING << message << kv("plain", 42) << kv("text", value) << kv("odd \"key\"", 1.5);
+
+    std::vector<std::string> records = collected();
+    CHECK(records.size() == 2);
+    if (records.size() != 2)
+        return;
+
+    // invalid characters of logfmt keys are replaced, an empty key becomes "_"
+    auto logfmt = parseLogfmt(records[0]);
+    CHECK(logfmt["level"] == "info");
+    CHECK(logfmt["msg"] == message);
+    CHECK(logfmt["plain"] == "42");
+    CHECK(logfmt["text"] == value);
+    CHECK(logfmt["bad_key__x_"] == "v");
+    CHECK(logfmt["_"] == "7");
+
+    auto json = parseJson(records[1]);
+    CHECK(json["level"] == "warning");
+    CHECK(json["msg"] == message);
+    CHECK(json["plain"] == "42");
+    CHECK(json["text"] == value);
+    CHECK(strtod(json["odd \"key\""].c_str(), nullptr) == 1.5);
+}
+
+//! Text records keep the header and get the fields as key=value.
+LOGGER_TEST(textFields)
+{
+    captureRecords();
+    LOG_INFO << "message" << kv("count", 3) << kv("name", "a b") << kv("ok", true);
+
+    std::vector<TestRecord> records = captured();
+    CHECK(records.size() == 1);
+    CHECK(records.size() == 1 && contains(records[0].message, " message"));
+    CHECK(records.size() == 1 && contains(records[0].message, "count=3"));
+    CHECK(records.size() == 1 && contains(records[0].message, "ok=true"));
+    CHECK(records.size() == 1 && contains(records[0].message, "name="));
+}
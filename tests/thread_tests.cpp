@@ -0,0 +1,87 @@
+#include "logger_test.h"
+
+#include <thread>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    std::string threadFields(const char *name)
+    {
+        std::string fields = "[" + std::to_string(getpid()) + ":" + std::to_string(syscall(SYS_gettid));
+        if (*name)
+            fields += std::string(" ") + name;
+        return fields + "] ";
+    }
+}
+
+LOGGER_TEST(threadIds)
+{
+    captureRecords();
+
+    LOG_INFO << "none";
+    LoggerStream::setThreadIdEnabled(true);
+    LOG_INFO << "id";
+    LoggerStream::setThreadName("main");
+    LOG_INFO << "name";
+    // the header is built from parts with a long prefix
+    LoggerStream::setMessagePrefix(std::string(300, 'p'));
+    LOG_INFO << "long";
+    LoggerStream::setMessagePrefix("");
+    LoggerStream::setThreadName("");
+    LOG_INFO << "unnamed";
+    LoggerStream::setThreadIdEnabled(false);
+    LOG_INFO << "disabled";
+
+    std::vector<TestRecord> records = captured();
+    CHECK(records.size() == 6);
+    if (records.size() != 6)
+        return;
+
+    std::string pid = "[" + std::to_string(getpid()) + "] ";
+    CHECK(contains(records[0].header, pid.c_str()));
+    CHECK(contains(records[1].header, threadFields("").c_str()));
+    CHECK(contains(records[2].header, threadFields("main").c_str()));
+    CHECK(contains(records[3].header, threadFields("main").c_str()));
+    CHECK(contains(records[4].header, threadFields("").c_str()));
+    CHECK(contains(records[5].header, pid.c_str()));
+}
+
+//! Asynchronous and binary records carry the id and the name of the thread which created them.
+LOGGER_TEST(threadNamesAsync)
+{
+    captureRecords();
+    LoggerStream::setThreadIdEnabled(true);
+
+    for (int binary = 0; binary < 2; ++binary)
+    {
+        LoggerStream::setBinaryMode(binary != 0);
+        LoggerStream::setAsync(1 << 16);
+
+        std::vector<std::string> expected(4);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([t, &expected] {
+                std::string name = "worker" + std::to_string(t);
+                LoggerStream::setThreadName(name);
+                expected[t] = threadFields(name.c_str());
+                for (int i = 0; i < 100; ++i)
+                    LOG_INFO << "thread" << t;
+            });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+        LoggerStream::setSync();
+
+        std::vector<TestRecord> records = captured();
+        CHECK(records.size() == size_t(400 * (binary + 1)));
+        for (size_t i = 400 * binary; i < records.size(); ++i)
+        {
+            long t = numberAfter(records[i].message, "thread ");
+            CHECK(t >= 0 && t < 4);
+            CHECK(t >= 0 && t < 4 && contains(records[i].header, expected[t].c_str()));
+        }
+    }
+}
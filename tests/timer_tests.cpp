@@ -0,0 +1,67 @@
+#include "logger_test.h"
+
+#include <chrono>
+#include <thread>
+
+#include <stdlib.h>
+
+namespace
+{
+    double tookUs(const std::string &record, const char *name)
+    {
+        std::string key = std::string(" ") + name + " took ";
+        size_t position = record.find(key);
+        if (position == std::string::npos)
+            return -1;
+        return strtod(record.c_str() + position + key.size(), nullptr);
+    }
+}
+
+//! A timer writes the duration only over the threshold.
+LOGGER_TEST(timerThreshold)
+{
+    LoggerStream::setOutputHandler(collect);
+
+    {
+        auto timer = logScope("fast", std::chrono::hours(1));
+    }
+    {
+        auto timer = logScope("slow", std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    {
+        auto timer = logScope("always");
+    }
+    LoggerStream::setSeverityLevel(LoggerStream::Warning);
+    {
+        auto timer = logScope("disabled");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::vector<std::string> records = collected();
+    CHECK(records.size() == 2);
+    if (records.size() != 2)
+        return;
+    CHECK(tookUs(records[0], "slow") >= 5000);
+    CHECK(contains(records[0], " us"));
+    CHECK(tookUs(records[1], "always") >= 0);
+}
+
+//! LOG_SCOPE samples the scopes of its call site, logScope() the timers of the thread.
+LOGGER_TEST(timerSampling)
+{
+    LoggerStream::setOutputHandler(collect);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        LOG_SCOPE("site", std::chrono::hours(1), LoggerStream::Info, 10);
+    }
+    CHECK(collected().size() == 10);
+
+    for (int i = 0; i < 50; ++i)
+    {
+        auto first = logScope("first", std::chrono::hours(1), LoggerStream::Info, 10);
+        auto second = logScope("second", std::chrono::hours(1), LoggerStream::Info, 10);
+    }
+    CHECK(collected().size() == 20);
+}